@@ -0,0 +1,54 @@
+#version 460 core
+
+layout (location = 0) in vec2 uv;
+
+// the scene for fxaa, or the resolved taa history
+layout (set = 0, binding = 0) uniform sampler2D src;
+
+layout (push_constant) uniform push_data {
+	vec2 texel; // 1 / src size
+	uint fxaa; // 0 just copies src
+} pd;
+
+layout (location = 0) out vec4 fragcolor;
+
+// src is linear, edges are found on roughly perceptual luma
+float luma(vec3 c) {
+	return sqrt(dot(c, vec3(0.299, 0.587, 0.114)));
+}
+
+// reduced fxaa, from Timothy Lottes' FXAA whitepaper:
+// blur along the edge direction found from the luma gradient of the 4 diagonal neighbours,
+// falling back to a narrower blur if the wide one picks up luma from outside the neighbourhood
+vec3 fxaa(vec2 p) {
+	const float reduceMin = 1.0 / 128.0;
+	const float reduceMul = 1.0 / 8.0;
+	const float spanMax = 8.0;
+
+	vec3 m = texture(src, p).rgb;
+	float lnw = luma(texture(src, p + vec2(-1.0, -1.0) * pd.texel).rgb);
+	float lne = luma(texture(src, p + vec2(1.0, -1.0) * pd.texel).rgb);
+	float lsw = luma(texture(src, p + vec2(-1.0, 1.0) * pd.texel).rgb);
+	float lse = luma(texture(src, p + vec2(1.0, 1.0) * pd.texel).rgb);
+	float lm = luma(m);
+
+	float lmin = min(lm, min(min(lnw, lne), min(lsw, lse)));
+	float lmax = max(lm, max(max(lnw, lne), max(lsw, lse)));
+
+	vec2 dir = vec2((lsw + lse) - (lnw + lne), (lnw + lsw) - (lne + lse));
+
+	float reduce = max((lnw + lne + lsw + lse) * 0.25 * reduceMul, reduceMin);
+	float rcpMin = 1.0 / (min(abs(dir.x), abs(dir.y)) + reduce);
+	dir = clamp(dir * rcpMin, -spanMax, spanMax) * pd.texel;
+
+	vec3 a = 0.5 * (texture(src, p + dir * (1.0 / 3.0 - 0.5)).rgb + texture(src, p + dir * (2.0 / 3.0 - 0.5)).rgb);
+	vec3 b = 0.5 * a + 0.25 * (texture(src, p - 0.5 * dir).rgb + texture(src, p + 0.5 * dir).rgb);
+
+	float lb = luma(b);
+	return (lb < lmin || lb > lmax) ? a : b;
+}
+
+void main() {
+	vec3 c = pd.fxaa != 0 ? fxaa(uv) : texture(src, uv).rgb;
+	fragcolor = vec4(c, 1.0);
+}
@@ -0,0 +1,11 @@
+#version 460 core
+
+// fullscreen triangle from the vertex index, no vertex buffer needed
+// uv (0, 0) is the top left of the screen, matching the image being filtered
+
+layout (location = 0) out vec2 uv;
+
+void main() {
+	uv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+	gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
+}
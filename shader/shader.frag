@@ -1,5 +1,8 @@
 #version 460 core
 
+// hidden fragments never run, so they never ask for pages
+layout (early_fragment_tests) in;
+
 layout (location = 0) in vec3 p;
 layout (location = 1) in vec3 n;
 layout (location = 2) in vec2 uv;
@@ -7,16 +10,127 @@ layout (location = 3) in vec3 eye;
 
 layout (location = 4) in mat3 tbn;
 
-// maps are defined as [diffuse, normal, displacement]
-layout (set = 0, binding = 1) uniform sampler2D maps[3];
+// virtual textures (see src/vtex.hpp): maps are sampled through the page table out of pages in the cache,
+// and some pixels record the pages they wanted in the feedback bits, which decide what gets loaded
+const uint pageSize = 128;
+const uint border = 4;
+const uint slotSize = pageSize + 2u * border;
+const uint maxTextures = 8;
+const uint noTexture = 0xffffffffu;
+const float maxAniso = 8.0; // the cache sampler's, so its footprint stays inside a page's border
+
+struct vtTexture {
+	uvec2 size; // texels at level 0, powers of two
+	uint levels;
+	uint pad;
+	uint offsets[16]; // entry of each level's first page
+};
+
+layout (set = 0, binding = 1) uniform sampler2D vtCache;
+
+layout (std430, set = 0, binding = 2) readonly buffer vtTable {
+	vtTexture textures[maxTextures];
+	uint entries[]; // slot and level of the page, or of the coarser page standing in for it
+};
+
+layout (std430, set = 0, binding = 3) buffer vtFeedback {
+	uint wanted[]; // a bit per entry
+};
+
+// maps are [diffuse, normal, displacement] virtual textures, noTexture until loaded
+layout (push_constant) uniform push_data {
+	layout (offset = 16) uint maps[3];
+	uint frame;
+} pd;
 
 layout (location = 0) out vec4 fragcolor;
 
+// uv derivatives, taken once up front since the displacement march samples in non-uniform control flow
+vec2 uvdx;
+vec2 uvdy;
+
+// one pixel in each 4x4 block records its pages, a different one every frame, so the whole screen is
+// covered every 16 frames without every fragment doing atomics
+bool recording;
+
 struct point {
 	vec3 p;
 	vec3 color;
 };
 
+// the level anisotropic filtering would use, from the derivatives in level 0 texels
+float vt_lod(uint id) {
+	vec2 size = vec2(textures[id].size);
+	float a = length(uvdx * size);
+	float b = length(uvdy * size);
+	float lod = log2(max(min(a, b), max(a, b) / maxAniso));
+	return clamp(lod, 0.0, float(textures[id].levels - 1u));
+}
+
+uint vt_index(uint id, uint level, vec2 wuv) {
+	uvec2 size = max(textures[id].size >> level, uvec2(1));
+	uvec2 pages = (size + pageSize - 1u) / pageSize;
+	uvec2 page = min(uvec2(wuv * vec2(size)) / pageSize, pages - 1u);
+	return textures[id].offsets[level] + page.y * pages.x + page.x;
+}
+
+// from whichever page the entry points at, which is coarser than the one looked up if that isn't resident
+vec4 vt_fetch(uint id, uint e, vec2 wuv) {
+	uint level = (e >> 24) & 0xfu;
+	vec2 size = vec2(max(textures[id].size >> level, uvec2(1)));
+	vec2 texel = wuv * size;
+	vec2 page = min(floor(texel / float(pageSize)), ceil(size / float(pageSize)) - 1.0);
+	vec2 slot = vec2(e & 0xfffu, (e >> 12) & 0xfffu);
+
+	vec2 cache = vec2(textureSize(vtCache, 0));
+	vec2 scale = size / cache;
+	vec2 st = (slot * float(slotSize) + float(border) + texel - page * float(pageSize)) / cache;
+	return textureGrad(vtCache, st, uvdx * scale, uvdy * scale);
+}
+
+// blend between the two nearest levels, or just take the nearest
+vec4 vt_sample(uint id, vec2 uv, vec4 fallback, bool blend) {
+	if (id == noTexture) {
+		return fallback;
+	}
+
+	vec2 wuv = fract(uv); // the textures repeat
+	float lod = vt_lod(id);
+	uint fine = blend ? uint(lod) : uint(lod + 0.5);
+
+	uint e0 = entries[vt_index(id, fine, wuv)];
+	if ((e0 & 0x80000000u) == 0u) {
+		return fallback; // not even the last level is in yet
+	}
+	if (!blend) {
+		return vt_fetch(id, e0, wuv);
+	}
+
+	uint e1 = entries[vt_index(id, min(fine + 1u, textures[id].levels - 1u), wuv)];
+	if ((e1 & 0x80000000u) == 0u) {
+		e1 = e0;
+	}
+	return mix(vt_fetch(id, e0, wuv), vt_fetch(id, e1, wuv), fract(lod));
+}
+
+// the finest page sampling uv wants, coarser ones are added on the cpu
+void vt_want(uint id, vec2 uv) {
+	if (!recording || id == noTexture) {
+		return;
+	}
+
+	uint i = vt_index(id, uint(vt_lod(id)), fract(uv));
+	uint bit = 1u << (i & 31u);
+	if ((wanted[i >> 5] & bit) == 0u) {
+		atomicOr(wanted[i >> 5], bit);
+	}
+}
+
+// displacement is marched at a single level, blending two at every step isn't worth it
+float height(vec2 uv) {
+	return vt_sample(pd.maps[2], uv, vec4(0.0), false).r;
+}
+
 vec2 disp_map(vec2 uv) {
 	const float scale = 0.1;
 	vec3 tldir = normalize(transpose(tbn) * (eye - p)); // transpose == inverse for orthogonal matrix
@@ -34,7 +148,7 @@ vec2 disp_map(vec2 uv) {
 	const float pstep = 1.0 / samples;
 	uint idx = 0;
 
-	float d = texture(maps[2], uv).r; // assuming 1.0 == max height in disp map
+	float d = height(uv); // assuming 1.0 == max height in disp map
 	float td = 0;
 	vec2 duv = uv;
 
@@ -42,22 +156,22 @@ vec2 disp_map(vec2 uv) {
 	while (d >= td && idx < samples) {
 		idx++;
 		duv += tldir.xy * pstep;
-		d = texture(maps[2], duv).r;
+		d = height(duv);
 		td += pstep;
 	}
 
 	// weight "before" and "after" uv offsets by how far away they are from their respective layers
 	vec2 preuv = duv - tldir.xy * pstep;
-	float pred = texture(maps[2], preuv).r - td + pstep;
+	float pred = height(preuv) - td + pstep;
 	float currd = d - td;
 	float w = currd / (currd - pred);
-	
+
 	return mix(duv, preuv, w);
 }
 
 vec3 blinn_phong(in point l, in vec3 c, in vec3 nn) {
 	vec3 ldir = l.p - p;
-	
+
 	float dist = length(ldir);
 
 	const vec3 cf = vec3(0.0, 1.0, 0.0);
@@ -95,15 +209,26 @@ void main() {
 
 	const point l = point(vec3(0.0, 2.0, 0.0), vec3(1.0));
 
+	uvdx = dFdx(uv);
+	uvdy = dFdy(uv);
+
+	uvec2 px = uvec2(gl_FragCoord.xy) & 3u;
+	recording = px.x + 4u * px.y == (pd.frame & 15u);
+
 	vec2 duv = disp_map(uv);
 
+	// the flat maps the placeholders used to be stand in until a texture loads
 	// normal map
-	vec3 nt = texture(maps[1], duv).rgb;
+	vec3 nt = vt_sample(pd.maps[1], duv, vec4(0.5, 0.5, 1.0, 1.0), true).rgb;
 	nt = normalize(nt * 2.0 - 1.0); // scale from [0, 1] -> [-1, 1]
 	nt = tbn * nt; // map to world space
 
 	// diffuse map
-	vec3 c = texture(maps[0], duv).rgb;
+	vec3 c = vt_sample(pd.maps[0], duv, vec4(vec3(0.216), 1.0), true).rgb;
+
+	vt_want(pd.maps[0], duv);
+	vt_want(pd.maps[1], duv);
+	vt_want(pd.maps[2], uv);
 
 	c = blinn_phong(l, c, nt);
 
@@ -5,10 +5,11 @@
 // right handed system, -Y is up normally but I flipped the rasterizer
 // depth goes from 0 to 1 as object gets farther away
 
+// see vtx::packed, normal and tangent are octahedral-encoded
 layout (location = 0) in vec3 position;
-layout (location = 1) in vec3 normal;
+layout (location = 1) in vec2 normalOct;
 layout (location = 2) in vec2 texcoord;
-layout (location = 3) in vec3 tangent;
+layout (location = 3) in vec2 tangentOct;
 
 layout (set = 0, binding = 0) uniform uniformBuffer {
 	mat4 model;
@@ -27,7 +28,18 @@ layout (location = 3) out vec3 eye;
 
 layout (location = 4) out mat3 tbn;
 
+// inverse of vtx::octEncode
+vec3 octDecode(vec2 f) {
+	vec3 v = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+	float t = max(-v.z, 0.0);
+	v.xy += mix(vec2(t), vec2(-t), greaterThanEqual(v.xy, vec2(0.0)));
+	return normalize(v);
+}
+
 void main() {
+	vec3 normal = octDecode(normalOct);
+	vec3 tangent = octDecode(tangentOct);
+
 	vec4 p4 = ubo.model * vec4(position, 1.0);
 
 	gl_Position = ubo.proj * ubo.view * p4;
@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+#include <fcntl.h>
+
+#include "main.hpp"
+
+#include "vloader.hpp"
+#include "iloader.hpp"
+
+#include "options.hpp"
+
+// asset streaming: every asset loads as a job, results arrive in a mailbox in the order they finish,
+// and each frame uploads whatever has arrived since the last one. things start out with placeholders,
+// so the first frame is drawn however long the assets take
+
+namespace {
+    // one per thing, in thing order
+    constexpr std::array<const char*, 2> meshPaths = {
+        "models/sphere.obj",
+        "models/cube.obj",
+    };
+
+    // diffuse, normal and height per thing, in thing order
+    constexpr std::array<const char*, 6> texturePaths = {
+        "textures/grass/diffuse.jpg",
+        "textures/grass/normal.jpg",
+        "textures/grass/height.jpg",
+
+        "textures/grass2/diffuse.jpg",
+        "textures/grass2/normal.jpg",
+        "textures/grass2/height.jpg",
+    };
+}
+
+// the loaders only run on a thread of their own, so a job starts one and waits for it, which still
+// bounds how many are in flight, and meshes then cook (optimise, simplify, split) in the same job.
+// the prefetch runs alongside them rather than ahead, so no loader waits on files other than its own
+void appvk::loadAssets() {
+    PROF_ZONE("loadAssets");
+
+    static_assert(meshPaths.size() == std::tuple_size<decltype(things)>::value && texturePaths.size() == 3 * meshPaths.size());
+
+    jobs.submit(assetLoads, [this] { prefetchAssets(); });
+
+    for (size_t i = 0; i < meshPaths.size(); i++) {
+        jobs.submit(assetLoads, [this, i] {
+            PROF_ZONE("load mesh");
+
+            vload::vloader obj(meshPaths[i], true, true, true);
+            obj.dispatch();
+            obj.join();
+
+            loadedAsset a;
+            a.thing = i;
+            a.path = meshPaths[i];
+            a.cooked = cookMesh(meshPaths[i], obj.meshList[0].verts, obj.meshList[0].indices);
+            loadedAssets.push(std::move(a));
+        });
+    }
+
+    for (size_t i = 0; i < texturePaths.size(); i++) {
+        jobs.submit(assetLoads, [this, i] {
+            PROF_ZONE("load texture");
+
+            loadedAsset a;
+            a.thing = i / 3;
+            a.map = i % 3;
+            a.path = texturePaths[i];
+
+            // tile files are the only form virtual textures are read in, so one that can't be written is fatal
+            if (virtualTextures) {
+                if (!vt::fresh(texturePaths[i])) {
+                    iload::iloader ld(texturePaths[i], false);
+                    ld.dispatch();
+                    ld.join();
+                    vt::bake(vt::pathFor(texturePaths[i]), ld.width, ld.height, ld.data);
+                }
+
+                a.tiles = std::make_unique<vt::tileFile>(vt::pathFor(texturePaths[i]));
+                loadedAssets.push(std::move(a));
+                return;
+            }
+
+            const bool bake = options::get().bakeTextures;
+            if (bake && baked::fresh(texturePaths[i])) {
+                a.baked = std::make_unique<baked::mapping>(baked::pathFor(texturePaths[i]));
+                a.width = a.baked->width();
+                a.height = a.baked->height();
+                loadedAssets.push(std::move(a));
+                return;
+            }
+
+            iload::iloader ld(texturePaths[i], false);
+            ld.dispatch();
+            ld.join();
+
+            // copied out, the loader's pixels go with it
+            a.width = ld.width;
+            a.height = ld.height;
+            a.pixels.assign(ld.data, ld.data + size_t(ld.width) * ld.height * 4);
+
+            // for next time, a read-only asset directory just means decoding again
+            if (bake) {
+                try {
+                    baked::write(texturePaths[i], a.width, a.height, a.pixels.data());
+                } catch (const std::exception& e) {
+                    cerr << std::string(e.what()) + "\n"; // whole, other jobs are logging too
+                }
+            }
+
+            loadedAssets.push(std::move(a));
+        });
+    }
+
+    assetsPending = meshPaths.size() + texturePaths.size();
+}
+
+// the loaders read with small blocking reads, so on a cold disk they wait on one read at a time. asking
+// the kernel to read every file ahead, in the order the loaders were submitted, keeps the whole lot queued
+// on the device without copying any of it out, and the loaders then mostly find their data in the page cache
+void appvk::prefetchAssets() {
+    PROF_ZONE("prefetchAssets");
+
+    std::vector<std::string> paths(meshPaths.begin(), meshPaths.end());
+    for (const char* path : texturePaths) {
+        // the file the job will actually read, tile files are read a page at a time as they're needed
+        if (virtualTextures && vt::fresh(path)) {
+            continue;
+        }
+        const bool useBaked = !virtualTextures && options::get().bakeTextures && baked::fresh(path);
+        paths.push_back(useBaked ? baked::pathFor(path) : std::string(path));
+    }
+
+    uint64_t total = 0;
+    for (const std::string& path : paths) {
+        const io::file f(path);
+        // only advice, a loader that gets there first just reads it itself
+        posix_fadvise(f.fd(), 0, 0, POSIX_FADV_WILLNEED);
+        total += f.size();
+    }
+
+    std::ostringstream log; // one write, the loaders are printing too
+    log << "prefetching " << std::fixed << std::setprecision(1) << total / 1048576.0 << " MiB of assets from "
+        << paths.size() << " files\n";
+    cout << log.str();
+}
+
+// a unit cube and flat 1x1 maps, shared by everything still loading
+void appvk::createPlaceholders() {
+    PROF_ZONE("createPlaceholders");
+
+    std::vector<vtx::packed> verts;
+    std::vector<uint32_t> indices;
+    for (int axis = 0; axis < 3; axis++) {
+        for (float side : { -1.0f, 1.0f }) {
+            glm::vec3 n(0.0f);
+            n[axis] = side;
+            glm::vec3 u(0.0f);
+            u[(axis + 1) % 3] = 1.0f;
+            const glm::vec3 v = glm::cross(n, u); // u x v == n, so faces wind counter-clockwise from outside
+
+            const uint32_t base = verts.size();
+            for (int corner = 0; corner < 4; corner++) {
+                const glm::vec2 uv(corner & 1, corner >> 1);
+                const glm::vec3 p = 0.5f * (n + (2.0f * uv.x - 1.0f) * u + (2.0f * uv.y - 1.0f) * v);
+                verts.push_back(vtx::pack(p, n, uv, u));
+            }
+            indices.insert(indices.end(), { base, base + 1, base + 3, base, base + 3, base + 2 });
+        }
+    }
+
+    cookedMesh cube;
+    cube.levels.push_back(cookLevel(verts, indices));
+    cube.sphere = glm::vec4(0.0f, 0.0f, 0.0f, std::sqrt(0.75f));
+    placeholderMesh = uploadMesh(cube);
+
+    const std::array<std::array<uint8_t, 4>, 3> texels = {{
+        { 128, 128, 128, 255 }, // grey
+        { 188, 188, 255, 255 }, // maps are sampled as srgb, 188 comes back as the 0.5 of a flat normal
+        { 0, 0, 0, 255 }, // no displacement
+    }};
+
+    for (size_t i = 0; i < placeholderMaps.size(); i++) {
+        texture& tx = placeholderMaps[i];
+        tx = createTextureImage(1, 1, texels[i].data(), false);
+        tx.view = createImageView(tx.im, VK_FORMAT_R8G8B8A8_SRGB, tx.mipLevels, VK_IMAGE_ASPECT_COLOR_BIT);
+        tx.samp = createSampler(tx.mipLevels);
+    }
+
+    for (thing& t : things) {
+        t.lods = placeholderMesh;
+        t.maps = placeholderMaps;
+    }
+}
+
+void appvk::destroyPlaceholders() {
+    for (texture& tx : placeholderMaps) {
+        vkDestroySampler(dev, tx.samp, nullptr);
+        vkDestroyImageView(dev, tx.view, nullptr);
+        vkDestroyImage(dev, tx.im, nullptr);
+        memory.free(dev, tx.mem);
+    }
+
+    for (mesh& m : placeholderMesh) {
+        freeMesh(m);
+    }
+}
+
+// upload whatever finished loading since the last frame. placeholders aren't freed, other things may still use them
+void appvk::integrateAssets() {
+    PROF_ZONE("integrateAssets");
+
+    for (loadedAsset& a : loadedAssets.take()) {
+        thing& t = things[a.thing];
+
+        if (!a.map) {
+            t.lods = uploadMesh(a.cooked);
+            t.lod = 0;
+            t.meshResident = true;
+            cout << "loaded model " << a.path << "\n";
+        } else if (a.tiles) {
+            // pages are only read once something samples them
+            const uint32_t id = vtPages.add(a.tiles->pages());
+            vtFiles.push_back(std::move(a.tiles));
+            t.virtualMaps[*a.map] = id;
+            cout << "loaded virtual texture " << a.path << "\n";
+        } else {
+            texture& tx = t.maps[*a.map];
+            tx = a.baked ? createBakedTexture(*a.baked) : createTextureImage(a.width, a.height, a.pixels.data());
+            tx.view = createImageView(tx.im, VK_FORMAT_R8G8B8A8_SRGB, tx.mipLevels, VK_IMAGE_ASPECT_COLOR_BIT);
+            tx.samp = createSampler(tx.mipLevels);
+            t.mapsResident[*a.map] = true;
+
+            // sets of images in flight still point at the placeholder, each is rewritten when its image comes round
+            t.staleSets.assign(t.staleSets.size(), true);
+            cout << "loaded texture " << a.path << (a.baked ? " (baked)" : "") << "\n";
+        }
+
+        assetsPending--;
+    }
+
+    jobs.rethrowIfFailed(assetLoads);
+}
+
+void appvk::refreshTextureSets(uint32_t imageIndex) {
+    for (thing& t : things) {
+        if (!t.staleSets[imageIndex]) {
+            continue;
+        }
+
+        std::array<VkDescriptorImageInfo, 3> imageInfos;
+        for (size_t i = 0; i < imageInfos.size(); i++) {
+            imageInfos[i].sampler = t.maps[i].samp;
+            imageInfos[i].imageView = t.maps[i].view;
+            imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        }
+
+        VkWriteDescriptorSet set{};
+        set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        set.dstSet = t.dsets[imageIndex];
+        set.dstBinding = 1;
+        set.dstArrayElement = 0;
+        set.descriptorCount = imageInfos.size();
+        set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        set.pImageInfo = imageInfos.data();
+
+        vkUpdateDescriptorSets(dev, 1, &set, 0, nullptr);
+        t.staleSets[imageIndex] = false;
+    }
+}
+
+void appvk::finishLoading() {
+    PROF_ZONE("finishLoading");
+
+    jobs.wait(assetLoads);
+    integrateAssets();
+}
+
+void appvk::abandonAssets() {
+    try {
+        jobs.wait(assetLoads);
+    } catch (const std::exception&) {
+        // shutting down anyway
+    }
+}
@@ -0,0 +1,109 @@
+#include "baked.hpp"
+
+#include "cpuprof.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace baked {
+    namespace {
+        constexpr uint32_t magic = 0x656b6162; // "bake"
+        constexpr uint32_t version = 1;
+
+        uint64_t alignUp(uint64_t n) {
+            return (n + alignment - 1) / alignment * alignment;
+        }
+    }
+
+    std::string pathFor(std::string_view source) {
+        return std::string(source) + ".baked";
+    }
+
+    bool fresh(std::string_view source) {
+        struct stat src, dst;
+        if (stat(std::string(source).c_str(), &src) != 0 || stat(pathFor(source).c_str(), &dst) != 0) {
+            return false;
+        }
+        return dst.st_mtime >= src.st_mtime;
+    }
+
+    void write(std::string_view source, uint32_t width, uint32_t height, const uint8_t* pixels) {
+        PROF_ZONE("bake texture");
+
+        header h{};
+        h.magic = magic;
+        h.version = version;
+        h.width = width;
+        h.height = height;
+        h.offset = alignment;
+        h.size = uint64_t(width) * height * 4;
+
+        const std::string path = pathFor(source);
+        const std::string temp = path + ".tmp";
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+            const std::vector<char> zeros(alignment, 0);
+            out.write(zeros.data(), h.offset - sizeof(h));
+            out.write(reinterpret_cast<const char*>(pixels), h.size);
+            out.write(zeros.data(), alignUp(h.offset + h.size) - (h.offset + h.size)); // so no mapped page is past the end
+
+            if (!out) {
+                std::remove(temp.c_str());
+                throw std::runtime_error("cannot write " + temp + "!");
+            }
+        }
+
+        if (std::rename(temp.c_str(), path.c_str()) != 0) {
+            std::remove(temp.c_str());
+            throw std::runtime_error("cannot write " + path + "!");
+        }
+    }
+
+    mapping::mapping(std::string_view path) {
+        PROF_ZONE("map baked texture");
+
+        const std::string p(path);
+        const int fd = ::open(p.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("cannot open file " + p + "!");
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || uint64_t(st.st_size) < alignment || uint64_t(st.st_size) % alignment != 0) {
+            ::close(fd);
+            throw std::runtime_error("invalid baked texture " + p + "!");
+        }
+        length = size_t(st.st_size);
+
+        // shared and read-only, so the pages are the page cache's own. populating a writable private mapping
+        // would copy every page to break copy-on-write, so the reads are only started here instead
+        void* m = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd); // the mapping keeps the file
+        if (m == MAP_FAILED) {
+            throw std::runtime_error("cannot map file " + p + "!");
+        }
+        base = static_cast<uint8_t*>(m);
+        madvise(base, length, MADV_WILLNEED);
+
+        std::memcpy(&head, base, sizeof(head));
+        if (head.magic != magic || head.version != version || head.offset % alignment != 0
+            || head.size != uint64_t(head.width) * head.height * 4 || head.offset + head.size > length) {
+            munmap(base, length);
+            throw std::runtime_error("invalid baked texture " + p + "!");
+        }
+    }
+
+    mapping::~mapping() {
+        munmap(base, length);
+    }
+}
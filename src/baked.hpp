@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Pre-baked textures: decoded rgba8 written next to the source image the first time it loads, so later
+// runs map the file and hand it to the gpu without decoding or copying it. The pixels start on an
+// alignment boundary and the file is padded to one, so the whole mapping can be imported as host memory.
+namespace baked {
+    // imports need 4 KiB in practice, this covers devices that want more
+    constexpr uint64_t alignment = 65536;
+
+    struct header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint64_t offset; // of the pixels
+        uint64_t size; // bytes of pixels
+    };
+
+    std::string pathFor(std::string_view source);
+
+    // there's a baked copy at least as new as source
+    bool fresh(std::string_view source);
+
+    // written to a temporary and renamed into place, so nothing ever maps half a file. throws on failure
+    void write(std::string_view source, uint32_t width, uint32_t height, const uint8_t* pixels);
+
+    // a baked file mapped read-only straight from the page cache, with its pages read ahead so importing it
+    // mostly doesn't wait on the disk. drivers that won't import read-only memory get the staging window instead
+    class mapping {
+    public:
+        explicit mapping(std::string_view path); // throws if it isn't a baked file
+        ~mapping();
+
+        mapping(const mapping&) = delete;
+        mapping& operator=(const mapping&) = delete;
+
+        uint32_t width() const { return head.width; }
+        uint32_t height() const { return head.height; }
+        uint64_t offset() const { return head.offset; }
+        const uint8_t* pixels() const { return base + head.offset; }
+
+        // the whole file, a multiple of alignment
+        void* data() const { return base; }
+        size_t size() const { return length; }
+
+    private:
+        uint8_t* base = nullptr;
+        size_t length = 0;
+        header head{};
+    };
+}
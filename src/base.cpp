@@ -52,9 +52,9 @@ void basevk::createWindow(bool fullscreen) {
     }
 
 	if (fullscreen) {
-    	w = glfwCreateWindow(options::screenWidth, options::screenHeight, "demo", glfwGetPrimaryMonitor(), nullptr);
+    	w = glfwCreateWindow(options::get().screenWidth, options::get().screenHeight, "demo", glfwGetPrimaryMonitor(), nullptr);
 	} else {
-    	w = glfwCreateWindow(options::screenWidth, options::screenHeight, "demo", nullptr, nullptr);
+    	w = glfwCreateWindow(options::get().screenWidth, options::get().screenHeight, "demo", nullptr, nullptr);
 	}
 
     if (!w) {
@@ -125,7 +125,7 @@ void basevk::populateDebugMessenger(VkDebugUtilsMessengerCreateInfoEXT &createIn
     createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
                                     VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
     
-    if (options::verbose) {
+    if (options::get().verbose) {
         createInfo.messageSeverity |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
     }
 
@@ -0,0 +1,200 @@
+#include "bench.hpp"
+
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+
+using std::cout;
+
+namespace bench {
+    // default path orbits the origin while bobbing up and down a bit
+    camPath::camPath() {
+        constexpr unsigned int steps = 16;
+        constexpr float period = 16.0f;
+        constexpr float radius = 3.0f;
+
+        for (unsigned int i = 0; i <= steps; i++) {
+            const float a = 2.0f * float(M_PI) * i / steps;
+            key k;
+            k.t = period * i / steps;
+            k.pos = glm::vec3(radius * std::sin(a), 0.5f + 0.25f * std::sin(2.0f * a), -radius * std::cos(a));
+            k.front = glm::normalize(-k.pos);
+            keys.push_back(k);
+        }
+    }
+
+    // one key per line: "t px py pz fx fy fz"
+    void camPath::load(std::string_view file) {
+        std::ifstream in(file.data());
+        if (!in) {
+            throw std::runtime_error(std::string("cannot open camera path ") + file.data() + "!");
+        }
+
+        keys.clear();
+
+        key k;
+        while (in >> k.t >> k.pos.x >> k.pos.y >> k.pos.z >> k.front.x >> k.front.y >> k.front.z) {
+            keys.push_back(k);
+        }
+
+        if (keys.empty()) {
+            throw std::runtime_error(std::string("camera path ") + file.data() + " is empty!");
+        }
+    }
+
+    void camPath::save(std::string_view file) const {
+        std::ofstream out(file.data());
+        if (!out) {
+            throw std::runtime_error(std::string("cannot write camera path ") + file.data() + "!");
+        }
+
+        for (const key& k : keys) {
+            out << k.t << " " << k.pos.x << " " << k.pos.y << " " << k.pos.z << " "
+                << k.front.x << " " << k.front.y << " " << k.front.z << "\n";
+        }
+    }
+
+    key camPath::sample(float t) const {
+        if (keys.size() == 1) {
+            return keys[0];
+        }
+
+        // loop the path, measuring time relative to the first key
+        const float start = keys.front().t;
+        const float len = keys.back().t - start;
+        if (len > 0.0f) {
+            t = start + std::fmod(t, len);
+        }
+
+        auto next = std::upper_bound(keys.begin(), keys.end(), t, [](float t, const key& k) { return t < k.t; });
+        if (next == keys.begin()) {
+            return keys.front();
+        } else if (next == keys.end()) {
+            return keys.back();
+        }
+
+        const key& a = *(next - 1);
+        const key& b = *next;
+        const float w = (t - a.t) / (b.t - a.t);
+
+        key k;
+        k.t = t;
+        k.pos = glm::mix(a.pos, b.pos, w);
+        k.front = glm::normalize(glm::mix(a.front, b.front, w));
+        return k;
+    }
+
+    size_t recorder::columnIndex(std::string_view column) {
+        auto it = std::find(columns.begin(), columns.end(), column);
+        if (it != columns.end()) {
+            return it - columns.begin();
+        }
+
+        columns.emplace_back(column);
+        return columns.size() - 1;
+    }
+
+    void recorder::add(std::string_view column, double value, size_t lag) {
+        if (lag == 0) {
+            curr.emplace_back(columnIndex(column), value);
+        } else if (lag <= rows.size()) {
+            rows[rows.size() - lag].emplace_back(columnIndex(column), value);
+        }
+    }
+
+    void recorder::endFrame() {
+        rows.push_back(std::move(curr));
+        curr.clear();
+    }
+
+    double percentile(std::vector<double> v, double p) {
+        if (v.empty()) {
+            return 0.0;
+        }
+
+        // nearest-rank percentile
+        size_t rank = std::ceil(p / 100.0 * v.size());
+        rank = std::clamp<size_t>(rank, 1, v.size());
+
+        std::nth_element(v.begin(), v.begin() + rank - 1, v.end());
+        return v[rank - 1];
+    }
+
+    // writes <file> with one row per frame, and <file>_summary.csv with percentiles per column
+    void recorder::write(std::string_view file) const {
+        std::ofstream out(file.data());
+        if (!out) {
+            throw std::runtime_error(std::string("cannot write benchmark output ") + file.data() + "!");
+        }
+
+        out << "frame";
+        for (const auto& c : columns) {
+            out << "," << c;
+        }
+        out << "\n";
+
+        std::vector<std::vector<double>> values(columns.size());
+
+        for (size_t f = 0; f < rows.size(); f++) {
+            std::vector<std::optional<double>> line(columns.size());
+            for (const auto& [col, val] : rows[f]) {
+                line[col] = val;
+                values[col].push_back(val);
+            }
+
+            out << f;
+            for (const auto& val : line) {
+                out << ",";
+                if (val) {
+                    out << *val;
+                }
+            }
+            out << "\n";
+        }
+
+        std::string summaryFile(file);
+        const size_t ext = summaryFile.rfind(".csv");
+        if (ext != std::string::npos) {
+            summaryFile.erase(ext);
+        }
+        summaryFile += "_summary.csv";
+
+        std::ofstream summary(summaryFile);
+        if (!summary) {
+            throw std::runtime_error("cannot write benchmark summary " + summaryFile + "!");
+        }
+
+        std::ostringstream table;
+        table << "metric,mean,min,p50,p90,p95,p99,max\n";
+        for (size_t c = 0; c < columns.size(); c++) {
+            const auto& v = values[c];
+            if (v.empty()) {
+                continue;
+            }
+
+            double mean = 0.0;
+            for (double x : v) {
+                mean += x;
+            }
+            mean /= v.size();
+
+            table << columns[c] << "," << mean << ","
+                << *std::min_element(v.begin(), v.end()) << ","
+                << percentile(v, 50.0) << ","
+                << percentile(v, 90.0) << ","
+                << percentile(v, 95.0) << ","
+                << percentile(v, 99.0) << ","
+                << *std::max_element(v.begin(), v.end()) << "\n";
+        }
+
+        summary << table.str();
+
+        cout << "wrote " << rows.size() << " frames to " << file << "\n" << table.str();
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+
+#include "glm_mat_wrapper.hpp"
+
+// Deterministic benchmarking: a replayable camera path and a per-frame timing recorder.
+namespace bench {
+    struct config {
+        bool enabled = false; // replay path instead of reading keyboard input
+        unsigned int frames = 1000; // frames recorded after warmup
+        unsigned int warmup = 100; // frames rendered but not recorded
+        float dt = 1.0f / 60.0f; // fixed animation timestep so every run renders the same frames
+
+        std::string out = "bench.csv";
+        std::string path; // camera path to replay, empty for the built-in orbit
+        std::string record; // if set, save the live camera path here on exit
+    };
+
+    struct key {
+        float t;
+        glm::vec3 pos;
+        glm::vec3 front;
+    };
+
+    // keyframed camera path, sampled with linear interpolation and looped past the last key
+    class camPath {
+    public:
+        camPath();
+
+        void load(std::string_view file);
+        void save(std::string_view file) const;
+
+        void clear() { keys.clear(); }
+        void add(const key& k) { keys.push_back(k); }
+
+        key sample(float t) const;
+
+    private:
+        std::vector<key> keys;
+    };
+
+    // collects named per-frame values and writes them out as csv with percentile summaries
+    class recorder {
+    public:
+        // lag is how many frames before this one the value was measured on, gpu results arrive late.
+        // values for frames before the first are dropped
+        void add(std::string_view column, double value, size_t lag = 0);
+        void endFrame();
+
+        void write(std::string_view file) const;
+
+    private:
+        std::vector<std::string> columns; // in order of first appearance
+        std::vector<std::vector<std::pair<size_t, double>>> rows;
+        std::vector<std::pair<size_t, double>> curr;
+
+        size_t columnIndex(std::string_view column);
+    };
+
+    double percentile(std::vector<double> v, double p);
+}
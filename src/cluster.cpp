@@ -0,0 +1,140 @@
+#include "cluster.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace cluster {
+    namespace {
+        struct vec3 {
+            float x, y, z;
+        };
+
+        vec3 sub(vec3 a, vec3 b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+        float dot(vec3 a, vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+        float length(vec3 a) { return std::sqrt(dot(a, a)); }
+
+        vec3 cross(vec3 a, vec3 b) {
+            return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+        }
+
+        vec3 position(const float* positions, size_t stride, uint32_t v) {
+            const float* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + stride * v);
+            return { p[0], p[1], p[2] };
+        }
+
+        // sphere around the meshlet's vertices and a cone around its triangles' normals
+        void bound(meshlet& m, const built& b, const float* positions, size_t stride) {
+            vec3 lo = position(positions, stride, b.vertices[m.vertexOffset]);
+            vec3 hi = lo;
+            for (uint32_t i = 1; i < m.vertexCount; i++) {
+                const vec3 p = position(positions, stride, b.vertices[m.vertexOffset + i]);
+                lo = { std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z) };
+                hi = { std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z) };
+            }
+
+            const vec3 center = { 0.5f * (lo.x + hi.x), 0.5f * (lo.y + hi.y), 0.5f * (lo.z + hi.z) };
+            float radius = 0.0f;
+            for (uint32_t i = 0; i < m.vertexCount; i++) {
+                radius = std::max(radius, length(sub(position(positions, stride, b.vertices[m.vertexOffset + i]), center)));
+            }
+
+            m.center[0] = center.x;
+            m.center[1] = center.y;
+            m.center[2] = center.z;
+            m.radius = radius;
+
+            std::vector<vec3> normals;
+            normals.reserve(m.triangleCount);
+            vec3 sum = { 0.0f, 0.0f, 0.0f };
+            for (uint32_t t = 0; t < m.triangleCount; t++) {
+                const uint8_t* tri = &b.triangles[m.triangleOffset + t * 3];
+                const vec3 p0 = position(positions, stride, b.vertices[m.vertexOffset + tri[0]]);
+                const vec3 p1 = position(positions, stride, b.vertices[m.vertexOffset + tri[1]]);
+                const vec3 p2 = position(positions, stride, b.vertices[m.vertexOffset + tri[2]]);
+
+                const vec3 n = cross(sub(p1, p0), sub(p2, p0));
+                const float len = length(n);
+                if (len == 0.0f) {
+                    continue; // degenerate, faces nowhere
+                }
+                normals.push_back({ n.x / len, n.y / len, n.z / len });
+                sum = { sum.x + normals.back().x, sum.y + normals.back().y, sum.z + normals.back().z };
+            }
+
+            const float sumLen = length(sum);
+            if (normals.empty() || sumLen == 0.0f) {
+                return;
+            }
+            const vec3 axis = { sum.x / sumLen, sum.y / sumLen, sum.z / sumLen };
+
+            float minDot = 1.0f;
+            for (const vec3& n : normals) {
+                minDot = std::min(minDot, dot(n, axis));
+            }
+
+            // past ~85 degrees the cone culls next to nothing and the test costs more than it saves
+            if (minDot <= 0.1f) {
+                return;
+            }
+
+            m.coneAxis[0] = axis.x;
+            m.coneAxis[1] = axis.y;
+            m.coneAxis[2] = axis.z;
+            m.coneCutoff = std::sqrt(1.0f - minDot * minDot); // sine of the cone's half angle
+        }
+    }
+
+    template <typename I>
+    built build(const I* indices, size_t indexCount, size_t vertexCount, const float* positions, size_t stride) {
+        built b;
+        b.meshlets.reserve(indexCount / 3 / maxTriangles + 1);
+        b.vertices.reserve(indexCount / 3);
+        b.triangles.reserve(indexCount);
+
+        std::vector<uint8_t> local(vertexCount, UINT8_MAX); // slot of each vertex in the current meshlet
+        meshlet m;
+
+        auto finish = [&] {
+            if (m.triangleCount == 0) {
+                return;
+            }
+            bound(m, b, positions, stride);
+            for (uint32_t i = 0; i < m.vertexCount; i++) {
+                local[b.vertices[m.vertexOffset + i]] = UINT8_MAX;
+            }
+            b.meshlets.push_back(m);
+
+            m = {};
+            m.firstTriangle = b.meshlets.back().firstTriangle + b.meshlets.back().triangleCount;
+            m.vertexOffset = b.vertices.size();
+            m.triangleOffset = b.triangles.size();
+        };
+
+        for (size_t i = 0; i + 2 < indexCount; i += 3) {
+            const uint32_t tri[3] = { indices[i], indices[i + 1], indices[i + 2] };
+
+            uint32_t added = 0;
+            for (uint32_t v : tri) {
+                added += local[v] == UINT8_MAX;
+            }
+            if (m.vertexCount + added > maxVertices || m.triangleCount == maxTriangles) {
+                finish();
+            }
+
+            for (uint32_t v : tri) {
+                if (local[v] == UINT8_MAX) {
+                    local[v] = m.vertexCount++;
+                    b.vertices.push_back(v);
+                }
+                b.triangles.push_back(local[v]);
+            }
+            m.triangleCount++;
+        }
+        finish();
+
+        return b;
+    }
+
+    template built build<uint16_t>(const uint16_t* indices, size_t indexCount, size_t vertexCount, const float* positions, size_t stride);
+    template built build<uint32_t>(const uint32_t* indices, size_t indexCount, size_t vertexCount, const float* positions, size_t stride);
+}
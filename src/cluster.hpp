@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Meshlets: a mesh's triangles cut into small clusters with bounded vertex and triangle counts,
+// each with a bounding sphere and a normal cone so whole clusters can be culled at once.
+// Triangles are taken in index order, so each meshlet is also a contiguous range of the index
+// buffer it was built from and can be drawn with an ordinary indexed draw.
+namespace cluster {
+    // what mesh shaders are happy with (nvidia recommends 64 / 126, the triangle count is kept a multiple of 4)
+    constexpr uint32_t maxVertices = 64;
+    constexpr uint32_t maxTriangles = 124;
+
+    struct meshlet {
+        uint32_t firstTriangle = 0; // in the index list it was built from
+        uint32_t triangleCount = 0;
+
+        // into built::vertices and built::triangles, the layout mesh shaders read
+        uint32_t vertexOffset = 0;
+        uint32_t vertexCount = 0;
+        uint32_t triangleOffset = 0; // in bytes, three per triangle
+
+        float center[3] = {};
+        float radius = 0.0f;
+
+        // backfacing from wherever dot(center - eye, axis) >= cutoff * |center - eye| + radius,
+        // a zero axis never culls
+        float coneAxis[3] = {};
+        float coneCutoff = 1.0f;
+    };
+
+    struct built {
+        std::vector<meshlet> meshlets;
+        std::vector<uint32_t> vertices; // mesh vertex per meshlet vertex
+        std::vector<uint8_t> triangles; // meshlet-local vertex indices
+    };
+
+    // positions are float3s stride bytes apart, indices form a triangle list
+    template <typename I>
+    built build(const I* indices, size_t indexCount, size_t vertexCount, const float* positions, size_t stride);
+
+    // what the culling shader reads per meshlet, std430
+    struct cullable {
+        float sphere[4]; // center and radius
+        float cone[4]; // axis and cutoff
+        uint32_t firstIndex; // draw arguments in the geometry arena
+        uint32_t indexCount;
+        int32_t vertexOffset;
+        uint32_t pad;
+    };
+    static_assert(sizeof(cullable) == 48);
+}
@@ -11,7 +11,7 @@ void appvk::createCommandPool() {
     }
 }
 
-VkCommandBuffer appvk::beginSingleCommand() {
+VkCommandBuffer appvk::beginSingleCommand(bool timed) {
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.commandPool = cp;
@@ -28,21 +28,47 @@ VkCommandBuffer appvk::beginSingleCommand() {
 
     vkBeginCommandBuffer(buf, &beginInfo);
 
+    // the upload profiler has one slot, so only commands that are waited for can be timed
+    if (timed) {
+        onceProf.beginFrame(buf, 0);
+    }
+
     return buf;
 }
 
-void appvk::endSingleCommand(VkCommandBuffer buf) {
+// submit with a fence of its own, so only this submission is waited for rather than the whole queue
+VkFence appvk::submitSingleCommand(VkCommandBuffer buf) {
     vkEndCommandBuffer(buf);
 
+    VkFenceCreateInfo fCreateInfo{};
+    fCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VkFence done;
+    if (vkCreateFence(dev, &fCreateInfo, nullptr, &done) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create upload fence!");
+    }
+
     VkSubmitInfo subInfo{};
     subInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     subInfo.commandBufferCount = 1;
     subInfo.pCommandBuffers = &buf;
 
-    vkQueueSubmit(gQueue, 1, &subInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(gQueue);
+    if (vkQueueSubmit(gQueue, 1, &subInfo, done) != VK_SUCCESS) {
+        throw std::runtime_error("cannot submit single command!");
+    }
+
+    deletions.push(done, [this, buf] {
+        vkFreeCommandBuffers(dev, cp, 1, &buf);
+    });
+
+    return done;
+}
+
+void appvk::endSingleCommand(VkCommandBuffer buf) {
+    VkFence done = submitSingleCommand(buf);
+    vkWaitForFences(dev, 1, &done, VK_FALSE, UINT64_MAX);
 
-    vkFreeCommandBuffers(dev, cp, 1, &buf);
+    onceProf.collect(0);
 }
 
 // need to create a command buffer per swapchain image
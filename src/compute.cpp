@@ -15,10 +15,10 @@ void appvk::createComputeBuffers() {
     }
 
     ibuf = createBuffer(bufsize * sizeof(glm::vec4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        mem::preset::dynamic, mem::category::compute);
     
     obuf = createBuffer(bufsize * sizeof(glm::vec4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        mem::preset::readback, mem::category::compute);
     
     void* data;
     vkMapMemory(dev, ibuf.mem, 0, bufsize * sizeof(glm::vec4), 0, &data);
@@ -99,7 +99,9 @@ void appvk::createComputeDescriptors() {
 }
 
 void appvk::createComputePipeline() {
-    std::vector<char> cspv = readFile(".spv/shader.comp.spv");
+    PROF_ZONE("createComputePipeline");
+
+    std::vector<uint32_t> cspv = spv::load(".spv/shader.comp.spv");
     VkShaderModule cmod = createShaderModule(cspv);
 
     VkPipelineShaderStageCreateInfo shaderCreateInfo{};
@@ -122,10 +124,16 @@ void appvk::createComputePipeline() {
     createInfo.stage = shaderCreateInfo;
     createInfo.layout = cPipeLayout;
 
+    if (captureShaderStats) {
+        createInfo.flags = VK_PIPELINE_CREATE_CAPTURE_STATISTICS_BIT_KHR;
+    }
+
     if (vkCreateComputePipelines(dev, VK_NULL_HANDLE, 1, &createInfo, nullptr, &cPipeline) != VK_SUCCESS) {
         throw std::runtime_error("cannot create compute pipeline!");
     }
 
+    collectShaderStats(cPipeline, "compute");
+
     vkDestroyShaderModule(dev, cmod, nullptr);
 }
 
@@ -153,15 +161,22 @@ VkCommandBuffer appvk::createComputeCommandBuffer() {
     beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
     vkBeginCommandBuffer(buf, &beginInfo);
+        onceProf.beginFrame(buf, 0);
+        onceProf.begin(buf, "compute dispatch");
+
         vkCmdBindDescriptorSets(buf, VK_PIPELINE_BIND_POINT_COMPUTE, cPipeLayout, 0, 1, &cDescSet, 0, nullptr);
         vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_COMPUTE, cPipeline);
         vkCmdDispatch(buf, bufsize / 128, 1, 1);
+
+        onceProf.end(buf);
     vkEndCommandBuffer(buf);
 
     return buf;
 }
 
 void appvk::runCompute(VkCommandBuffer buf) {
+    PROF_ZONE("runCompute");
+
     VkSubmitInfo subInfo{};
     subInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     subInfo.commandBufferCount = 1;
@@ -170,6 +185,8 @@ void appvk::runCompute(VkCommandBuffer buf) {
     vkQueueSubmit(cQueue, 1, &subInfo, VK_NULL_HANDLE);
     vkQueueWaitIdle(cQueue);
 
+    onceProf.collect(0);
+
     vkFreeCommandBuffers(dev, ccp, 1, &buf);
 
     std::vector<glm::vec4> cmpbuf(bufsize);
@@ -0,0 +1,163 @@
+#include "cpuprof.hpp"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace prof::cpu {
+    std::atomic<bool> capturing = false;
+
+    namespace {
+        struct event {
+            const char* name;
+            uint64_t start;
+            uint64_t end;
+        };
+
+        // written only by the owning thread, so recording needs no locks
+        struct ring {
+            constexpr static size_t size = 1 << 16; // oldest events are overwritten past this
+            std::vector<event> events = std::vector<event>(size);
+            std::atomic<uint64_t> head = 0;
+            std::atomic<uint32_t> generation = 0; // capture its events belong to
+            std::atomic<uint32_t> open = 0; // zones entered and not yet recorded
+            uint32_t tid = 0;
+            std::string name;
+        };
+
+        // only locked when a thread records its first zone and while dumping
+        std::mutex ringsLock;
+        std::vector<std::unique_ptr<ring>> rings; // never freed, so rings outlive their threads
+        uint64_t epoch = 0;
+
+        // bumped by start(), each thread empties its own ring when it next records and sees it changed
+        std::atomic<uint32_t> generation = 0;
+
+        ring& threadRing() {
+            thread_local ring* r = nullptr;
+            if (r == nullptr) {
+                std::lock_guard<std::mutex> l(ringsLock);
+                rings.push_back(std::make_unique<ring>());
+                r = rings.back().get();
+                r->tid = rings.size();
+                r->name = "thread " + std::to_string(r->tid);
+            }
+            return *r;
+        }
+
+        void writeEscaped(std::ostream& out, std::string_view s) {
+            for (char c : s) {
+                if (c == '"' || c == '\\') {
+                    out << '\\';
+                }
+                out << c;
+            }
+        }
+    }
+
+    void start() {
+        {
+            std::lock_guard<std::mutex> l(ringsLock);
+            epoch = now();
+        }
+
+        generation.fetch_add(1, std::memory_order_release);
+        capturing.store(true, std::memory_order_release);
+    }
+
+    void stop() {
+        capturing.store(false, std::memory_order_release);
+    }
+
+    void nameThread(std::string_view name) {
+        ring& r = threadRing();
+
+        std::lock_guard<std::mutex> l(ringsLock);
+        r.name = name;
+    }
+
+    void enter() {
+        ring& r = threadRing();
+        r.open.store(r.open.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    void record(const char* name, uint64_t start, uint64_t end) {
+        ring& r = threadRing();
+
+        const uint32_t g = generation.load(std::memory_order_acquire);
+        if (r.generation.load(std::memory_order_relaxed) != g) {
+            r.head.store(0, std::memory_order_relaxed);
+            r.generation.store(g, std::memory_order_release);
+        }
+
+        uint64_t h = r.head.load(std::memory_order_relaxed);
+        r.events[h % ring::size] = { name, start, end };
+        r.head.store(h + 1, std::memory_order_release);
+        r.open.store(r.open.load(std::memory_order_relaxed) - 1, std::memory_order_release);
+    }
+
+    void dump(std::string_view file) {
+        std::ofstream out(file.data());
+        if (!out) {
+            throw std::runtime_error(std::string("cannot write trace ") + file.data() + "!");
+        }
+
+        std::lock_guard<std::mutex> l(ringsLock);
+
+        // zones still open on other threads record once they close, capture being off doesn't stop that. the calling
+        // thread's can't be closed from here, and record nothing while it's dumping anyway
+        ring* self = &threadRing();
+        for (const auto& r : rings) {
+            while (r.get() != self && r->open.load(std::memory_order_acquire) != 0) {
+                std::this_thread::yield();
+            }
+        }
+        const uint32_t current = generation.load(std::memory_order_acquire);
+
+        out << std::fixed << std::setprecision(3);
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+        size_t count = 0;
+        bool first = true;
+        for (const auto& r : rings) {
+            if (!first) {
+                out << ",\n";
+            }
+            first = false;
+
+            out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << r->tid << ",\"args\":{\"name\":\"";
+            writeEscaped(out, r->name);
+            out << "\"}}";
+
+            // a ring its thread hasn't recorded into since start() still holds an earlier capture
+            const bool stale = r->generation.load(std::memory_order_acquire) != current;
+            const uint64_t head = stale ? 0 : r->head.load(std::memory_order_acquire);
+            const uint64_t begin = head > ring::size ? head - ring::size : 0;
+
+            for (uint64_t i = begin; i < head; i++) {
+                const event& e = r->events[i % ring::size];
+                if (e.start < epoch) {
+                    continue; // zone opened before capture started
+                }
+
+                // complete events, timestamps in microseconds
+                out << ",\n{\"name\":\"";
+                writeEscaped(out, e.name);
+                out << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":" << r->tid
+                    << ",\"ts\":" << (e.start - epoch) / 1e3
+                    << ",\"dur\":" << (e.end - e.start) / 1e3 << "}";
+                count++;
+            }
+        }
+
+        out << "\n]}\n";
+
+        std::cout << "wrote " << count << " cpu zones to " << file << "\n";
+    }
+}
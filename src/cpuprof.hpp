@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+// Scoped cpu zones recorded into per-thread ring buffers and dumped as Chrome trace / Perfetto json.
+// When capture is off a zone costs one relaxed atomic load.
+namespace prof::cpu {
+    extern std::atomic<bool> capturing;
+
+    inline uint64_t now() {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    void start();
+    void stop();
+
+    // write every recorded zone to file, call after stop(). waits for zones other threads still have open
+    void dump(std::string_view file);
+
+    // label the calling thread in the trace
+    void nameThread(std::string_view name);
+
+    // a zone opened on the calling thread, which record() closes. name must outlive the dump, string literals are expected
+    void enter();
+    void record(const char* name, uint64_t start, uint64_t end);
+
+    class zone {
+    public:
+        explicit zone(const char* name) : name(name), active(capturing.load(std::memory_order_relaxed)) {
+            if (active) {
+                enter();
+                begin = now();
+            }
+        }
+
+        ~zone() {
+            end();
+        }
+
+        // close the zone before the end of its block
+        void end() {
+            if (active) {
+                record(name, begin, now());
+                active = false;
+            }
+        }
+
+        zone(const zone&) = delete;
+        zone& operator=(const zone&) = delete;
+
+    private:
+        const char* name;
+        bool active;
+        uint64_t begin = 0;
+    };
+}
+
+#define PROF_CAT_INNER(a, b) a##b
+#define PROF_CAT(a, b) PROF_CAT_INNER(a, b)
+
+// time the rest of the enclosing block
+#define PROF_ZONE(name) prof::cpu::zone PROF_CAT(profZone, __LINE__)(name)
@@ -0,0 +1,221 @@
+#include "main.hpp"
+
+// gpu meshlet culling: a compute pass tests every meshlet against the view frustum and its normal cone
+// and compacts the survivors into indirect draws, so the scene pass draws each mesh with one call
+
+namespace {
+    struct cullPush {
+        std::array<glm::vec4, 6> planes;
+        glm::vec4 eye;
+        uint32_t meshletStart;
+        uint32_t meshletCount;
+        uint32_t countIndex;
+    };
+    static_assert(sizeof(cullPush) <= 128, "push constants are only guaranteed 128 bytes");
+
+    constexpr uint32_t cullGroupSize = 64; // local_size_x in cull.comp
+
+    // frustum planes of a clip space with 0 to 1 depth, normalised and in whatever space the matrix takes in
+    std::array<glm::vec4, 6> frustumPlanes(const glm::mat4& m) {
+        auto row = [&](int i) { return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]); };
+
+        std::array<glm::vec4, 6> planes = {
+            row(3) + row(0), row(3) - row(0), // left, right
+            row(3) + row(1), row(3) - row(1), // bottom, top
+            row(2), row(3) - row(2), // near, far
+        };
+        for (glm::vec4& p : planes) {
+            p /= glm::length(glm::vec3(p));
+        }
+        return planes;
+    }
+}
+
+// the meshlets themselves live in the geometry arena, so this runs after createGeometryArena
+void appvk::createCulling() {
+    PROF_ZONE("createCulling");
+
+    if (!gpuCulling) {
+        return;
+    }
+
+    const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    cullDraws = createDeviceBuffer(VkDeviceSize(arenaMeshlets) * sizeof(VkDrawIndexedIndirectCommand), usage, mem::category::mesh);
+    cullCounts = createDeviceBuffer(things.size() * sizeof(uint32_t), usage, mem::category::mesh);
+
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings = {};
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = bindings.size();
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(dev, &layoutInfo, nullptr, &cullLayout) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create cull descriptor set layout!");
+    }
+
+    VkPushConstantRange pcr{};
+    pcr.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pcr.size = sizeof(cullPush);
+
+    VkPipelineLayoutCreateInfo pipeLayoutCreateInfo{};
+    pipeLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeLayoutCreateInfo.setLayoutCount = 1;
+    pipeLayoutCreateInfo.pSetLayouts = &cullLayout;
+    pipeLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipeLayoutCreateInfo.pPushConstantRanges = &pcr;
+
+    if (vkCreatePipelineLayout(dev, &pipeLayoutCreateInfo, nullptr, &cullPipeLayout) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create cull pipeline layout!");
+    }
+
+    VkShaderModule cmod = createShaderModule(spv::load(".spv/cull.comp.spv"));
+
+    VkComputePipelineCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    createInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    createInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    createInfo.stage.module = cmod;
+    createInfo.stage.pName = "main";
+    createInfo.layout = cullPipeLayout;
+
+    if (captureShaderStats) {
+        createInfo.flags = VK_PIPELINE_CREATE_CAPTURE_STATISTICS_BIT_KHR;
+    }
+
+    if (vkCreateComputePipelines(dev, VK_NULL_HANDLE, 1, &createInfo, nullptr, &cullPipeline) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create cull pipeline!");
+    }
+
+    collectShaderStats(cullPipeline, "cull");
+
+    vkDestroyShaderModule(dev, cmod, nullptr);
+
+    VkDescriptorPoolSize size{};
+    size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    size.descriptorCount = bindings.size();
+
+    VkDescriptorPoolCreateInfo poolCreateInfo{};
+    poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolCreateInfo.maxSets = 1;
+    poolCreateInfo.poolSizeCount = 1;
+    poolCreateInfo.pPoolSizes = &size;
+
+    if (vkCreateDescriptorPool(dev, &poolCreateInfo, nullptr, &cullPool) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create cull descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = cullPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &cullLayout;
+
+    if (vkAllocateDescriptorSets(dev, &allocInfo, &cullSet) != VK_SUCCESS) {
+        throw std::runtime_error("cannot allocate cull descriptor set!");
+    }
+
+    const std::array<VkDescriptorBufferInfo, 3> infos = {{
+        { arenaMeshlet.buf, 0, VK_WHOLE_SIZE },
+        { cullDraws.buf, 0, VK_WHOLE_SIZE },
+        { cullCounts.buf, 0, VK_WHOLE_SIZE },
+    }};
+
+    std::array<VkWriteDescriptorSet, 3> writes = {};
+    for (uint32_t i = 0; i < writes.size(); i++) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = cullSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &infos[i];
+    }
+
+    vkUpdateDescriptorSets(dev, writes.size(), writes.data(), 0, nullptr);
+}
+
+void appvk::destroyCulling() {
+    vkDestroyDescriptorPool(dev, cullPool, nullptr);
+    vkDestroyPipeline(dev, cullPipeline, nullptr);
+    vkDestroyPipelineLayout(dev, cullPipeLayout, nullptr);
+    vkDestroyDescriptorSetLayout(dev, cullLayout, nullptr);
+
+    vkDestroyBuffer(dev, cullCounts.buf, nullptr);
+    memory.free(dev, cullCounts.mem);
+
+    vkDestroyBuffer(dev, cullDraws.buf, nullptr);
+    memory.free(dev, cullDraws.mem);
+}
+
+// counts start at zero, and without draw counts the culled slots have to be empty draws
+void appvk::recordCullClear(VkCommandBuffer cbuf) {
+    vkCmdFillBuffer(cbuf, cullCounts.buf, 0, VK_WHOLE_SIZE, 0);
+
+    if (drawIndirectCountSupported) {
+        return;
+    }
+
+    for (const thing& t : things) {
+        const mesh& m = t.drawn();
+        if (m.meshletCount > 0) {
+            vkCmdFillBuffer(cbuf, cullDraws.buf, VkDeviceSize(m.meshletStart) * sizeof(VkDrawIndexedIndirectCommand),
+                VkDeviceSize(m.meshletCount) * sizeof(VkDrawIndexedIndirectCommand), 0);
+        }
+    }
+}
+
+// barriers on the draws and counts come from the frame graph
+void appvk::recordCull(VkCommandBuffer cbuf) {
+    frameProf.begin(cbuf, "cull");
+
+    vkCmdBindPipeline(cbuf, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+    vkCmdBindDescriptorSets(cbuf, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeLayout, 0, 1, &cullSet, 0, nullptr);
+
+    for (uint32_t i = 0; i < things.size(); i++) {
+        const thing& t = things[i];
+        const mesh& m = t.drawn();
+        if (m.meshletCount == 0) {
+            continue;
+        }
+
+        // cull in object space, so meshlet bounds are used as uploaded
+        cullPush push;
+        push.planes = frustumPlanes(cullViewProj * t.model);
+        push.eye = glm::inverse(t.model) * glm::vec4(c.pos, 1.0f);
+        push.meshletStart = m.meshletStart;
+        push.meshletCount = m.meshletCount;
+        push.countIndex = i;
+
+        vkCmdPushConstants(cbuf, cullPipeLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cullPush), &push);
+        vkCmdDispatch(cbuf, (m.meshletCount + cullGroupSize - 1) / cullGroupSize, 1, 1);
+    }
+
+    frameProf.end(cbuf);
+}
+
+// the surviving meshlets of a mesh in one call, countIndex is the thing it belongs to
+void appvk::drawCulled(VkCommandBuffer cbuf, const mesh& m, uint32_t countIndex) {
+    if (m.meshletCount == 0) {
+        drawMesh(cbuf, m); // didn't fit in the meshlet arena
+        return;
+    }
+
+    if (m.indexType != arenaIndexType) {
+        vkCmdBindIndexBuffer(cbuf, arenaIndex.buf, 0, m.indexType);
+        arenaIndexType = m.indexType;
+    }
+
+    const VkDeviceSize offset = VkDeviceSize(m.meshletStart) * sizeof(VkDrawIndexedIndirectCommand);
+    if (drawIndirectCountSupported) {
+        vkCmdDrawIndexedIndirectCount(cbuf, cullDraws.buf, offset, cullCounts.buf, countIndex * sizeof(uint32_t),
+            m.meshletCount, sizeof(VkDrawIndexedIndirectCommand));
+    } else {
+        vkCmdDrawIndexedIndirect(cbuf, cullDraws.buf, offset, m.meshletCount, sizeof(VkDrawIndexedIndirectCommand));
+    }
+}
@@ -0,0 +1,68 @@
+#include "deletion.hpp"
+
+namespace del {
+    void queue::init(VkDevice dev, unsigned int framesInFlight) {
+        this->dev = dev;
+        this->framesInFlight = framesInFlight;
+    }
+
+    void queue::push(uint64_t frame, destroyFn destroy) {
+        // most pushes in a frame share a batch
+        if (batches.empty() || batches.back().fence != VK_NULL_HANDLE || batches.back().frame != frame) {
+            batches.push_back({ frame, VK_NULL_HANDLE, {} });
+        }
+        batches.back().work.push_back(std::move(destroy));
+    }
+
+    void queue::push(VkFence fence, destroyFn destroy) {
+        for (batch& b : batches) {
+            if (b.fence == fence) {
+                b.work.push_back(std::move(destroy));
+                return;
+            }
+        }
+        batches.push_back({ 0, fence, {} });
+        batches.back().work.push_back(std::move(destroy));
+    }
+
+    void queue::collect(uint64_t frame) {
+        for (size_t i = 0; i < batches.size();) {
+            batch& b = batches[i];
+
+            const bool done = b.fence != VK_NULL_HANDLE ?
+                vkGetFenceStatus(dev, b.fence) == VK_SUCCESS :
+                frame >= b.frame + framesInFlight;
+
+            if (done) {
+                run(b);
+                batches.erase(batches.begin() + i); // rather than swap and pop, so batches run in push order
+            } else {
+                i++;
+            }
+        }
+    }
+
+    void queue::flush() {
+        for (batch& b : batches) {
+            run(b);
+        }
+        batches.clear();
+    }
+
+    size_t queue::pending() const {
+        size_t n = 0;
+        for (const batch& b : batches) {
+            n += b.work.size();
+        }
+        return n;
+    }
+
+    void queue::run(batch& b) {
+        for (destroyFn& f : b.work) {
+            f();
+        }
+        if (b.fence != VK_NULL_HANDLE) {
+            vkDestroyFence(dev, b.fence, nullptr);
+        }
+    }
+}
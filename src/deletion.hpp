@@ -0,0 +1,48 @@
+#pragma once
+
+#include "glfw_wrapper.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Deferred destruction. Anything the gpu might still be using is handed over with the point it
+// was last used at, either the frame that recorded it or the fence of a one-off submission like
+// an upload, and is destroyed by collect() once that point has completed, so nothing needs the
+// device to be idle to be freed.
+namespace del {
+    class queue {
+    public:
+        using destroyFn = std::function<void()>;
+
+        // a frame is complete once framesInFlight more have started, as its fence has been waited on by then
+        void init(VkDevice dev, unsigned int framesInFlight);
+
+        // destroy after the frame numbered frame has completed
+        void push(uint64_t frame, destroyFn destroy);
+
+        // destroy after fence signals, the queue owns the fence and destroys it along with the last of its work
+        void push(VkFence fence, destroyFn destroy);
+
+        // run everything that has completed by the start of frame
+        void collect(uint64_t frame);
+
+        // run everything, the device must be idle
+        void flush();
+
+        size_t pending() const;
+
+    private:
+        struct batch {
+            uint64_t frame = 0;
+            VkFence fence = VK_NULL_HANDLE; // if set, frame is ignored
+            std::vector<destroyFn> work;
+        };
+
+        VkDevice dev = VK_NULL_HANDLE;
+        unsigned int framesInFlight = 0;
+        std::vector<batch> batches;
+
+        void run(batch& b);
+    };
+}
@@ -32,4 +32,13 @@ VkResult GetPipelineExecutablePropertiesKHR(VkDevice device, const VkPipelineInf
 	} else {
 		return VK_ERROR_EXTENSION_NOT_PRESENT;
 	}
+}
+
+VkResult GetMemoryHostPointerPropertiesEXT(VkDevice device, VkExternalMemoryHandleTypeFlagBits handleType, const void* pHostPointer, VkMemoryHostPointerPropertiesEXT* pMemoryHostPointerProperties) {
+	auto f = (PFN_vkGetMemoryHostPointerPropertiesEXT) vkGetDeviceProcAddr(device, "vkGetMemoryHostPointerPropertiesEXT");
+	if (f) {
+		return f(device, handleType, pHostPointer, pMemoryHostPointerProperties);
+	} else {
+		return VK_ERROR_EXTENSION_NOT_PRESENT;
+	}
 }
\ No newline at end of file
@@ -0,0 +1,318 @@
+#include "fileio.hpp"
+
+#include "cpuprof.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// raw syscalls rather than liburing, the rings are simple enough and it's one less dependency
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup)
+#define IO_URING 1
+#endif
+#endif
+
+namespace io {
+    file::file(std::string_view path, bool direct) {
+        const std::string p(path);
+
+#ifdef O_DIRECT
+        if (direct) {
+            handle = ::open(p.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+            isDirect = handle >= 0;
+        }
+#endif
+        if (handle < 0) {
+            handle = ::open(p.c_str(), O_RDONLY | O_CLOEXEC);
+        }
+        if (handle < 0) {
+            throw std::runtime_error("cannot open file " + p + "!");
+        }
+
+        struct stat st;
+        if (fstat(handle, &st) != 0) {
+            ::close(handle);
+            throw std::runtime_error("cannot stat file " + p + "!");
+        }
+        bytes = uint64_t(st.st_size);
+    }
+
+    file::~file() {
+        if (handle >= 0) {
+            ::close(handle);
+        }
+    }
+
+    file::file(file&& o) noexcept
+        : handle(std::exchange(o.handle, -1)), bytes(o.bytes), isDirect(o.isDirect) {}
+
+    file& file::operator=(file&& o) noexcept {
+        std::swap(handle, o.handle);
+        std::swap(bytes, o.bytes);
+        std::swap(isDirect, o.isDirect);
+        return *this;
+    }
+
+    buffer::buffer(size_t size) : length((size + directAlignment - 1) / directAlignment * directAlignment) {
+        bytes = static_cast<uint8_t*>(std::aligned_alloc(directAlignment, length));
+        if (bytes == nullptr) {
+            throw std::runtime_error("cannot allocate io buffer!");
+        }
+    }
+
+    buffer::~buffer() {
+        std::free(bytes);
+    }
+
+    buffer::buffer(buffer&& o) noexcept
+        : bytes(std::exchange(o.bytes, nullptr)), length(std::exchange(o.length, 0)) {}
+
+    buffer& buffer::operator=(buffer&& o) noexcept {
+        std::swap(bytes, o.bytes);
+        std::swap(length, o.length);
+        return *this;
+    }
+
+    reader::reader(job::pool& fallback, unsigned int depth) : pool(fallback), depth(depth) {
+#ifdef IO_URING
+        io_uring_params p{};
+        const int fd = int(syscall(__NR_io_uring_setup, depth, &p));
+        if (fd < 0) {
+            return; // preads on the pool instead
+        }
+
+        sqMapSize = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+        cqMapSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        const bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) {
+            sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+        }
+        sqeMapSize = p.sq_entries * sizeof(io_uring_sqe);
+
+        sqMap = mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        cqMap = single ? sqMap : mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        sqeMap = mmap(nullptr, sqeMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqMap == MAP_FAILED || cqMap == MAP_FAILED || sqeMap == MAP_FAILED) {
+            if (sqeMap != MAP_FAILED) {
+                munmap(sqeMap, sqeMapSize);
+            }
+            if (!single && cqMap != MAP_FAILED) {
+                munmap(cqMap, cqMapSize);
+            }
+            if (sqMap != MAP_FAILED) {
+                munmap(sqMap, sqMapSize);
+            }
+            sqMap = cqMap = sqeMap = nullptr;
+            ::close(fd);
+            return;
+        }
+
+        auto at = [](void* base, uint32_t offset) { return reinterpret_cast<unsigned int*>(static_cast<uint8_t*>(base) + offset); };
+        sqHead = at(sqMap, p.sq_off.head);
+        sqTail = at(sqMap, p.sq_off.tail);
+        sqMask = at(sqMap, p.sq_off.ring_mask);
+        sqArray = at(sqMap, p.sq_off.array);
+        cqHead = at(cqMap, p.cq_off.head);
+        cqTail = at(cqMap, p.cq_off.tail);
+        cqMask = at(cqMap, p.cq_off.ring_mask);
+        cqes = static_cast<uint8_t*>(cqMap) + p.cq_off.cqes;
+
+        ring = fd;
+        this->depth = p.sq_entries; // rounded up to a power of two
+#endif
+    }
+
+    reader::~reader() {
+#ifdef IO_URING
+        if (ring < 0) {
+            return;
+        }
+
+        munmap(sqeMap, sqeMapSize);
+        if (cqMap != sqMap) {
+            munmap(cqMap, cqMapSize);
+        }
+        munmap(sqMap, sqMapSize);
+        ::close(ring);
+#endif
+    }
+
+    int reader::registerBuffer(void* p, size_t size) {
+        std::lock_guard<std::mutex> lk(m);
+
+#ifdef IO_URING
+        if (ring < 0) {
+            return -1;
+        }
+
+        // the whole table is registered at once, so adding one means registering them all again
+        std::vector<iovec> iovs;
+        for (auto [base, len] : registered) {
+            iovs.push_back({ base, len });
+        }
+        iovs.push_back({ p, size });
+
+        if (!registered.empty()) {
+            syscall(__NR_io_uring_register, ring, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+        }
+        if (syscall(__NR_io_uring_register, ring, IORING_REGISTER_BUFFERS, iovs.data(), iovs.size()) == 0) {
+            registered.push_back({ p, size });
+            return int(registered.size()) - 1;
+        }
+
+        // usually over the locked memory limit, so put back what was there
+        iovs.pop_back();
+        if (!iovs.empty()) {
+            syscall(__NR_io_uring_register, ring, IORING_REGISTER_BUFFERS, iovs.data(), iovs.size());
+        }
+#else
+        (void)p;
+        (void)size;
+#endif
+        return -1;
+    }
+
+    void reader::read(std::vector<request>& batch) {
+        PROF_ZONE("io read");
+
+        for (request& r : batch) {
+            r.read = 0;
+        }
+
+        // the pool fallback runs unlocked: waiting on it runs other jobs, which may read too
+        if (async()) {
+            std::lock_guard<std::mutex> lk(m);
+            readRing(batch);
+        } else {
+            readPool(batch);
+        }
+    }
+
+    // keep depth reads queued until the batch is done. short reads go again for the rest, and a retry of
+    // a direct read that stopped at an unaligned end of file fails with EINVAL, which also means it's done
+    void reader::readRing(std::vector<request>& batch) {
+#ifdef IO_URING
+        std::vector<size_t> queue; // left to submit, popped from the back so the batch goes in order
+        for (size_t i = batch.size(); i-- > 0;) {
+            if (batch[i].size > 0) {
+                queue.push_back(i);
+            }
+        }
+
+        std::vector<iovec> iovs(batch.size());
+        unsigned int inFlight = 0;
+        int error = 0;
+
+        while (!queue.empty() || inFlight > 0) {
+            unsigned int tail = *sqTail; // only ever written here
+            while (!queue.empty() && inFlight < depth) {
+                const size_t i = queue.back();
+                queue.pop_back();
+
+                request& r = batch[i];
+                uint8_t* dst = static_cast<uint8_t*>(r.dst) + r.read;
+
+                const unsigned int slot = tail & *sqMask;
+                io_uring_sqe& sqe = static_cast<io_uring_sqe*>(sqeMap)[slot];
+                std::memset(&sqe, 0, sizeof(sqe));
+                sqe.fd = r.fd;
+                sqe.off = r.offset + r.read;
+                sqe.user_data = i;
+                if (r.buffer >= 0) {
+                    sqe.opcode = IORING_OP_READ_FIXED;
+                    sqe.addr = uint64_t(uintptr_t(dst));
+                    sqe.len = uint32_t(r.size - r.read);
+                    sqe.buf_index = uint16_t(r.buffer);
+                } else {
+                    iovs[i] = { dst, r.size - r.read };
+                    sqe.opcode = IORING_OP_READV;
+                    sqe.addr = uint64_t(uintptr_t(&iovs[i]));
+                    sqe.len = 1;
+                }
+                sqArray[slot] = slot;
+
+                tail++;
+                inFlight++;
+            }
+            __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+            // submit whatever the kernel hasn't taken yet and wait for at least one completion, in one call
+            const unsigned int unsubmitted = tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+            if (syscall(__NR_io_uring_enter, ring, unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0
+                && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                throw std::runtime_error(std::string("cannot submit reads: ") + std::strerror(errno) + "!");
+            }
+
+            unsigned int head = *cqHead;
+            const unsigned int completed = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            for (; head != completed; head++) {
+                const io_uring_cqe& cqe = static_cast<const io_uring_cqe*>(cqes)[head & *cqMask];
+                request& r = batch[cqe.user_data];
+                inFlight--;
+
+                if (cqe.res == -EAGAIN || cqe.res == -EINTR) {
+                    queue.push_back(cqe.user_data);
+                } else if (cqe.res == -EINVAL && r.read > 0) {
+                    // the unaligned tail of a direct read
+                } else if (cqe.res < 0) {
+                    // nothing more goes in, but what's in flight still lands in the caller's buffers
+                    error = error != 0 ? error : -cqe.res;
+                    queue.clear();
+                } else if (cqe.res > 0) {
+                    r.read += size_t(cqe.res);
+                    if (r.read < r.size && error == 0) {
+                        queue.push_back(cqe.user_data);
+                    }
+                }
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        }
+
+        if (error != 0) {
+            throw std::runtime_error(std::string("cannot read file: ") + std::strerror(error) + "!");
+        }
+#else
+        readPool(batch);
+#endif
+    }
+
+    void reader::readPool(std::vector<request>& batch) {
+        job::group g;
+
+        for (request& r : batch) {
+            pool.submit(g, [&r] {
+                while (r.read < r.size) {
+                    const ssize_t n = ::pread(r.fd, static_cast<uint8_t*>(r.dst) + r.read, r.size - r.read, off_t(r.offset + r.read));
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (n < 0 && errno == EINVAL && r.read > 0) {
+                        break; // as with the ring, a direct read's unaligned tail
+                    }
+                    if (n < 0) {
+                        throw std::runtime_error(std::string("cannot read file: ") + std::strerror(errno) + "!");
+                    }
+                    if (n == 0) {
+                        break; // end of file
+                    }
+                    r.read += size_t(n);
+                }
+            });
+        }
+
+        pool.wait(g); // rethrows only once every read is done with its buffer
+    }
+}
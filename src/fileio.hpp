@@ -0,0 +1,111 @@
+#pragma once
+
+#include "jobs.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+// Batched file reads. Every read in a batch goes to the kernel at once through io_uring, so a cold disk
+// sees a deep queue rather than one read at a time and loading is bound by bandwidth, not latency.
+// Where io_uring isn't there (old kernels, or containers that block it) a batch runs as preads on the job pool.
+namespace io {
+    // direct io skips the page cache, and needs buffers, offsets and sizes aligned to this
+    constexpr size_t directAlignment = 4096;
+
+    class file {
+    public:
+        file() = default;
+        // direct falls back to buffered on filesystems without it. throws if the file can't be opened
+        explicit file(std::string_view path, bool direct = false);
+        ~file();
+
+        file(file&& o) noexcept;
+        file& operator=(file&& o) noexcept;
+
+        int fd() const { return handle; }
+        uint64_t size() const { return bytes; }
+        bool direct() const { return isDirect; }
+
+    private:
+        int handle = -1;
+        uint64_t bytes = 0;
+        bool isDirect = false;
+    };
+
+    // heap memory aligned for direct io
+    class buffer {
+    public:
+        buffer() = default;
+        explicit buffer(size_t size); // rounded up to directAlignment
+        ~buffer();
+
+        buffer(buffer&& o) noexcept;
+        buffer& operator=(buffer&& o) noexcept;
+
+        uint8_t* data() const { return bytes; }
+        size_t size() const { return length; }
+
+    private:
+        uint8_t* bytes = nullptr;
+        size_t length = 0;
+    };
+
+    struct request {
+        int fd = -1;
+        uint64_t offset = 0;
+        size_t size = 0;
+        void* dst = nullptr;
+        int buffer = -1; // the registered buffer dst lies in, if any
+        size_t read = 0; // filled in, short only at the end of the file
+    };
+
+    class reader {
+    public:
+        // depth is how many reads are in flight at once
+        explicit reader(job::pool& fallback, unsigned int depth = 64);
+        ~reader();
+
+        reader(const reader&) = delete;
+        reader& operator=(const reader&) = delete;
+
+        bool async() const { return ring >= 0; } // otherwise preads on the pool
+
+        // memory the kernel keeps pinned, so reads into it skip mapping its pages every time. returns the
+        // index for request::buffer, or -1 if it can't be registered, in which case reads into it still work
+        int registerBuffer(void* p, size_t size);
+
+        // every request, blocking until all are done. safe from any thread, including jobs on the pool.
+        // batches through the ring run one at a time. throws on a read error
+        void read(std::vector<request>& batch);
+
+    private:
+        job::pool& pool;
+        std::mutex m; // the ring and the registered buffers
+
+        int ring = -1;
+        unsigned int depth = 0;
+        std::vector<std::pair<void*, size_t>> registered;
+
+        // the rings shared with the kernel
+        void* sqMap = nullptr;
+        size_t sqMapSize = 0;
+        void* cqMap = nullptr;
+        size_t cqMapSize = 0;
+        void* sqeMap = nullptr;
+        size_t sqeMapSize = 0;
+        unsigned int* sqHead = nullptr;
+        unsigned int* sqTail = nullptr;
+        unsigned int* sqMask = nullptr;
+        unsigned int* sqArray = nullptr;
+        unsigned int* cqHead = nullptr;
+        unsigned int* cqTail = nullptr;
+        unsigned int* cqMask = nullptr;
+        void* cqes = nullptr;
+
+        void readRing(std::vector<request>& batch);
+        void readPool(std::vector<request>& batch);
+    };
+}
@@ -0,0 +1,136 @@
+#include "geometry.hpp"
+
+#include <iterator>
+
+namespace geo {
+    void ranges::reset(uint32_t capacity) {
+        freeList.clear();
+        if (capacity > 0) {
+            freeList[0] = capacity;
+        }
+        cap = capacity;
+        inUse = 0;
+    }
+
+    std::optional<uint32_t> ranges::allocate(uint32_t count, uint32_t align) {
+        if (count == 0) {
+            return 0;
+        }
+
+        for (auto it = freeList.begin(); it != freeList.end(); ++it) {
+            const auto [offset, size] = *it;
+            const uint32_t aligned = (offset + align - 1) / align * align;
+            if (aligned + count > offset + size) {
+                continue;
+            }
+
+            // whatever is left either side stays free
+            freeList.erase(it);
+            if (aligned > offset) {
+                freeList[offset] = aligned - offset;
+            }
+            if (aligned + count < offset + size) {
+                freeList[aligned + count] = offset + size - (aligned + count);
+            }
+            inUse += count;
+            return aligned;
+        }
+
+        return std::nullopt;
+    }
+
+    void ranges::free(uint32_t offset, uint32_t count) {
+        if (count == 0) {
+            return;
+        }
+        inUse -= count;
+
+        auto next = freeList.lower_bound(offset);
+
+        // merge with the range after
+        if (next != freeList.end() && offset + count == next->first) {
+            count += next->second;
+            next = freeList.erase(next);
+        }
+
+        // and the one before
+        if (next != freeList.begin()) {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second == offset) {
+                prev->second += count;
+                return;
+            }
+        }
+
+        freeList[offset] = count;
+    }
+
+    void ranges::grow(uint32_t capacity) {
+        if (capacity <= cap) {
+            return;
+        }
+
+        const uint32_t added = capacity - cap;
+        if (!freeList.empty()) {
+            auto last = std::prev(freeList.end());
+            if (last->first + last->second == cap) {
+                last->second += added;
+                cap = capacity;
+                return;
+            }
+        }
+
+        freeList[cap] = added;
+        cap = capacity;
+    }
+
+    std::optional<chunked> split16(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t vertexStride) {
+        constexpr uint32_t maxVertices = 65536;
+        chunked c;
+
+        if (vertexCount <= maxVertices) {
+            c.indices.assign(indices.begin(), indices.end());
+            c.chunks.push_back({ 0, 0, uint32_t(indices.size()) });
+            return c;
+        }
+
+        std::vector<uint32_t> owner(vertexCount, UINT32_MAX); // chunk that last took a vertex
+        std::vector<uint16_t> local(vertexCount); // and where it put it
+
+        c.chunks.push_back({ 0, 0, 0 });
+
+        for (size_t tri = 0; tri + 2 < indices.size(); tri += 3) {
+            uint32_t chunkId = c.chunks.size() - 1;
+
+            uint32_t added = 0;
+            for (size_t k = 0; k < 3; k++) {
+                added += owner[indices[tri + k]] != chunkId;
+            }
+
+            // a triangle never straddles chunks, start a new one if it doesn't fit
+            if (c.remap.size() - c.chunks.back().vertexOffset + added > maxVertices) {
+                c.chunks.push_back({ uint32_t(c.remap.size()), uint32_t(c.indices.size()), 0 });
+                chunkId++;
+            }
+
+            for (size_t k = 0; k < 3; k++) {
+                const uint32_t v = indices[tri + k];
+                if (owner[v] != chunkId) {
+                    owner[v] = chunkId;
+                    local[v] = uint16_t(c.remap.size() - c.chunks.back().vertexOffset);
+                    c.remap.push_back(v);
+                }
+                c.indices.push_back(local[v]);
+            }
+            c.chunks.back().indexCount += 3;
+        }
+
+        const uint64_t bytes16 = uint64_t(c.indices.size()) * sizeof(uint16_t) + uint64_t(c.remap.size() - vertexCount) * vertexStride;
+        const uint64_t bytes32 = uint64_t(indices.size()) * sizeof(uint32_t);
+        if (bytes16 >= bytes32) {
+            return std::nullopt;
+        }
+
+        return c;
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <vector>
+
+// Sub-allocation for the geometry arena, which keeps every mesh's vertices and indices in one
+// vertex buffer and one index buffer so a frame binds them once and draws by offset.
+namespace geo {
+    // first-fit allocator over [0, capacity) in whole elements (vertices or indices),
+    // neighbouring free ranges are merged so meshes can come and go at runtime
+    class ranges {
+    public:
+        void reset(uint32_t capacity);
+
+        // offset is a multiple of align, nullopt if no free range is big enough
+        std::optional<uint32_t> allocate(uint32_t count, uint32_t align = 1);
+        void free(uint32_t offset, uint32_t count);
+
+        // extend to capacity, the new space joins whatever is free at the end
+        void grow(uint32_t capacity);
+
+        uint32_t capacity() const { return cap; }
+        uint32_t used() const { return inUse; }
+
+    private:
+        std::map<uint32_t, uint32_t> freeList; // offset -> count
+        uint32_t cap = 0;
+        uint32_t inUse = 0;
+    };
+
+    // a mesh's triangles regrouped so each group's vertices are addressable with 16-bit indices
+    struct chunked {
+        struct chunk {
+            uint32_t vertexOffset; // into remap
+            uint32_t firstIndex;
+            uint32_t indexCount;
+        };
+
+        std::vector<uint32_t> remap; // new vertex i is old vertex remap[i], empty if unchanged
+        std::vector<uint16_t> indices; // relative to their chunk's vertexOffset
+        std::vector<chunk> chunks;
+    };
+
+    // meshes with up to 65536 vertices narrow as they are, bigger ones are split into chunks that
+    // duplicate the vertices they share, nullopt if that costs more than 32-bit indices would
+    std::optional<chunked> split16(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t vertexStride);
+}
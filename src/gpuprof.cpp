@@ -0,0 +1,245 @@
+#include "gpuprof.hpp"
+
+#include <stdexcept>
+
+namespace prof {
+    void gpu::init(VkDevice dev, VkPhysicalDevice pdev, uint32_t validBits, unsigned int ringSize, bool keepHistory) {
+        this->dev = dev;
+        this->keepHistory = keepHistory;
+        enabled = validBits != 0;
+
+        if (!enabled) {
+            return;
+        }
+        mask = validBits >= 64 ? ~uint64_t(0) : (uint64_t(1) << validBits) - 1;
+
+        VkPhysicalDeviceProperties dprop;
+        vkGetPhysicalDeviceProperties(pdev, &dprop);
+        period = dprop.limits.timestampPeriod;
+
+        VkQueryPoolCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        createInfo.queryCount = 2 * maxScopes; // begin and end timestamp per scope
+
+        slots.resize(ringSize);
+        for (auto& s : slots) {
+            if (vkCreateQueryPool(dev, &createInfo, nullptr, &s.pool) != VK_SUCCESS) {
+                throw std::runtime_error("cannot create timestamp query pool!");
+            }
+        }
+    }
+
+    void gpu::destroy() {
+        for (auto& s : slots) {
+            vkDestroyQueryPool(dev, s.pool, nullptr);
+        }
+        slots.clear();
+        curr = nullptr;
+    }
+
+    void gpu::beginFrame(VkCommandBuffer buf, uint32_t slot) {
+        if (!enabled) {
+            return;
+        }
+
+        curr = &slots[slot];
+        curr->names.clear();
+        curr->paths.clear();
+        curr->depths.clear();
+        curr->written = true;
+        open.clear();
+
+        vkCmdResetQueryPool(buf, curr->pool, 0, 2 * maxScopes);
+    }
+
+    void gpu::begin(VkCommandBuffer buf, std::string_view name) {
+        if (!enabled || curr == nullptr) {
+            return;
+        }
+
+        // drop scopes past the end of the pool instead of failing
+        if (curr->names.size() >= maxScopes) {
+            open.push_back(-1);
+            return;
+        }
+
+        std::string path;
+        for (int i = open.size() - 1; i >= 0; i--) {
+            if (open[i] >= 0) {
+                path = curr->paths[open[i]] + "/";
+                break;
+            }
+        }
+        path += name;
+
+        int idx = curr->names.size();
+        curr->names.emplace_back(name);
+        curr->paths.push_back(std::move(path));
+        curr->depths.push_back(open.size());
+
+        vkCmdWriteTimestamp(buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, curr->pool, 2 * idx);
+        open.push_back(idx);
+    }
+
+    void gpu::end(VkCommandBuffer buf) {
+        if (!enabled || curr == nullptr || open.empty()) {
+            return;
+        }
+
+        int idx = open.back();
+        open.pop_back();
+
+        if (idx >= 0) {
+            // bottom of pipe waits for all prior work in the command buffer to complete
+            vkCmdWriteTimestamp(buf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, curr->pool, 2 * idx + 1);
+        }
+    }
+
+    void gpu::collect(uint32_t slot) {
+        if (!enabled) {
+            return;
+        }
+
+        slotQueries& s = slots[slot];
+        if (!s.written || s.names.empty()) {
+            return;
+        }
+
+        // each value followed by whether it was written. the submission has completed, so one that wasn't never
+        // will be: its scope was left open. it's dropped rather than waited on, and the slot's next beginFrame
+        // resets its queries along with the rest
+        std::vector<uint64_t> ts(2 * 2 * s.names.size());
+        VkResult r = vkGetQueryPoolResults(dev, s.pool, 0, 2 * s.names.size(), ts.size() * sizeof(uint64_t), ts.data(),
+            2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if (r != VK_SUCCESS && r != VK_NOT_READY) {
+            return;
+        }
+
+        last.clear();
+        for (size_t i = 0; i < s.names.size(); i++) {
+            const uint64_t* begin = &ts[4 * i];
+            const uint64_t* end = &ts[4 * i + 2];
+            if (begin[1] == 0 || end[1] == 0) {
+                continue;
+            }
+
+            // only the low bits count, and masking the difference too handles the counter wrapping in between
+            const uint64_t ticks = ((end[0] & mask) - (begin[0] & mask)) & mask;
+            last.push_back({ s.names[i], s.paths[i], s.depths[i], ticks * period / 1e6f });
+        }
+
+        if (keepHistory) {
+            hist.insert(hist.end(), last.begin(), last.end());
+            if (hist.size() > maxHistory) {
+                hist.erase(hist.begin(), hist.begin() + (hist.size() - maxHistory));
+            }
+        }
+
+        s.written = false;
+    }
+
+    float gpu::ms(std::string_view path) const {
+        for (const auto& r : last) {
+            if (r.path == path) {
+                return r.ms;
+            }
+        }
+        return 0.0f;
+    }
+
+    void pipeStats::init(VkDevice dev, bool supported, unsigned int ringSize) {
+        this->dev = dev;
+        enabled = supported;
+
+        if (!enabled) {
+            return;
+        }
+
+        VkQueryPoolCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        createInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        createInfo.queryCount = maxPasses;
+        createInfo.pipelineStatistics = flags;
+
+        slots.resize(ringSize);
+        for (auto& s : slots) {
+            if (vkCreateQueryPool(dev, &createInfo, nullptr, &s.pool) != VK_SUCCESS) {
+                throw std::runtime_error("cannot create pipeline statistics query pool!");
+            }
+        }
+    }
+
+    void pipeStats::destroy() {
+        for (auto& s : slots) {
+            vkDestroyQueryPool(dev, s.pool, nullptr);
+        }
+        slots.clear();
+        curr = nullptr;
+    }
+
+    void pipeStats::beginFrame(VkCommandBuffer buf, uint32_t slot) {
+        if (!enabled) {
+            return;
+        }
+
+        curr = &slots[slot];
+        curr->names.clear();
+        curr->written = true;
+        open = -1;
+
+        vkCmdResetQueryPool(buf, curr->pool, 0, maxPasses);
+    }
+
+    void pipeStats::begin(VkCommandBuffer buf, std::string_view name) {
+        if (!enabled || curr == nullptr || curr->names.size() >= maxPasses) {
+            open = -1;
+            return;
+        }
+
+        open = curr->names.size();
+        curr->names.emplace_back(name);
+
+        vkCmdBeginQuery(buf, curr->pool, open, 0);
+    }
+
+    void pipeStats::end(VkCommandBuffer buf) {
+        if (open < 0) {
+            return;
+        }
+
+        vkCmdEndQuery(buf, curr->pool, open);
+        open = -1;
+    }
+
+    void pipeStats::collect(uint32_t slot) {
+        if (!enabled) {
+            return;
+        }
+
+        slotQueries& s = slots[slot];
+        if (!s.written || s.names.empty()) {
+            return;
+        }
+
+        // the counters then availability, which stays 0 for a pass that was never ended
+        constexpr size_t stride = numCounters + 1;
+        std::vector<uint64_t> counters(stride * s.names.size());
+        VkResult r = vkGetQueryPoolResults(dev, s.pool, 0, s.names.size(), counters.size() * sizeof(uint64_t), counters.data(),
+            stride * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if (r != VK_SUCCESS && r != VK_NOT_READY) {
+            return;
+        }
+
+        last.clear();
+        for (size_t i = 0; i < s.names.size(); i++) {
+            const uint64_t* c = &counters[stride * i];
+            if (c[numCounters] == 0) {
+                continue;
+            }
+            last.push_back({ s.names[i], c[0], c[1], c[2], c[3], c[4], c[5] });
+        }
+
+        s.written = false;
+    }
+}
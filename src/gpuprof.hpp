@@ -0,0 +1,136 @@
+#pragma once
+
+#include "glfw_wrapper.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace prof {
+    // Timestamp profiler with nested scopes.
+    // Each slot in the ring has its own query pool, so a slot can be read back without stalling
+    // once the fence of the submission that used it has signaled.
+    class gpu {
+    public:
+        struct result {
+            std::string name;
+            std::string path; // names of enclosing scopes joined with '/'
+            unsigned int depth;
+            float ms;
+        };
+
+        // validBits is the queue family's timestampValidBits, 0 if it has no timestamps
+        void init(VkDevice dev, VkPhysicalDevice pdev, uint32_t validBits, unsigned int ringSize, bool keepHistory = false);
+        void destroy();
+
+        // start recording scopes into slot, must be outside a render pass
+        void beginFrame(VkCommandBuffer buf, uint32_t slot);
+
+        void begin(VkCommandBuffer buf, std::string_view name);
+        void end(VkCommandBuffer buf);
+
+        // read back a slot whose submission has completed. scopes that were never ended are left out
+        void collect(uint32_t slot);
+
+        // results of the most recently collected slot, in scope order
+        const std::vector<result>& results() const { return last; }
+
+        // every collected result, if history is kept (for one-off submissions like uploads)
+        const std::vector<result>& history() const { return hist; }
+
+        float ms(std::string_view path) const;
+
+        class scope {
+        public:
+            scope(gpu& p, VkCommandBuffer buf, std::string_view name) : p(p), buf(buf) { p.begin(buf, name); }
+            ~scope() { p.end(buf); }
+
+        private:
+            gpu& p;
+            VkCommandBuffer buf;
+        };
+
+    private:
+        constexpr static uint32_t maxScopes = 64;
+        constexpr static size_t maxHistory = 256;
+
+        struct slotQueries {
+            VkQueryPool pool = VK_NULL_HANDLE;
+            std::vector<std::string> names;
+            std::vector<std::string> paths;
+            std::vector<unsigned int> depths;
+            bool written = false;
+        };
+
+        VkDevice dev = VK_NULL_HANDLE;
+        float period = 0.0f; // ns per tick
+        uint64_t mask = 0; // the bits of a timestamp that are valid
+        bool enabled = false;
+        bool keepHistory = false;
+
+        std::vector<slotQueries> slots;
+        slotQueries* curr = nullptr;
+        std::vector<int> open; // stack of scope indices, -1 if the scope was dropped
+
+        std::vector<result> last;
+        std::vector<result> hist;
+    };
+
+    // Pipeline statistics per pass, ring-buffered like the timestamp profiler.
+    // Queries of the same type can't be active at once, so passes can't be nested.
+    class pipeStats {
+    public:
+        struct result {
+            std::string name;
+            uint64_t iaVertices;
+            uint64_t iaPrimitives;
+            uint64_t vsInvocations;
+            uint64_t clipInvocations;
+            uint64_t clipPrimitives;
+            uint64_t fsInvocations; // counted per fragment, not per sample, unless sample shading is on
+        };
+
+        void init(VkDevice dev, bool supported, unsigned int ringSize);
+        void destroy();
+
+        bool supported() const { return enabled; }
+
+        // start recording passes into slot, must be outside a render pass
+        void beginFrame(VkCommandBuffer buf, uint32_t slot);
+
+        // a pass started inside a render pass has to end in the same subpass
+        void begin(VkCommandBuffer buf, std::string_view name);
+        void end(VkCommandBuffer buf);
+
+        // like gpu::collect, passes that were never ended are left out
+        void collect(uint32_t slot);
+
+        const std::vector<result>& results() const { return last; }
+
+    private:
+        constexpr static uint32_t maxPasses = 16;
+        constexpr static VkQueryPipelineStatisticFlags flags =
+            VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+        constexpr static size_t numCounters = 6; // results are written in flag bit order
+
+        struct slotQueries {
+            VkQueryPool pool = VK_NULL_HANDLE;
+            std::vector<std::string> names;
+            bool written = false;
+        };
+
+        VkDevice dev = VK_NULL_HANDLE;
+        bool enabled = false;
+
+        std::vector<slotQueries> slots;
+        slotQueries* curr = nullptr;
+        int open = -1; // index of the active pass, -1 if none or dropped
+
+        std::vector<result> last;
+    };
+}
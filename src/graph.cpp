@@ -0,0 +1,503 @@
+#include "graph.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace rg {
+    namespace {
+        struct useInfo {
+            VkPipelineStageFlags stage;
+            VkAccessFlags access;
+            VkImageLayout layout;
+            VkImageUsageFlags usage;
+        };
+
+        useInfo info(use u) {
+            switch (u) {
+                case use::colorAttachment:
+                    return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT };
+                case use::depthAttachment:
+                    return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT };
+                case use::sampledFragment:
+                    return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT };
+                case use::sampledCompute:
+                    return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT };
+                case use::storageReadCompute:
+                    return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+                        VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT };
+                case use::storageWriteCompute:
+                    return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT };
+                case use::storageModifyCompute:
+                    return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT };
+                case use::storageReadFragment:
+                    return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+                        VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT };
+                case use::storageModifyFragment:
+                    return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT };
+                case use::transferSrc:
+                    return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT };
+                case use::transferDst:
+                    return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT };
+                case use::vertexInput:
+                    return { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                        VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
+                        VK_IMAGE_LAYOUT_UNDEFINED, 0 };
+                case use::indirectRead:
+                    return { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+                        VK_IMAGE_LAYOUT_UNDEFINED, 0 };
+            }
+            throw std::invalid_argument("unknown resource use!");
+        }
+
+        // only writes need to be made available, reads just need an execution dependency
+        constexpr VkAccessFlags writeAccesses = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        constexpr VkImageUsageFlags attachmentUsages = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+        bool hasStencil(VkFormat f) {
+            return f == VK_FORMAT_D16_UNORM_S8_UINT || f == VK_FORMAT_D24_UNORM_S8_UINT || f == VK_FORMAT_D32_SFLOAT_S8_UINT;
+        }
+
+        bool overlaps(uint32_t aFirst, uint32_t aLast, uint32_t bFirst, uint32_t bLast) {
+            return aFirst <= bLast && bFirst <= aLast;
+        }
+    }
+
+    void graph::init(VkDevice dev, VkPhysicalDevice pdev, mem::tracker* memory) {
+        this->dev = dev;
+        this->pdev = pdev;
+        this->memory = memory;
+    }
+
+    void graph::reset() {
+        for (auto& r : resources) {
+            if (!r.imported) {
+                vkDestroyImageView(dev, r.view, nullptr);
+                vkDestroyImage(dev, r.im, nullptr);
+            }
+        }
+        for (const heap& h : heaps) {
+            memory->free(dev, h.mem);
+        }
+
+        resources.clear();
+        passes.clear();
+        heaps.clear();
+        allocated = 0;
+        unaliased = 0;
+        lazy = 0;
+    }
+
+    handle graph::createImage(std::string_view name, const imageDesc& d) {
+        resource r;
+        r.name = name;
+        r.desc = d;
+        r.barrierAspect = d.aspect;
+        if ((d.aspect & VK_IMAGE_ASPECT_DEPTH_BIT) && hasStencil(d.format)) {
+            r.barrierAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+        }
+
+        resources.push_back(std::move(r));
+        return resources.size() - 1;
+    }
+
+    handle graph::importImage(std::string_view name, VkImage im, VkImageAspectFlags aspect, VkImageLayout layout) {
+        resource r;
+        r.name = name;
+        r.imported = true;
+        r.im = im;
+        r.barrierAspect = aspect;
+        r.st.layout = layout;
+
+        resources.push_back(std::move(r));
+        return resources.size() - 1;
+    }
+
+    handle graph::importBuffer(std::string_view name, VkBuffer buf) {
+        resource r;
+        r.name = name;
+        r.isImage = false;
+        r.imported = true;
+        r.buf = buf;
+
+        resources.push_back(std::move(r));
+        return resources.size() - 1;
+    }
+
+    handle graph::addPass(std::string_view name, recordFn record) {
+        pass p;
+        p.name = name;
+        p.record = std::move(record);
+
+        passes.push_back(std::move(p));
+        return passes.size() - 1;
+    }
+
+    void graph::addAccess(handle p, handle res, use u, bool write) {
+        for (const access& a : passes[p].accesses) {
+            if (a.res == res) {
+                throw std::invalid_argument(resources[res].name + " is used twice by " + passes[p].name + "!");
+            }
+        }
+        passes[p].accesses.push_back({ res, u, write });
+    }
+
+    void graph::read(handle p, handle res, use u) {
+        addAccess(p, res, u, false);
+    }
+
+    void graph::write(handle p, handle res, use u) {
+        addAccess(p, res, u, true);
+    }
+
+    void graph::present(handle p) {
+        passes[p].output = true;
+    }
+
+    void graph::compile() {
+        cull();
+
+        for (uint32_t i = 0; i < passes.size(); i++) {
+            if (passes[i].culled) {
+                continue;
+            }
+            for (const access& a : passes[i].accesses) {
+                resource& r = resources[a.res];
+                if (r.imported) {
+                    continue;
+                }
+                r.firstPass = std::min(r.firstPass, i);
+                r.lastPass = std::max(r.lastPass, i);
+                r.usage |= info(a.u).usage;
+            }
+        }
+
+        allocate();
+    }
+
+    // walk backwards from what's presented or imported, keeping passes that write something still needed
+    void graph::cull() {
+        std::vector<bool> needed(resources.size());
+        for (size_t i = 0; i < resources.size(); i++) {
+            needed[i] = resources[i].imported; // outlives the frame, so the last write is always observable
+        }
+
+        for (size_t i = passes.size(); i-- > 0;) {
+            pass& p = passes[i];
+
+            bool keep = p.output;
+            for (const access& a : p.accesses) {
+                keep |= a.write && needed[a.res];
+            }
+            p.culled = !keep;
+
+            if (!keep) {
+                continue;
+            }
+
+            // anything written here hides earlier writes, unless this pass also reads it
+            for (const access& a : p.accesses) {
+                if (a.write) {
+                    needed[a.res] = false;
+                }
+            }
+            for (const access& a : p.accesses) {
+                if (!a.write || a.u == use::storageModifyCompute || a.u == use::storageModifyFragment) {
+                    needed[a.res] = true;
+                }
+            }
+        }
+    }
+
+    // place each transient at the lowest offset that doesn't collide with one alive at the same time
+    void graph::allocate() {
+        std::vector<handle> order;
+        std::vector<VkMemoryRequirements> reqs(resources.size());
+
+        for (handle h = 0; h < resources.size(); h++) {
+            resource& r = resources[h];
+            if (r.imported || r.firstPass == UINT32_MAX) {
+                continue; // culled along with every pass using it
+            }
+
+            VkImageCreateInfo createInfo{};
+            createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            createInfo.imageType = VK_IMAGE_TYPE_2D;
+            createInfo.format = r.desc.format;
+            createInfo.extent = { r.desc.width, r.desc.height, 1 };
+            createInfo.mipLevels = 1;
+            createInfo.arrayLayers = 1;
+            createInfo.samples = r.desc.samples;
+            createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            createInfo.usage = r.usage;
+            createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            // never leaves the render pass, so tilers can keep it on chip
+            r.attachmentOnly = (r.usage & ~attachmentUsages) == 0;
+            if (r.attachmentOnly) {
+                createInfo.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+            }
+
+            if (vkCreateImage(dev, &createInfo, nullptr, &r.im) != VK_SUCCESS) {
+                throw std::runtime_error("cannot create transient image " + r.name + "!");
+            }
+
+            vkGetImageMemoryRequirements(dev, r.im, &reqs[h]);
+            r.size = reqs[h].size;
+            unaliased += r.size;
+            order.push_back(h);
+        }
+
+        // biggest first packs better
+        std::sort(order.begin(), order.end(), [&](handle a, handle b) { return resources[a].size > resources[b].size; });
+
+        struct heapInfo {
+            uint32_t typeBits;
+            bool attachmentOnly; // lazily allocated memory can only back transient attachments
+            VkDeviceSize size = 0;
+            std::vector<handle> members;
+        };
+        std::vector<heapInfo> infos;
+
+        for (handle h : order) {
+            resource& r = resources[h];
+
+            size_t k = 0;
+            while (k < infos.size() &&
+                ((infos[k].typeBits & reqs[h].memoryTypeBits) == 0 || infos[k].attachmentOnly != r.attachmentOnly)) {
+                k++;
+            }
+            if (k == infos.size()) {
+                infos.push_back({ reqs[h].memoryTypeBits, r.attachmentOnly, 0, {} });
+            }
+            heapInfo& heap = infos[k];
+
+            auto alignUp = [&](VkDeviceSize v) { return (v + reqs[h].alignment - 1) / reqs[h].alignment * reqs[h].alignment; };
+
+            std::vector<VkDeviceSize> candidates = { 0 };
+            for (handle m : heap.members) {
+                const resource& o = resources[m];
+                if (overlaps(r.firstPass, r.lastPass, o.firstPass, o.lastPass)) {
+                    candidates.push_back(alignUp(o.offset + o.size));
+                }
+            }
+            std::sort(candidates.begin(), candidates.end());
+
+            for (VkDeviceSize offset : candidates) {
+                bool fits = true;
+                for (handle m : heap.members) {
+                    const resource& o = resources[m];
+                    if (overlaps(r.firstPass, r.lastPass, o.firstPass, o.lastPass) &&
+                        offset < o.offset + o.size && o.offset < offset + r.size) {
+                        fits = false;
+                        break;
+                    }
+                }
+                if (fits) {
+                    r.offset = offset;
+                    break;
+                }
+            }
+
+            r.heap = k;
+            heap.size = std::max(heap.size, r.offset + r.size);
+            heap.typeBits &= reqs[h].memoryTypeBits;
+            heap.members.push_back(h);
+        }
+
+        for (const heapInfo& heap : infos) {
+            const auto type = mem::findType(pdev, heap.typeBits, heap.attachmentOnly ? mem::preset::transient : mem::preset::gpuOnly);
+            if (!type) {
+                throw std::runtime_error("cannot find memory type for transient images!");
+            }
+            const bool lazyType = memory->typeFlags(*type) & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+
+            VkMemoryAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            allocInfo.allocationSize = heap.size;
+            allocInfo.memoryTypeIndex = *type;
+
+            VkDeviceMemory mem;
+            if (memory->allocate(dev, allocInfo, mem::category::attachment, &mem) != VK_SUCCESS) {
+                throw std::runtime_error("cannot allocate transient memory!");
+            }
+            heaps.push_back({ mem, lazyType });
+            allocated += heap.size;
+            if (lazyType) {
+                lazy += heap.size;
+            }
+
+            // anything sharing memory has to wait for the previous user before discarding it
+            for (handle a : heap.members) {
+                for (handle b : heap.members) {
+                    const resource& ra = resources[a];
+                    const resource& rb = resources[b];
+                    if (a != b && ra.offset < rb.offset + rb.size && rb.offset < ra.offset + ra.size) {
+                        resources[a].aliases.push_back(b);
+                    }
+                }
+            }
+        }
+
+        for (handle h : order) {
+            resource& r = resources[h];
+            vkBindImageMemory(dev, r.im, heaps[r.heap].mem, r.offset);
+
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = r.im;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = r.desc.format;
+            viewInfo.subresourceRange.aspectMask = r.desc.aspect;
+            viewInfo.subresourceRange.levelCount = 1;
+            viewInfo.subresourceRange.layerCount = 1;
+
+            if (vkCreateImageView(dev, &viewInfo, nullptr, &r.view) != VK_SUCCESS) {
+                throw std::runtime_error("cannot create transient image view " + r.name + "!");
+            }
+        }
+    }
+
+    void graph::transition(resource& r, use u, bool write) {
+        const useInfo i = info(u);
+        const VkImageLayout layout = r.isImage ? i.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+        state& s = r.st;
+
+        VkPipelineStageFlags src = 0;
+        VkAccessFlags srcAccess = 0;
+        VkImageLayout oldLayout = s.layout;
+
+        if (r.fresh) {
+            // contents are discarded, but whatever last used the memory still has to finish
+            r.fresh = false;
+            oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            for (handle a : r.aliases) {
+                const state& o = resources[a].st;
+                src |= o.writeStage | o.readStages;
+                srcAccess |= o.writeAccess;
+            }
+        }
+
+        const bool relayout = r.isImage && oldLayout != layout;
+
+        if (write || relayout) {
+            src |= s.writeStage | s.readStages;
+            srcAccess |= s.writeAccess;
+        } else if (s.writeStage == 0 || (s.readStages & i.stage) == i.stage) {
+            s.readStages |= i.stage; // nothing to wait for, or already waited on by this stage
+            return;
+        } else {
+            src = s.writeStage;
+            srcAccess = s.writeAccess;
+        }
+
+        srcStages |= src ? src : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        dstStages |= i.stage;
+
+        if (r.isImage && (relayout || srcAccess)) {
+            VkImageMemoryBarrier b{};
+            b.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            b.srcAccessMask = srcAccess;
+            b.dstAccessMask = i.access;
+            b.oldLayout = oldLayout;
+            b.newLayout = layout;
+            b.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            b.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            b.image = r.im;
+            b.subresourceRange.aspectMask = r.barrierAspect;
+            b.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+            b.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+            imageBarriers.push_back(b);
+        } else if (!r.isImage && srcAccess) {
+            VkBufferMemoryBarrier b{};
+            b.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            b.srcAccessMask = srcAccess;
+            b.dstAccessMask = i.access;
+            b.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            b.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            b.buffer = r.buf;
+            b.size = VK_WHOLE_SIZE;
+            bufferBarriers.push_back(b);
+        }
+
+        if (write) {
+            s = { layout, i.stage, i.access & writeAccesses, 0 };
+        } else if (relayout) {
+            s = { layout, i.stage, 0, i.stage }; // later readers wait on the transition through this stage
+        } else {
+            s.readStages |= i.stage;
+        }
+    }
+
+    void graph::execute(VkCommandBuffer cbuf, uint32_t imageIndex) {
+        for (auto& r : resources) {
+            r.fresh = !r.imported;
+        }
+
+        for (const pass& p : passes) {
+            if (p.culled) {
+                continue;
+            }
+
+            imageBarriers.clear();
+            bufferBarriers.clear();
+            srcStages = 0;
+            dstStages = 0;
+
+            for (const access& a : p.accesses) {
+                transition(resources[a.res], a.u, a.write);
+            }
+
+            if (dstStages != 0) {
+                vkCmdPipelineBarrier(cbuf, srcStages, dstStages, 0, 0, nullptr,
+                    bufferBarriers.size(), bufferBarriers.data(), imageBarriers.size(), imageBarriers.data());
+            }
+
+            p.record(cbuf, imageIndex);
+        }
+    }
+
+    void graph::swapImports(handle a, handle b) {
+        resource& ra = resources[a];
+        resource& rb = resources[b];
+        if (!ra.imported || !rb.imported) {
+            throw std::invalid_argument("only imported resources can be swapped!");
+        }
+
+        std::swap(ra.im, rb.im);
+        std::swap(ra.view, rb.view);
+        std::swap(ra.buf, rb.buf);
+        std::swap(ra.st, rb.st);
+    }
+
+    // how much of the lazily allocated memory the driver has actually backed, which can grow while rendering
+    VkDeviceSize graph::committedLazyBytes() const {
+        VkDeviceSize committed = 0;
+        for (const heap& h : heaps) {
+            if (h.lazy) {
+                VkDeviceSize bytes = 0;
+                vkGetDeviceMemoryCommitment(dev, h.mem, &bytes);
+                committed += bytes;
+            }
+        }
+        return committed;
+    }
+
+    size_t graph::culledCount() const {
+        return std::count_if(passes.begin(), passes.end(), [](const pass& p) { return p.culled; });
+    }
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "glfw_wrapper.hpp"
+#include "memstats.hpp"
+#include "memtype.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Frame graph. Passes declare the images and buffers they read and write, and the graph
+// derives the barriers between them, drops passes whose results nothing uses, and places
+// transient images whose lifetimes don't overlap in the same memory.
+// It's built and compiled once per swapchain, then executed every frame. Resource state
+// carries over between executes, so a frame's first barrier on a resource waits for the
+// previous frame's last use of it.
+namespace rg {
+    using handle = uint32_t;
+
+    // how a pass uses a resource, each maps to a fixed stage, access mask and image layout
+    enum class use {
+        colorAttachment,
+        depthAttachment,
+        sampledFragment,
+        sampledCompute,
+        storageReadCompute,
+        storageWriteCompute,
+        storageModifyCompute, // read-modify-write or partial writes, so earlier writes aren't hidden
+        storageReadFragment,
+        storageModifyFragment, // likewise
+        transferSrc,
+        transferDst,
+        vertexInput, // vertex and index buffers
+        indirectRead, // draw arguments and counts
+    };
+
+    struct imageDesc {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+        VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT; // of the view, barriers cover every aspect of the format
+    };
+
+    class graph {
+    public:
+        // imageIndex is the swapchain image being rendered, for per-image framebuffers and descriptor sets
+        using recordFn = std::function<void(VkCommandBuffer cbuf, uint32_t imageIndex)>;
+
+        void init(VkDevice dev, VkPhysicalDevice pdev, mem::tracker* memory);
+        void destroy() { reset(); }
+
+        // destroy transients and forget every pass and resource, the device must be idle
+        void reset();
+
+        // images created and owned by the graph, only valid between the first and last pass using them
+        handle createImage(std::string_view name, const imageDesc& d);
+
+        // resources owned elsewhere that outlive a frame
+        handle importImage(std::string_view name, VkImage im, VkImageAspectFlags aspect,
+            VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED);
+        handle importBuffer(std::string_view name, VkBuffer buf);
+
+        // passes run in the order they're added, a resource can be used once per pass
+        handle addPass(std::string_view name, recordFn record);
+        void read(handle pass, handle res, use u);
+        void write(handle pass, handle res, use u);
+        void present(handle pass); // writes the swapchain, so it's never culled
+
+        // cull passes, work out lifetimes and allocate transients
+        void compile();
+
+        void execute(VkCommandBuffer cbuf, uint32_t imageIndex);
+
+        // exchange two imported images along with their tracked state, for history ping-ponging
+        void swapImports(handle a, handle b);
+
+        VkImage image(handle res) const { return resources[res].im; }
+        VkImageView view(handle res) const { return resources[res].view; }
+
+        size_t passCount() const { return passes.size(); }
+        size_t culledCount() const;
+        VkDeviceSize transientBytes() const { return allocated; } // after aliasing
+        VkDeviceSize unaliasedBytes() const { return unaliased; }
+
+        // attachments that never leave a render pass go in lazily allocated memory where the device has it,
+        // which tilers only back with physical pages if the attachment actually spills out of tile memory
+        VkDeviceSize lazyBytes() const { return lazy; }
+        VkDeviceSize committedLazyBytes() const;
+
+    private:
+        struct state {
+            VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            VkPipelineStageFlags writeStage = 0; // last write or layout transition
+            VkAccessFlags writeAccess = 0;
+            VkPipelineStageFlags readStages = 0; // stages that have waited on the last write
+        };
+
+        struct resource {
+            std::string name;
+            bool isImage = true;
+            bool imported = false;
+            imageDesc desc;
+            VkImageAspectFlags barrierAspect = 0;
+
+            VkImage im = VK_NULL_HANDLE;
+            VkImageView view = VK_NULL_HANDLE;
+            VkBuffer buf = VK_NULL_HANDLE;
+
+            state st;
+
+            // transients only
+            VkImageUsageFlags usage = 0;
+            bool attachmentOnly = false; // so it can be lazily allocated
+            uint32_t firstPass = UINT32_MAX;
+            uint32_t lastPass = 0;
+            bool fresh = false; // not yet used this frame, so contents are discarded on first use
+            uint32_t heap = 0;
+            VkDeviceSize offset = 0;
+            VkDeviceSize size = 0;
+            std::vector<handle> aliases; // transients sharing some of this one's memory
+        };
+
+        struct access {
+            handle res;
+            use u;
+            bool write;
+        };
+
+        struct pass {
+            std::string name;
+            recordFn record;
+            std::vector<access> accesses;
+            bool output = false;
+            bool culled = false;
+        };
+
+        VkDevice dev = VK_NULL_HANDLE;
+        VkPhysicalDevice pdev = VK_NULL_HANDLE;
+        mem::tracker* memory = nullptr;
+
+        std::vector<resource> resources;
+        std::vector<pass> passes;
+
+        struct heap {
+            VkDeviceMemory mem = VK_NULL_HANDLE;
+            bool lazy = false;
+        };
+
+        std::vector<heap> heaps;
+        VkDeviceSize allocated = 0;
+        VkDeviceSize unaliased = 0;
+        VkDeviceSize lazy = 0;
+
+        void addAccess(handle pass, handle res, use u, bool write);
+        void cull();
+        void allocate();
+
+        // barriers for one pass, merged into a single vkCmdPipelineBarrier
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+        std::vector<VkBufferMemoryBarrier> bufferBarriers;
+        VkPipelineStageFlags srcStages = 0;
+        VkPipelineStageFlags dstStages = 0;
+        void transition(resource& r, use u, bool write);
+    };
+}
@@ -1,19 +1,37 @@
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+#include <glm/common.hpp>
+
 #include "main.hpp"
 
 // stores framebuffer config
 void appvk::createRenderPass() {
+    PROF_ZONE("createRenderPass");
+
+    // without msaa there's nothing to resolve, so we render straight into the swapchain image
+    const bool resolve = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+    // with post-process aa the scene goes to an offscreen target, which postPass samples afterwards
+    const bool post = postAA();
+
     std::array<VkAttachmentDescription, 3> attachments;
 
-    // multisample
+    // multisample (or the swapchain image if not resolving)
     attachments[0].flags = 0;
     attachments[0].format = swapFormat; // format from swapchain image
     attachments[0].samples = msaaSamples;
     attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[0].storeOp = resolve && !post ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
     attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED; // layout of image before render pass - don't care since we'll be clearing it anyways
-    attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL; // layout of image at end of render pass
+    attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; // layout of image at end of render pass
+    if (resolve || post) {
+        // frame graph target, the graph does its layout transitions
+        attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    }
 
     const std::vector<VkFormat> formatList = {
         VK_FORMAT_D24_UNORM_S8_UINT,
@@ -31,11 +49,15 @@ void appvk::createRenderPass() {
     attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    // initialLayout needs to be set before we start rendering, otherwise
-    // clearing and a layout transition from undefined -> depth stencil optimal happen at the same time
+    // the frame graph moves depth into attachment layout before the pass
     attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
     attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+    // taa reads depth to reproject history
+    if (aa == aaMode::taa) {
+        attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    }
+
     // resolve
     attachments[2].flags = 0;
     attachments[2].format = swapFormat;
@@ -63,7 +85,7 @@ void appvk::createRenderPass() {
     subs[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subs[0].colorAttachmentCount = 1; // color attachments are FS outputs, can also specify input / depth attachments, etc.
     subs[0].pColorAttachments = &colorAttachmentRef;
-    subs[0].pResolveAttachments = &resolveAttachmentRef;
+    subs[0].pResolveAttachments = resolve ? &resolveAttachmentRef : nullptr;
     subs[0].pDepthStencilAttachment = &depthAttachmentRef;
 
     std::array<VkSubpassDependency, 1> deps = {};
@@ -77,10 +99,11 @@ void appvk::createRenderPass() {
     deps[0].dstSubpass = 0; // index into pSubpasses
     deps[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT; // stage we write to
     deps[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT; // what we're using that output for
+    // the frame graph covers dependencies on its own targets
 
     VkRenderPassCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    createInfo.attachmentCount = attachments.size();
+    createInfo.attachmentCount = resolve ? 3 : 2;
     createInfo.pAttachments = attachments.data();
     createInfo.subpassCount = subs.size();
     createInfo.pSubpasses = subs.data();
@@ -90,128 +113,30 @@ void appvk::createRenderPass() {
     if (vkCreateRenderPass(dev, &createInfo, nullptr, &renderPass) != VK_SUCCESS) {
         throw std::runtime_error("cannot create render pass!");
     }
+    renderPassFormat = swapFormat;
 }
 
+// layouts are created here and the pipelines are queued on the pipeline manager's workers
 void appvk::createGraphicsPipeline() {
-    std::vector<char> vertspv = readFile(".spv/shader.vert.spv");
-    std::vector<char> fragspv = readFile(".spv/shader.frag.spv");
-
-    VkShaderModule vmod = createShaderModule(vertspv);
-    VkShaderModule fmod = createShaderModule(fragspv);
-
-    std::array<VkPipelineShaderStageCreateInfo, 2> shaders = {};
-    
-    shaders[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaders[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-    shaders[0].module = vmod;
-    shaders[0].pName = "main";
-    
-    shaders[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaders[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    shaders[1].module = fmod;
-    shaders[1].pName = "main";
-    
-    VkVertexInputBindingDescription bindDesc;
-    bindDesc.binding = 0;
-    bindDesc.stride = sizeof(vformat::vertex);
-    bindDesc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    PROF_ZONE("createGraphicsPipeline");
 
-    std::array<VkVertexInputAttributeDescription, 4> attrDesc;
-    for (size_t i = 0; i < attrDesc.size(); i++) {
-        attrDesc[i].location = i;
-        attrDesc[i].binding = 0;
-        attrDesc[i].offset = 16 * i; // all offsets are rounded up to 16 bytes due to alignas
-    }
-
-    attrDesc[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attrDesc[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attrDesc[2].format = VK_FORMAT_R32G32_SFLOAT;
-    attrDesc[3].format = VK_FORMAT_R32G32B32_SFLOAT;
-    
-    VkPipelineVertexInputStateCreateInfo vinCreateInfo{};
-    vinCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vinCreateInfo.vertexBindingDescriptionCount = 1;
-    vinCreateInfo.pVertexBindingDescriptions = &bindDesc;
-    vinCreateInfo.vertexAttributeDescriptionCount = attrDesc.size();
-    vinCreateInfo.pVertexAttributeDescriptions = attrDesc.data();
-
-    VkPipelineInputAssemblyStateCreateInfo inAsmCreateInfo{};
-    inAsmCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inAsmCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inAsmCreateInfo.primitiveRestartEnable = VK_FALSE;
-
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = swapExtent.height;
-    viewport.width = swapExtent.width;
-    // Vulkan says -Y is up, not down, flip so we're compatible with OpenGL code and obj models
-    viewport.height = -1.0f * swapExtent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    VkRect2D scissor{};
-    scissor.offset = {0, 0};
-    scissor.extent = swapExtent;
-
-    VkPipelineViewportStateCreateInfo viewCreateInfo{};
-    viewCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewCreateInfo.viewportCount = 1;
-    viewCreateInfo.pViewports = &viewport;
-    viewCreateInfo.scissorCount = 1;
-    viewCreateInfo.pScissors = &scissor;
-    
-    VkPipelineRasterizationStateCreateInfo rasterCreateInfo{};
-    rasterCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterCreateInfo.depthClampEnable = VK_FALSE; // clamps depth to range instead of discarding it
-    rasterCreateInfo.rasterizerDiscardEnable = VK_FALSE; // disables rasterization if true
-    rasterCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterCreateInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE; // flip cull order due to inverting y in rasterizer
-    rasterCreateInfo.depthBiasEnable = VK_FALSE;
-    rasterCreateInfo.lineWidth = 1.0f;
-
-    VkPipelineMultisampleStateCreateInfo msCreateInfo{};
-    msCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    msCreateInfo.sampleShadingEnable = VK_FALSE;
-    msCreateInfo.rasterizationSamples = msaaSamples;
-
-    VkPipelineDepthStencilStateCreateInfo dCreateInfo{};
-    dCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    dCreateInfo.depthTestEnable = VK_TRUE;
-    dCreateInfo.depthWriteEnable = VK_TRUE;
-    dCreateInfo.depthCompareOp = VK_COMPARE_OP_LESS;
-    dCreateInfo.depthBoundsTestEnable = VK_FALSE;
-    dCreateInfo.stencilTestEnable = VK_FALSE;
-
-    VkPipelineColorBlendAttachmentState colorAttachment{}; // blending information per fb
-    colorAttachment.blendEnable = VK_FALSE;
-    colorAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | 
-                                        VK_COLOR_COMPONENT_G_BIT | 
-                                        VK_COLOR_COMPONENT_B_BIT |
-                                        VK_COLOR_COMPONENT_A_BIT;
-
-    VkPipelineColorBlendStateCreateInfo colorCreateInfo{};
-    colorCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorCreateInfo.logicOpEnable = VK_FALSE;
-    colorCreateInfo.attachmentCount = 1;
-    colorCreateInfo.pAttachments = &colorAttachment;
-    
-    VkPipelineDynamicStateCreateInfo dynCreateInfo{};
-    dynCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynCreateInfo.dynamicStateCount = 0;
-
-    std::array<VkPushConstantRange, 1> pcr{};
+    std::array<VkPushConstantRange, 2> pcr{};
 
     // camera position
     pcr[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     pcr[0].offset = 0;
     pcr[0].size = sizeof(glm::vec3);
 
+    // virtual texture ids of the maps and the frame, which picks the pixels that record feedback
+    pcr[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pcr[1].offset = 16;
+    pcr[1].size = sizeof(virtualPush);
+
     VkPipelineLayoutCreateInfo pipeLayoutCreateInfo{}; // for descriptor sets
     pipeLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipeLayoutCreateInfo.setLayoutCount = 1;
     pipeLayoutCreateInfo.pSetLayouts = &t.layout;
-    pipeLayoutCreateInfo.pushConstantRangeCount = pcr.size();
+    pipeLayoutCreateInfo.pushConstantRangeCount = virtualTextures ? 2 : 1;
     pipeLayoutCreateInfo.pPushConstantRanges = pcr.data();
 
     if (vkCreatePipelineLayout(dev, &pipeLayoutCreateInfo, nullptr, &t.pipeLayout) != VK_SUCCESS) {
@@ -224,65 +149,79 @@ void appvk::createGraphicsPipeline() {
         throw std::runtime_error("cannot create flr pipeline layout!");
     }
 
-    std::array<VkGraphicsPipelineCreateInfo, 2> pipeCreateInfos = {};
-    std::array<VkPipeline, 2> pipes;
+    pso::desc d;
+    d.vert = ".spv/shader.vert.spv";
+    d.frag = virtualTextures ? ".spv/shader.frag.spv" : ".spv/whole.frag.spv";
 
-    pipeCreateInfos[0].sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    
-    if (shader_debug) {
-        pipeCreateInfos[0].flags = VK_PIPELINE_CREATE_CAPTURE_STATISTICS_BIT_KHR;
-    }
-    
-    // (no major speedup expected from pipeline derivatives)
-    pipeCreateInfos[0].stageCount = shaders.size();
-    pipeCreateInfos[0].pStages = shaders.data();
-    pipeCreateInfos[0].pVertexInputState = &vinCreateInfo;
-    pipeCreateInfos[0].pInputAssemblyState = &inAsmCreateInfo;
-    pipeCreateInfos[0].pViewportState = &viewCreateInfo;
-    pipeCreateInfos[0].pRasterizationState = &rasterCreateInfo;
-    pipeCreateInfos[0].pMultisampleState = &msCreateInfo;
-    pipeCreateInfos[0].pDepthStencilState = &dCreateInfo;
-    pipeCreateInfos[0].pColorBlendState = &colorCreateInfo;
-    pipeCreateInfos[0].layout = t.pipeLayout; // handle, not a struct.
-    pipeCreateInfos[0].renderPass = renderPass;
-    pipeCreateInfos[0].subpass = 0;
-
-    pipeCreateInfos[1] = pipeCreateInfos[0];
-    
-    if (vkCreateGraphicsPipelines(dev, VK_NULL_HANDLE, things.size(), pipeCreateInfos.data(), nullptr, pipes.data()) != VK_SUCCESS) {
-        throw std::runtime_error("cannot create graphics pipeline!");
-    }
+    VkVertexInputBindingDescription bindDesc;
+    bindDesc.binding = 0;
+    bindDesc.stride = vtx::packed::layout::stride;
+    bindDesc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    d.bindings.push_back(bindDesc);
 
-    for (size_t i = 0; i < things.size(); i++) {
-        things[i].pipe = pipes[i];
-    }
+    const auto attributes = vtx::packed::layout::attributes(0);
+    d.attributes.assign(attributes.begin(), attributes.end());
 
-    if (shader_debug && !printed) {
-        printShaderStats(t.pipe);
-        printed = true; // prevent stats from being printed again if we recreate the pipeline
-    }
-    
-    vkDestroyShaderModule(dev, vmod, nullptr); // we can destroy shader modules once the graphics pipeline is created.
-    vkDestroyShaderModule(dev, fmod, nullptr);
+    d.renderPass = renderPass;
+    d.samples = msaaSamples;
+    d.captureStats = captureShaderStats;
+
+    d.layout = t.pipeLayout;
+    t.pipe = pipelines.request("object", d);
+
+    d.layout = flr.pipeLayout;
+    flr.pipe = pipelines.request("floor", d);
+
+    // the layouts are identical, so the object pipeline can stand in for anything still compiling
+    pipelines.setFallback(t.pipe);
 }
 
 void appvk::createFramebuffers() {
     swapFramebuffers.resize(swapImageViews.size());
 
+    if (postAA()) {
+        // the scene is drawn once into sceneColor, only the post pass writes to the swapchain
+        VkImageView sceneAttachments[] = { frameGraph.view(sceneTarget), frameGraph.view(depthTarget) };
+
+        VkFramebufferCreateInfo fCreateInfo{};
+        fCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        fCreateInfo.renderPass = renderPass;
+        fCreateInfo.attachmentCount = 2;
+        fCreateInfo.pAttachments = sceneAttachments;
+        fCreateInfo.width = swapExtent.width;
+        fCreateInfo.height = swapExtent.height;
+        fCreateInfo.layers = 1;
+
+        if (vkCreateFramebuffer(dev, &fCreateInfo, nullptr, &sceneFramebuffer) != VK_SUCCESS) {
+            throw std::runtime_error("cannot create scene framebuffer!");
+        }
+
+        fCreateInfo.renderPass = postPass;
+        fCreateInfo.attachmentCount = 1;
+        for (size_t i = 0; i < swapFramebuffers.size(); i++) {
+            fCreateInfo.pAttachments = &swapImageViews[i];
+            if (vkCreateFramebuffer(dev, &fCreateInfo, nullptr, &swapFramebuffers[i]) != VK_SUCCESS) {
+                throw std::runtime_error("cannot create framebuffer!");
+            }
+        }
+        return;
+    }
+
     for (size_t i = 0; i < swapFramebuffers.size(); i++) {
         
         // having a single depth buffer with >1 swap image only works if graphics and pres queues are the same.
         // this is due to submissions in a single queue having to respect both submission order and semaphores
+        const bool resolve = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
         VkImageView attachments[] = {
-            ms.view, // multisampled render image
-            depth.view,
+            resolve ? frameGraph.view(msTarget) : swapImageViews[i], // multisampled render image
+            frameGraph.view(depthTarget),
             swapImageViews[i] // swapchain present image
         };
 
         VkFramebufferCreateInfo fCreateInfo{};
         fCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
         fCreateInfo.renderPass = renderPass;
-        fCreateInfo.attachmentCount = 3;
+        fCreateInfo.attachmentCount = resolve ? 3 : 2;
         fCreateInfo.pAttachments = attachments; // framebuffer attaches to the image view of a swapchain
         fCreateInfo.width = swapExtent.width;
         fCreateInfo.height = swapExtent.height;
@@ -294,61 +233,289 @@ void appvk::createFramebuffers() {
     }
 }
 
-appvk::buffer appvk::createVertexBuffer(const std::vector<uint8_t>& verts) {
-    VkDeviceSize bufferSize = verts.size();
-    buffer staging = createBuffer(verts.size(), 
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    
-    buffer local = createBuffer(verts.size(), 
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, 
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+namespace {
+    // both ends of the copy when an arena grows
+    constexpr VkBufferUsageFlags arenaUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+}
 
-    void *data;
-    vkMapMemory(dev, staging.mem, 0, bufferSize, 0, &data);
-    memcpy(data, verts.data(), bufferSize);
-    vkUnmapMemory(dev, staging.mem);
+void appvk::createGeometryArena() {
+    PROF_ZONE("createGeometryArena");
 
-    copyBuffer(staging.buf, local.buf, bufferSize);
+    arenaVert = createDeviceBuffer(VkDeviceSize(arenaVertices) * sizeof(vtx::packed),
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | arenaUsage, mem::category::mesh);
+    arenaIndex = createDeviceBuffer(VkDeviceSize(arenaIndexUnits) * sizeof(uint16_t),
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT | arenaUsage, mem::category::mesh);
 
-    vkFreeMemory(dev, staging.mem, nullptr);
-    vkDestroyBuffer(dev, staging.buf, nullptr);
+    arenaVertRanges.reset(arenaVertices);
+    arenaIndexRanges.reset(arenaIndexUnits);
 
-    return local;
+    if (gpuCulling) {
+        arenaMeshlet = createDeviceBuffer(VkDeviceSize(arenaMeshlets) * sizeof(cluster::cullable),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, mem::category::mesh);
+        arenaMeshletRanges.reset(arenaMeshlets);
+    }
 }
 
-// wrapper for raw createVertexBuffer that takes a vloader mesh
-appvk::buffer appvk::createVertexBuffer(std::vector<vformat::vertex>& v) {
-    auto bytePtr = reinterpret_cast<uint8_t*>(v.data());
-	std::vector<uint8_t> byteData(bytePtr, bytePtr + v.size() * sizeof(vformat::vertex));
+void appvk::destroyGeometryArena() {
+    vkDestroyBuffer(dev, arenaMeshlet.buf, nullptr);
+    memory.free(dev, arenaMeshlet.mem);
 
-    return createVertexBuffer(byteData);
+    vkDestroyBuffer(dev, arenaIndex.buf, nullptr);
+    memory.free(dev, arenaIndex.mem);
+
+    vkDestroyBuffer(dev, arenaVert.buf, nullptr);
+    memory.free(dev, arenaVert.mem);
 }
 
-appvk::buffer appvk::createIndexBuffer(const std::vector<uint32_t>& indices) {
-    VkDeviceSize bufferSize = indices.size() * sizeof(uint32_t);
+// a range that doesn't fit doubles the arena until it does. frames in flight keep drawing from the old
+// buffer, which goes once they're done, and anything recorded from now on binds the new one
+uint32_t appvk::allocateArena(buffer& b, geo::ranges& r, VkDeviceSize elemSize, VkBufferUsageFlags usage, uint32_t count, uint32_t align) {
+    if (auto start = r.allocate(count, align)) {
+        return *start;
+    }
 
-    buffer staging = createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    PROF_ZONE("growArena");
 
-    buffer local = createBuffer(bufferSize,
-    VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    uint64_t capacity = std::max(r.capacity(), 1u);
+    while (capacity < uint64_t(r.capacity()) + count + align) {
+        capacity *= 2;
+    }
+    if (capacity > UINT32_MAX) {
+        throw std::runtime_error("cannot grow geometry arena!");
+    }
 
-    void *data;
-    vkMapMemory(dev, staging.mem, 0, bufferSize, 0, &data);
-    memcpy(data, indices.data(), bufferSize);
-    vkUnmapMemory(dev, staging.mem);
+    buffer grown = createDeviceBuffer(capacity * elemSize, usage | arenaUsage, mem::category::mesh);
 
-    copyBuffer(staging.buf, local.buf, bufferSize);
+    VkCommandBuffer buf = beginSingleCommand(false);
+    VkBufferCopy copy{};
+    copy.size = VkDeviceSize(r.capacity()) * elemSize;
+    vkCmdCopyBuffer(buf, b.buf, grown.buf, 1, &copy);
 
-    vkFreeMemory(dev, staging.mem, nullptr);
-    vkDestroyBuffer(dev, staging.buf, nullptr);
+    // waited for, since with resizable bar the writes that follow go straight through a mapping
+    VkFence copied = submitSingleCommand(buf);
+    vkWaitForFences(dev, 1, &copied, VK_FALSE, UINT64_MAX);
+
+    deletions.push(frameNumber, [this, b] {
+        vkDestroyBuffer(dev, b.buf, nullptr);
+        memory.free(dev, b.mem);
+    });
+    b = grown;
+    r.grow(uint32_t(capacity));
+
+    return *r.allocate(count, align);
+}
+
+// 16-bit indices wherever they fit, splitting big meshes if that's still smaller, then meshlets
+appvk::cookedMesh::level appvk::cookLevel(std::vector<vtx::packed> verts, const std::vector<uint32_t>& indices) {
+    cookedMesh::level l;
+    l.triangles = indices.size() / 3;
+
+    auto narrow = geo::split16(indices, verts.size(), sizeof(vtx::packed));
+    if (narrow && !narrow->remap.empty()) {
+        verts = opt::remap(verts, narrow->remap);
+    }
+    l.verts = std::move(verts);
+
+    if (narrow) {
+        l.indexType = VK_INDEX_TYPE_UINT16;
+        l.indices16 = std::move(narrow->indices);
+        for (const auto& c : narrow->chunks) {
+            l.draws.push_back({ int32_t(c.vertexOffset), c.firstIndex, c.indexCount });
+        }
+    } else {
+        l.indexType = VK_INDEX_TYPE_UINT32;
+        l.indices32 = indices;
+        l.draws.push_back({ 0, 0, uint32_t(indices.size()) });
+    }
+
+    // meshlets are built per draw, so each is a range of that draw's indices
+    for (const mesh::draw& dr : l.draws) {
+        const float* positions = reinterpret_cast<const float*>(l.verts.data() + dr.vertexOffset); // position comes first
+
+        const cluster::built b = narrow
+            ? cluster::build(l.indices16.data() + dr.firstIndex, dr.indexCount, l.verts.size() - dr.vertexOffset, positions, sizeof(vtx::packed))
+            : cluster::build(l.indices32.data(), l.indices32.size(), l.verts.size(), positions, sizeof(vtx::packed));
+
+        for (const cluster::meshlet& ml : b.meshlets) {
+            cluster::cullable c;
+            std::copy(std::begin(ml.center), std::end(ml.center), c.sphere);
+            c.sphere[3] = ml.radius;
+            std::copy(std::begin(ml.coneAxis), std::end(ml.coneAxis), c.cone);
+            c.cone[3] = ml.coneCutoff;
+            c.firstIndex = dr.firstIndex + ml.firstTriangle * 3;
+            c.indexCount = ml.triangleCount * 3;
+            c.vertexOffset = dr.vertexOffset;
+            c.pad = 0;
+            l.meshlets.push_back(c);
+        }
+    }
+
+    return l;
+}
+
+// quantise, optimise and split a freshly loaded mesh, followed by a chain of simplified levels.
+// nothing here touches the device, so meshes cook on the job pool while the loaders are still busy
+appvk::cookedMesh appvk::cookMesh(std::string_view name, const std::vector<vformat::vertex>& loaded, std::vector<uint32_t> indices) {
+    PROF_ZONE("cookMesh");
+
+    constexpr size_t maxLevels = 6;
+    constexpr size_t minTriangles = 32; // not worth another level below this
+
+    auto verts = vtx::pack(loaded);
+    auto positions = [&] { return reinterpret_cast<const float*>(verts.data()); }; // position comes first
+
+    const opt::cacheStats before = opt::analyse(indices, verts.size());
+    opt::optimise(verts, indices, positions());
+    const opt::cacheStats after = opt::analyse(indices, verts.size());
+
+    std::ostringstream log; // written in one go, other meshes are cooking at the same time
+    log << name << ": acmr " << std::fixed << std::setprecision(3) << before.acmr << " -> " << after.acmr
+        << ", atvr " << before.atvr << " -> " << after.atvr << std::defaultfloat << "\n";
+
+    glm::vec3 lo(INFINITY), hi(-INFINITY);
+    for (const auto& v : verts) {
+        lo = glm::min(lo, v.position);
+        hi = glm::max(hi, v.position);
+    }
+    const glm::vec3 center = 0.5f * (lo + hi);
+    float radius = 0.0f;
+    for (const auto& v : verts) {
+        radius = std::max(radius, glm::length(v.position - center));
+    }
+
+    cookedMesh c;
+    c.sphere = glm::vec4(center, radius);
+
+    float error = 0.0f;
+    for (;;) {
+        c.levels.push_back(cookLevel(verts, indices));
+        c.levels.back().error = error;
+
+        if (c.levels.size() == maxLevels || indices.size() / 3 < minTriangles) {
+            break;
+        }
 
-    return local;
+        // each level halves the last, its error on top of the last level's
+        float levelError;
+        auto simpler = lod::simplify(indices, verts.size(), positions(), sizeof(vtx::packed), indices.size() / 6 * 3, levelError);
+        if (simpler.size() > indices.size() * 85 / 100) {
+            break; // only seams and borders left
+        }
+        error += levelError;
+        indices = std::move(simpler);
+
+        opt::optimise(verts, indices, positions()); // also drops the vertices that collapsed away
+    }
+
+    log << name << ": " << c.levels.size() << " levels of detail,";
+    for (const auto& l : c.levels) {
+        log << " " << l.triangles;
+    }
+    log << " triangles\n";
+    cout << log.str();
+
+    return c;
+}
+
+appvk::mesh appvk::uploadLevel(const cookedMesh::level& l) {
+    const bool narrow = l.indexType == VK_INDEX_TYPE_UINT16;
+
+    mesh m;
+    m.indexType = l.indexType;
+    m.vertexCount = l.verts.size();
+    m.indexUnits = narrow ? l.indices16.size() : l.indices32.size() * 2;
+    m.triangles = l.triangles;
+    m.error = l.error;
+
+    m.vertexStart = allocateArena(arenaVert, arenaVertRanges, sizeof(vtx::packed), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, m.vertexCount);
+    try {
+        // 32-bit indices have to start on a 4 byte boundary
+        m.indexStart = allocateArena(arenaIndex, arenaIndexRanges, sizeof(uint16_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, m.indexUnits, narrow ? 1 : 2);
+    } catch (...) {
+        arenaVertRanges.free(m.vertexStart, m.vertexCount);
+        throw;
+    }
+
+    writeBuffer(arenaVert, VkDeviceSize(m.vertexStart) * sizeof(vtx::packed), l.verts.data(), l.verts.size() * sizeof(vtx::packed));
+    if (narrow) {
+        writeBuffer(arenaIndex, VkDeviceSize(m.indexStart) * sizeof(uint16_t), l.indices16.data(), l.indices16.size() * sizeof(uint16_t));
+    } else {
+        writeBuffer(arenaIndex, VkDeviceSize(m.indexStart) * sizeof(uint16_t), l.indices32.data(), l.indices32.size() * sizeof(uint32_t));
+    }
+
+    // cooked draws and meshlets are relative to the level, the arena offsets go on now
+    const uint32_t firstIndex = narrow ? m.indexStart : m.indexStart / 2;
+    for (const mesh::draw& d : l.draws) {
+        m.draws.push_back({ d.vertexOffset + int32_t(m.vertexStart), d.firstIndex + firstIndex, d.indexCount });
+    }
+
+    if (!gpuCulling) {
+        return m;
+    }
+
+    std::vector<cluster::cullable> meshlets = l.meshlets;
+    for (cluster::cullable& c : meshlets) {
+        c.firstIndex += firstIndex;
+        c.vertexOffset += m.vertexStart;
+    }
+
+    auto meshletStart = arenaMeshletRanges.allocate(meshlets.size());
+    if (!meshletStart) {
+        cout << "meshlet arena full, drawing a level of " << m.triangles << " triangles without culling\n";
+        return m;
+    }
+    m.meshletStart = *meshletStart;
+    m.meshletCount = meshlets.size();
+
+    writeBuffer(arenaMeshlet, VkDeviceSize(m.meshletStart) * sizeof(cluster::cullable), meshlets.data(), meshlets.size() * sizeof(cluster::cullable));
+
+    return m;
+}
+
+std::vector<appvk::mesh> appvk::uploadMesh(const cookedMesh& c) {
+    PROF_ZONE("uploadMesh");
+
+    std::vector<mesh> lods;
+    for (const auto& l : c.levels) {
+        lods.push_back(uploadLevel(l));
+        lods.back().sphere = c.sphere;
+    }
+    return lods;
+}
+
+// its ranges are reused once the frame being recorded is done with them
+void appvk::freeMesh(mesh& m) {
+    deletions.push(frameNumber, [this, m] {
+        arenaVertRanges.free(m.vertexStart, m.vertexCount);
+        arenaIndexRanges.free(m.indexStart, m.indexUnits);
+        if (m.meshletCount > 0) {
+            arenaMeshletRanges.free(m.meshletStart, m.meshletCount);
+        }
+    });
+    m = {};
+}
+
+void appvk::bindGeometryArena(VkCommandBuffer cbuf) {
+    VkDeviceSize offset[] = { 0 };
+    vkCmdBindVertexBuffers(cbuf, 0, 1, &arenaVert.buf, offset);
+    vkCmdBindIndexBuffer(cbuf, arenaIndex.buf, 0, VK_INDEX_TYPE_UINT16);
+    arenaIndexType = VK_INDEX_TYPE_UINT16;
+}
+
+// the index buffer is only rebound when the index type changes
+void appvk::drawMesh(VkCommandBuffer cbuf, const mesh& m) {
+    if (m.indexType != arenaIndexType) {
+        vkCmdBindIndexBuffer(cbuf, arenaIndex.buf, 0, m.indexType);
+        arenaIndexType = m.indexType;
+    }
+
+    for (const auto& d : m.draws) {
+        vkCmdDrawIndexed(cbuf, d.indexCount, 1, d.firstIndex, d.vertexOffset, 0);
+    }
 }
 
 appvk::texture appvk::createTextureImage(int width, int height, const unsigned char* data, bool makeMips) {
+    PROF_ZONE("createTextureImage");
 
     unsigned int mipLevels;
     if (makeMips) {
@@ -361,7 +528,7 @@ appvk::texture appvk::createTextureImage(int width, int height, const unsigned c
 
     buffer staging = createBuffer(imageSize, 
         VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        mem::preset::staging, mem::category::staging);
 
     void *map_data;
     vkMapMemory(dev, staging.mem, 0, imageSize, 0, &map_data);
@@ -373,12 +540,12 @@ appvk::texture appvk::createTextureImage(int width, int height, const unsigned c
         VK_IMAGE_TILING_OPTIMAL,
         VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
         VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)};
+        mem::preset::gpuOnly, mem::category::texture)};
     
     transitionImageLayout(t, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
     copyBufferToImage(staging.buf, t.im, uint32_t(width), uint32_t(height));
 
-    vkFreeMemory(dev, staging.mem, nullptr);
+    memory.free(dev, staging.mem);
     vkDestroyBuffer(dev, staging.buf, nullptr);
 
     generateMipmaps(t.im, VK_FORMAT_R8G8B8A8_SRGB, width, height, mipLevels);
@@ -386,23 +553,165 @@ appvk::texture appvk::createTextureImage(int width, int height, const unsigned c
     return t;
 }
 
-void appvk::createDepthImage() {
-    depth = createImage(swapExtent.width, swapExtent.height,
-        depthFormat, 1, msaaSamples,
+// a baked texture straight from its file mapping: imported as the staging buffer where the device can read
+// host memory, otherwise copied a band of rows at a time through a small staging window. either way there's
+// no decode and no full size copy, so host memory traffic and peak use don't grow with the texture
+appvk::texture appvk::createBakedTexture(const baked::mapping& m) {
+    PROF_ZONE("createBakedTexture");
+
+    const uint32_t width = m.width();
+    const uint32_t height = m.height();
+    const unsigned int mipLevels = floor(log2(std::max(width, height))) + 1;
+
+    texture t = {createImage(width, height, VK_FORMAT_R8G8B8A8_SRGB, mipLevels, VK_SAMPLE_COUNT_1_BIT,
         VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    
-    transitionImageLayout(depth, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
-    
-    depth.view = createImageView(depth.im, depthFormat, 1, VK_IMAGE_ASPECT_DEPTH_BIT);
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        mem::preset::gpuOnly, mem::category::texture)};
+
+    transitionImageLayout(t, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+    buffer imported = importHostBuffer(m.data(), m.size());
+    if (imported.buf != VK_NULL_HANDLE) {
+        copyBufferToImage(imported.buf, t.im, width, height, m.offset()); // waits, so the import can go now
+
+        vkDestroyBuffer(dev, imported.buf, nullptr);
+        memory.free(dev, imported.mem);
+    } else {
+        if (uploadWindow.buf == VK_NULL_HANDLE) {
+            uploadWindow = createBuffer(uploadWindowSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, mem::preset::staging, mem::category::staging);
+            vkMapMemory(dev, uploadWindow.mem, 0, uploadWindowSize, 0, &uploadWindowMap);
+        }
+
+        const VkDeviceSize rowBytes = VkDeviceSize(width) * 4;
+        if (rowBytes > uploadWindowSize) {
+            throw std::runtime_error("cannot fit a row of a baked texture in the upload window!");
+        }
+        const uint32_t band = uploadWindowSize / rowBytes;
+
+        for (uint32_t row = 0; row < height; row += band) {
+            const uint32_t rows = std::min(band, height - row);
+            memcpy(uploadWindowMap, m.pixels() + row * rowBytes, rows * rowBytes);
+            copyBufferToImage(uploadWindow.buf, t.im, width, rows, 0, row); // waits, so the window can be refilled
+        }
+    }
+
+    generateMipmaps(t.im, VK_FORMAT_R8G8B8A8_SRGB, width, height, mipLevels);
+
+    return t;
+}
+
+// swapchain sized render targets and the passes that use them
+void appvk::createFrameGraph() {
+    PROF_ZONE("createFrameGraph");
+
+    rg::imageDesc color;
+    color.width = swapExtent.width;
+    color.height = swapExtent.height;
+    color.format = swapFormat;
+    color.samples = msaaSamples;
+
+    rg::imageDesc depthDesc = color;
+    depthDesc.format = depthFormat;
+    depthDesc.aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+
+    // one depth buffer shared by every frame in flight, the graph's barriers order each frame's use after the last
+    depthTarget = frameGraph.createImage("depth", depthDesc);
+
+    if (gpuCulling) {
+        cullDrawsRes = frameGraph.importBuffer("meshlet draws", cullDraws.buf);
+        cullCountsRes = frameGraph.importBuffer("meshlet counts", cullCounts.buf);
+
+        rg::handle clear = frameGraph.addPass("cull clear", [this](VkCommandBuffer cbuf, uint32_t) { recordCullClear(cbuf); });
+        frameGraph.write(clear, cullDrawsRes, rg::use::transferDst);
+        frameGraph.write(clear, cullCountsRes, rg::use::transferDst);
+
+        // survivors are appended, so the clears still matter
+        rg::handle cull = frameGraph.addPass("cull", [this](VkCommandBuffer cbuf, uint32_t) { recordCull(cbuf); });
+        frameGraph.write(cull, cullDrawsRes, rg::use::storageModifyCompute);
+        frameGraph.write(cull, cullCountsRes, rg::use::storageModifyCompute);
+    }
+
+    if (virtualTextures) {
+        vtCacheRes = frameGraph.importImage("vt cache", vtCache.im, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        vtTableRes = frameGraph.importBuffer("vt page table", vtTable.buf);
+        vtFeedbackRes = frameGraph.importBuffer("vt feedback", vtFeedback.buf);
+        vtReadbackRes = frameGraph.importBuffer("vt readback", vtReadback.buf);
+
+        rg::handle upload = frameGraph.addPass("vt upload", [this](VkCommandBuffer cbuf, uint32_t) { recordVirtualUpload(cbuf); });
+        frameGraph.write(upload, vtCacheRes, rg::use::transferDst);
+        frameGraph.write(upload, vtTableRes, rg::use::transferDst);
+    }
+
+    rg::handle scene = frameGraph.addPass("scene", [this](VkCommandBuffer cbuf, uint32_t imageIndex) { recordScene(cbuf, imageIndex); });
+    frameGraph.write(scene, depthTarget, rg::use::depthAttachment);
+    if (gpuCulling) {
+        frameGraph.read(scene, cullDrawsRes, rg::use::indirectRead);
+        frameGraph.read(scene, cullCountsRes, rg::use::indirectRead);
+    }
+    if (virtualTextures) {
+        frameGraph.read(scene, vtCacheRes, rg::use::sampledFragment);
+        frameGraph.read(scene, vtTableRes, rg::use::storageReadFragment);
+        frameGraph.write(scene, vtFeedbackRes, rg::use::storageModifyFragment);
+
+        // feedback goes out to be read a frame in flight later, and starts the next frame empty
+        rg::handle readback = frameGraph.addPass("vt readback", [this](VkCommandBuffer cbuf, uint32_t) { recordVirtualReadback(cbuf); });
+        frameGraph.read(readback, vtFeedbackRes, rg::use::transferSrc);
+        frameGraph.write(readback, vtReadbackRes, rg::use::transferDst);
+
+        rg::handle clear = frameGraph.addPass("vt clear", [this](VkCommandBuffer cbuf, uint32_t) {
+            vkCmdFillBuffer(cbuf, vtFeedback.buf, 0, VK_WHOLE_SIZE, 0);
+        });
+        frameGraph.write(clear, vtFeedbackRes, rg::use::transferDst);
+    }
+
+    if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+        msTarget = frameGraph.createImage("msaa color", color);
+        frameGraph.write(scene, msTarget, rg::use::colorAttachment);
+    }
+
+    if (!postAA()) {
+        frameGraph.present(scene);
+        frameGraph.compile();
+        return;
+    }
+
+    sceneTarget = frameGraph.createImage("scene color", color);
+    frameGraph.write(scene, sceneTarget, rg::use::colorAttachment);
+
+    rg::handle postInput = sceneTarget;
+
+    if (aa == aaMode::taa) {
+        historyCurr = frameGraph.importImage("history", history[historyIndex].im, VK_IMAGE_ASPECT_COLOR_BIT);
+        historyPrev = frameGraph.importImage("previous history", history[1 - historyIndex].im, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        rg::handle taa = frameGraph.addPass("taa", [this](VkCommandBuffer cbuf, uint32_t) { recordTaa(cbuf); });
+        frameGraph.read(taa, sceneTarget, rg::use::sampledCompute);
+        frameGraph.read(taa, depthTarget, rg::use::sampledCompute);
+        frameGraph.read(taa, historyPrev, rg::use::sampledCompute);
+        frameGraph.write(taa, historyCurr, rg::use::storageWriteCompute);
+
+        postInput = historyCurr;
+    }
+
+    rg::handle post = frameGraph.addPass("post", [this](VkCommandBuffer cbuf, uint32_t imageIndex) { recordPost(cbuf, imageIndex); });
+    frameGraph.read(post, postInput, rg::use::sampledFragment);
+    frameGraph.present(post);
+
+    frameGraph.compile();
 }
 
-void appvk::createMultisampleImage() {
-    ms = createImage(swapExtent.width, swapExtent.height, swapFormat, 1, msaaSamples, 
-    VK_IMAGE_TILING_OPTIMAL,
-    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
-    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+// render targets are the biggest thing lazily allocated memory saves on, so report it with the settings that size them
+void appvk::reportTransientMemory() {
+    constexpr double mib = 1024.0 * 1024.0;
+
+    cout << "transient attachments at " << swapExtent.width << "x" << swapExtent.height << ", " << int(msaaSamples) << "x msaa: "
+        << frameGraph.transientBytes() / mib << " MiB";
 
-    ms.view = createImageView(ms.im, swapFormat, 1, VK_IMAGE_ASPECT_COLOR_BIT);
+    if (frameGraph.lazyBytes() > 0) {
+        cout << ", " << frameGraph.lazyBytes() / mib << " MiB lazily allocated with "
+            << frameGraph.committedLazyBytes() / mib << " MiB committed\n";
+    } else {
+        cout << ", no lazily allocated memory on this device\n";
+    }
 }
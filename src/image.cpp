@@ -45,21 +45,13 @@ VkFormat appvk::findImageFormat(const std::vector<VkFormat>& formats, VkImageTil
     return VK_FORMAT_UNDEFINED;
 }
 
-// transition miplevels of image from the oldl layout to the newl layout
+// transition miplevels of image from the oldl layout to the newl layout, only used for texture uploads
+// since per-frame images get their barriers from the frame graph
 void appvk::transitionImageLayout(image im, VkImageLayout oldl, VkImageLayout newl) {
     VkCommandBuffer buf = beginSingleCommand();
 
     VkImageSubresourceRange range{};
-
-    if (newl == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-        range.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-        if (depthFormat == VK_FORMAT_D24_UNORM_S8_UINT || depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT) {
-            range.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-        }
-    } else {
-        range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    }
-
+    range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     range.levelCount = im.mipLevels;
     range.layerCount = 1;
 
@@ -87,12 +79,6 @@ void appvk::transitionImageLayout(image im, VkImageLayout oldl, VkImageLayout ne
 
         barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
         barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    } else if (oldl == VK_IMAGE_LAYOUT_UNDEFINED && newl == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-        srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        dstStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
     } else {
         throw std::invalid_argument("unsupported stage combination!");
     }
@@ -102,7 +88,7 @@ void appvk::transitionImageLayout(image im, VkImageLayout oldl, VkImageLayout ne
     endSingleCommand(buf);
 }
 
-void appvk::copyBufferToImage(VkBuffer buf, VkImage img, uint32_t width, uint32_t height) {
+void appvk::copyBufferToImage(VkBuffer buf, VkImage img, uint32_t width, uint32_t height, VkDeviceSize offset, uint32_t firstRow) {
     VkCommandBuffer cbuf = beginSingleCommand();
 
     VkImageSubresourceLayers rec{};
@@ -112,18 +98,20 @@ void appvk::copyBufferToImage(VkBuffer buf, VkImage img, uint32_t width, uint32_
     rec.layerCount = 1;
 
     VkBufferImageCopy copy{};
-    copy.bufferOffset = 0;
+    copy.bufferOffset = offset;
     copy.imageSubresource = rec;
-    copy.imageOffset = {0, 0, 0};
+    copy.imageOffset = {0, int32_t(firstRow), 0};
     copy.imageExtent = {width, height, 1};
 
+    onceProf.begin(cbuf, "upload image");
     vkCmdCopyBufferToImage(cbuf, buf, img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+    onceProf.end(cbuf);
 
     endSingleCommand(cbuf);
 }
 
 appvk::image appvk::createImage(unsigned int width, unsigned int height, VkFormat format, unsigned int mipLevels,
-    VkSampleCountFlagBits samples, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags props) {
+    VkSampleCountFlagBits samples, VkImageTiling tiling, VkImageUsageFlags usage, const mem::policy& p, mem::category cat) {
     VkImageCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     createInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -148,9 +136,9 @@ appvk::image appvk::createImage(unsigned int width, unsigned int height, VkForma
     VkMemoryAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     allocInfo.allocationSize = memReq.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memReq.memoryTypeBits, props);
+    allocInfo.memoryTypeIndex = findMemoryType(memReq.memoryTypeBits, p);
 
-    if (vkAllocateMemory(dev, &allocInfo, nullptr, &(im.mem)) != VK_SUCCESS) {
+    if (memory.allocate(dev, allocInfo, cat, &im.mem) != VK_SUCCESS) {
         throw std::runtime_error("cannot allocate texture memory!");
     }
 
@@ -216,6 +204,8 @@ void appvk::generateMipmaps(VkImage image, VkFormat format, unsigned int width,
     blit.dstSubresource.layerCount = 1;
     blit.dstOffsets[0] = {0, 0, 0};
 
+    onceProf.begin(b, "mipmaps");
+
     // turn each mip level from a dest into a source for the one below it
     for (size_t level = 1; level < levels; level++) {
         // move prev dst -> src
@@ -263,5 +253,7 @@ void appvk::generateMipmaps(VkImage image, VkFormat format, unsigned int width,
     VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
     0, 0, nullptr, 0, nullptr, 1, &mipBarrier);
 
+    onceProf.end(b);
+
     endSingleCommand(b);
 }
\ No newline at end of file
@@ -69,7 +69,7 @@ void appvk::checkChooseDevice(VkPhysicalDevice pd, manufacturer m) {
     
     if (correctm && correctf && pdev == VK_NULL_HANDLE) {
         pdev = pd;
-        msaaSamples = getSamples(options::msaaSamples);
+        msaaSamples = postAA() ? VK_SAMPLE_COUNT_1_BIT : getSamples(options::get().msaaSamples);
         cout << " (selected)";
     }
 
@@ -77,6 +77,8 @@ void appvk::checkChooseDevice(VkPhysicalDevice pd, manufacturer m) {
 }
 
 void appvk::pickPhysicalDevice(manufacturer m) {
+    PROF_ZONE("pickPhysicalDevice");
+
     uint32_t numDevices;
     vkEnumeratePhysicalDevices(instance, &numDevices, nullptr);
     if (numDevices == 0) {
@@ -92,6 +94,15 @@ void appvk::pickPhysicalDevice(manufacturer m) {
     if (pdev == VK_NULL_HANDLE) {
         throw std::runtime_error("no usable gpu found!");
     }
+
+    // virtual textures record the pages they want from the fragment shader, without that textures load whole.
+    // decided here since loadAssets comes next, and reads tile files rather than whole textures with it
+    VkPhysicalDeviceFeatures supported;
+    vkGetPhysicalDeviceFeatures(pdev, &supported);
+    virtualTextures = options::get().virtualTextures && supported.fragmentStoresAndAtomics;
+    if (options::get().virtualTextures && !virtualTextures) {
+        cout << "no fragmentStoresAndAtomics, loading textures whole\n";
+    }
 }
 
 appvk::queueIndices appvk::findQueueFamily(VkPhysicalDevice pd) {
@@ -128,6 +139,8 @@ appvk::queueIndices appvk::findQueueFamily(VkPhysicalDevice pd) {
 }
 
 void appvk::createLogicalDevice() {
+    PROF_ZONE("createLogicalDevice");
+
     queueIndices qi = findQueueFamily(pdev); // check for the proper queue
     swapChainSupportDetails d = querySwapChainSupport(pdev); // verify swap chain information before creating a new logical device
 
@@ -165,14 +178,79 @@ void appvk::createLogicalDevice() {
     feat2.features = {}; // set everything not used to zero
     feat2.features.samplerAnisotropy = VK_TRUE;
 
+    // optional, only used for profiling
+    VkPhysicalDeviceFeatures supported;
+    vkGetPhysicalDeviceFeatures(pdev, &supported);
+    pipelineStatsSupported = supported.pipelineStatisticsQuery;
+    feat2.features.pipelineStatisticsQuery = supported.pipelineStatisticsQuery;
+
+    // meshlet culling draws all of a mesh's survivors with one indirect call, and with
+    // vkCmdDrawIndexedIndirectCount (core in 1.2) reads how many there are from the gpu too
+    gpuCulling = options::get().cull && supported.multiDrawIndirect;
+    feat2.features.multiDrawIndirect = gpuCulling;
+
+    feat2.features.fragmentStoresAndAtomics = virtualTextures; // only on if supported, see pickPhysicalDevice
+
+    VkPhysicalDeviceProperties dprop;
+    vkGetPhysicalDeviceProperties(pdev, &dprop);
+
+    VkPhysicalDeviceVulkan12Features vk12{};
+    vk12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    if (gpuCulling && dprop.apiVersion >= VK_API_VERSION_1_2) {
+        VkPhysicalDeviceFeatures2 query{};
+        query.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        query.pNext = &vk12;
+        vkGetPhysicalDeviceFeatures2(pdev, &query);
+
+        drawIndirectCountSupported = vk12.drawIndirectCount;
+        vk12 = {}; // enable only that
+        vk12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        vk12.drawIndirectCount = drawIndirectCountSupported;
+        execProp.pNext = &vk12;
+    }
+
+    // also optional, budgets in the memory overlay
+    std::vector<const char*> extensions(requiredExtensions.begin(), requiredExtensions.end());
+
+    uint32_t numExtensions;
+    vkEnumerateDeviceExtensionProperties(pdev, nullptr, &numExtensions, nullptr);
+    std::vector<VkExtensionProperties> deviceExtensions(numExtensions);
+    vkEnumerateDeviceExtensionProperties(pdev, nullptr, &numExtensions, deviceExtensions.data());
+
+    memoryBudgetSupported = false;
+    hostImportSupported = false;
+    for (const auto& extension : deviceExtensions) {
+        if (strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0) {
+            memoryBudgetSupported = true;
+            extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+
+        // and baked textures imported straight from their file mappings, it needs external memory from 1.1
+        if (strcmp(extension.extensionName, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) == 0 && dprop.apiVersion >= VK_API_VERSION_1_1) {
+            VkPhysicalDeviceExternalMemoryHostPropertiesEXT hostProps{};
+            hostProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+
+            VkPhysicalDeviceProperties2 prop2{};
+            prop2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            prop2.pNext = &hostProps;
+            vkGetPhysicalDeviceProperties2(pdev, &prop2);
+
+            hostImportSupported = hostProps.minImportedHostPointerAlignment <= baked::alignment;
+            hostImportAlignment = hostProps.minImportedHostPointerAlignment;
+            if (hostImportSupported) {
+                extensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+            }
+        }
+    }
+
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     createInfo.pNext = &feat2;
     createInfo.pQueueCreateInfos = queueInfos;
     createInfo.queueCreateInfoCount = 2;
     createInfo.pEnabledFeatures = nullptr;
-    createInfo.enabledExtensionCount = requiredExtensions.size();
-    createInfo.ppEnabledExtensionNames = requiredExtensions.data();
+    createInfo.enabledExtensionCount = extensions.size();
+    createInfo.ppEnabledExtensionNames = extensions.data();
             
     if (vkCreateDevice(pdev, &createInfo, nullptr, &dev)) {
         throw std::runtime_error("cannot create virtual device!");
@@ -183,4 +261,8 @@ void appvk::createLogicalDevice() {
 
     gQueueFamily = *(qi.graphics);
     cQueueFamily = chosenComputeFamily;
+
+    memory.init(pdev, memoryBudgetSupported);
+    memory.update();
+    resizableBar = mem::hasResizableBar(pdev);
 }
@@ -0,0 +1,156 @@
+#include "jobs.hpp"
+
+#include "cpuprof.hpp"
+
+#include <algorithm>
+#include <optional>
+#include <utility>
+
+namespace job {
+    namespace {
+        // which pool and queue the calling thread works for, if any
+        thread_local const pool* owner = nullptr;
+        thread_local unsigned int ownIndex = 0;
+    }
+
+    pool::pool(unsigned int threads) {
+        if (threads == 0) {
+            threads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+
+        for (unsigned int i = 0; i < threads; i++) {
+            queues.push_back(std::make_unique<queue>());
+        }
+        for (unsigned int i = 0; i < threads; i++) {
+            workers.emplace_back(&pool::work, this, i);
+        }
+    }
+
+    pool::~pool() {
+        {
+            std::lock_guard<std::mutex> lk(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+
+        for (auto& w : workers) {
+            w.join();
+        }
+    }
+
+    void pool::submit(group& g, std::function<void()> fn) {
+        g.pending.fetch_add(1, std::memory_order_relaxed);
+
+        // counted first so it never goes negative when a thief is quick, at worst someone looks once too often
+        queued.fetch_add(1, std::memory_order_release);
+
+        const unsigned int q = owner == this ? ownIndex : next.fetch_add(1, std::memory_order_relaxed) % queues.size();
+        {
+            std::lock_guard<std::mutex> lk(queues[q]->m);
+            queues[q]->tasks.push_back({ std::move(fn), &g });
+        }
+
+        // everyone, since a waiter that wakes up to find its group done won't pass the job on
+        {
+            std::lock_guard<std::mutex> lk(sleepMutex);
+        }
+        wake.notify_all();
+    }
+
+    void pool::wait(group& g) {
+        const unsigned int home = owner == this ? ownIndex : 0;
+
+        while (!g.done()) {
+            if (tryRun(home)) {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lk(sleepMutex);
+            wake.wait(lk, [&] { return g.done() || queued.load(std::memory_order_acquire) > 0; });
+        }
+
+        std::lock_guard<std::mutex> lk(g.m);
+        if (g.error) {
+            std::rethrow_exception(std::exchange(g.error, nullptr));
+        }
+    }
+
+    void pool::rethrowIfFailed(group& g) {
+        if (!g.done()) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lk(g.m);
+        if (g.error) {
+            std::rethrow_exception(std::exchange(g.error, nullptr));
+        }
+    }
+
+    // newest job from our own queue, otherwise the oldest from the next queue that has one
+    bool pool::tryRun(unsigned int home) {
+        std::optional<task> t;
+
+        for (size_t i = 0; i < queues.size() && !t; i++) {
+            queue& q = *queues[(home + i) % queues.size()];
+            std::lock_guard<std::mutex> lk(q.m);
+            if (q.tasks.empty()) {
+                continue;
+            }
+
+            if (i == 0) {
+                t = std::move(q.tasks.back());
+                q.tasks.pop_back();
+            } else {
+                t = std::move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+        }
+
+        if (!t) {
+            return false;
+        }
+        queued.fetch_sub(1, std::memory_order_relaxed);
+
+        try {
+            t->fn();
+        } catch (...) {
+            std::lock_guard<std::mutex> lk(t->g->m);
+            if (!t->g->error) {
+                t->g->error = std::current_exception();
+            }
+        }
+
+        finish(*t->g);
+        return true;
+    }
+
+    void pool::finish(group& g) {
+        if (g.pending.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+
+        // taking the lock means a waiter is either still checking its predicate or already asleep
+        {
+            std::lock_guard<std::mutex> lk(sleepMutex);
+        }
+        wake.notify_all();
+    }
+
+    void pool::work(unsigned int index) {
+        owner = this;
+        ownIndex = index;
+        prof::cpu::nameThread("job worker");
+
+        for (;;) {
+            if (tryRun(index)) {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lk(sleepMutex);
+            wake.wait(lk, [&] { return stopping || queued.load(std::memory_order_acquire) > 0; });
+            if (stopping && queued.load(std::memory_order_acquire) == 0) {
+                return;
+            }
+        }
+    }
+}
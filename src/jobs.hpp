@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Each worker keeps its own queue, running its newest job first (it's
+// likely still in cache) and stealing the oldest from the others when it runs dry, so a pool sized
+// to the machine stays busy however many jobs are queued without adding threads.
+namespace job {
+    // jobs to wait on together, the first exception any of them throws is rethrown by pool::wait
+    class group {
+    public:
+        bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend class pool;
+        std::atomic<uint32_t> pending = 0;
+        std::mutex m;
+        std::exception_ptr error;
+    };
+
+    class pool {
+    public:
+        explicit pool(unsigned int threads = 0); // 0 is one per hardware thread
+        ~pool(); // runs whatever is still queued first
+
+        pool(const pool&) = delete;
+        pool& operator=(const pool&) = delete;
+
+        // jobs submitted from a worker go on its own queue, others are spread round robin
+        void submit(group& g, std::function<void()> fn);
+
+        // runs queued jobs while waiting, so it's safe to call from inside a job
+        void wait(group& g);
+
+        // wait() for consumers that poll for results instead: never blocks, but once every job in g has finished
+        // rethrows the first exception, since a job that threw has no result to show for it
+        void rethrowIfFailed(group& g);
+
+        unsigned int size() const { return workers.size(); }
+
+    private:
+        struct task {
+            std::function<void()> fn;
+            group* g;
+        };
+
+        struct queue {
+            std::mutex m;
+            std::deque<task> tasks;
+        };
+
+        std::vector<std::unique_ptr<queue>> queues; // one per worker
+        std::vector<std::thread> workers;
+        std::atomic<uint32_t> queued = 0;
+        std::atomic<uint32_t> next = 0;
+
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+        bool stopping = false;
+
+        bool tryRun(unsigned int home);
+        void finish(group& g);
+        void work(unsigned int index);
+    };
+
+    // results handed from jobs to one consumer in the order they were pushed. lock-free: a push is one
+    // compare-exchange onto a list and a take swaps the whole list out, so nodes are never popped one
+    // at a time and there's no ABA to worry about
+    template <typename T>
+    class mailbox {
+    public:
+        mailbox() = default;
+        ~mailbox() { take(); }
+
+        mailbox(const mailbox&) = delete;
+        mailbox& operator=(const mailbox&) = delete;
+
+        // any thread
+        void push(T value) {
+            node* n = new node{ std::move(value), head.load(std::memory_order_relaxed) };
+            while (!head.compare_exchange_weak(n->next, n, std::memory_order_release, std::memory_order_relaxed)) {
+            }
+        }
+
+        // the consumer only, everything pushed so far, oldest first
+        std::vector<T> take() {
+            std::vector<T> out;
+            for (node* n = head.exchange(nullptr, std::memory_order_acquire); n != nullptr;) {
+                out.push_back(std::move(n->value));
+                node* next = n->next;
+                delete n;
+                n = next;
+            }
+            std::reverse(out.begin(), out.end()); // the list is newest first
+            return out;
+        }
+
+        bool empty() const { return head.load(std::memory_order_acquire) == nullptr; }
+
+    private:
+        struct node {
+            T value;
+            node* next;
+        };
+        std::atomic<node*> head = nullptr;
+    };
+}
@@ -0,0 +1,192 @@
+#include "json.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace json {
+    namespace {
+        const value nullValue;
+
+        class parser {
+        public:
+            explicit parser(std::string_view text) : text(text) {}
+
+            value parseDocument() {
+                value v = parseValue();
+                skipSpace();
+                if (pos != text.size()) {
+                    fail("trailing characters");
+                }
+                return v;
+            }
+
+        private:
+            std::string_view text;
+            size_t pos = 0;
+
+            [[noreturn]] void fail(const char* what) {
+                throw std::runtime_error(std::string("json parse error at offset ") + std::to_string(pos) + ": " + what + "!");
+            }
+
+            void skipSpace() {
+                while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+                    pos++;
+                }
+            }
+
+            bool consume(char c) {
+                skipSpace();
+                if (pos < text.size() && text[pos] == c) {
+                    pos++;
+                    return true;
+                }
+                return false;
+            }
+
+            void expect(char c) {
+                if (!consume(c)) {
+                    fail("unexpected character");
+                }
+            }
+
+            bool literal(std::string_view word) {
+                if (text.substr(pos, word.size()) == word) {
+                    pos += word.size();
+                    return true;
+                }
+                return false;
+            }
+
+            value parseValue() {
+                skipSpace();
+                if (pos >= text.size()) {
+                    fail("unexpected end of input");
+                }
+
+                value v;
+                const char c = text[pos];
+
+                if (c == '{') {
+                    pos++;
+                    v.type = value::object;
+                    if (consume('}')) {
+                        return v;
+                    }
+                    do {
+                        skipSpace();
+                        std::string key = parseString();
+                        expect(':');
+                        v.obj.emplace_back(std::move(key), parseValue());
+                    } while (consume(','));
+                    expect('}');
+                } else if (c == '[') {
+                    pos++;
+                    v.type = value::array;
+                    if (consume(']')) {
+                        return v;
+                    }
+                    do {
+                        v.arr.push_back(parseValue());
+                    } while (consume(','));
+                    expect(']');
+                } else if (c == '"') {
+                    v.type = value::string;
+                    v.s = parseString();
+                } else if (literal("true")) {
+                    v.type = value::boolean;
+                    v.b = true;
+                } else if (literal("false")) {
+                    v.type = value::boolean;
+                } else if (literal("null")) {
+                    v.type = value::null;
+                } else {
+                    const std::string num(text.substr(pos, 32));
+                    char* end = nullptr;
+                    v.n = std::strtod(num.c_str(), &end);
+                    if (end == num.c_str()) {
+                        fail("invalid value");
+                    }
+                    v.type = value::number;
+                    pos += end - num.c_str();
+                }
+
+                return v;
+            }
+
+            // escapes other than \uXXXX are handled, which is all we ever write
+            std::string parseString() {
+                if (pos >= text.size() || text[pos] != '"') {
+                    fail("expected string");
+                }
+                pos++;
+
+                std::string s;
+                while (pos < text.size() && text[pos] != '"') {
+                    char c = text[pos++];
+                    if (c == '\\' && pos < text.size()) {
+                        c = text[pos++];
+                        switch (c) {
+                            case 'n': c = '\n'; break;
+                            case 't': c = '\t'; break;
+                            case 'r': c = '\r'; break;
+                            case 'b': c = '\b'; break;
+                            case 'f': c = '\f'; break;
+                            default: break;
+                        }
+                    }
+                    s += c;
+                }
+
+                if (pos >= text.size()) {
+                    fail("unterminated string");
+                }
+                pos++;
+
+                return s;
+            }
+        };
+    }
+
+    const value& value::operator[](std::string_view key) const {
+        if (type == object) {
+            for (const auto& [k, v] : obj) {
+                if (k == key) {
+                    return v;
+                }
+            }
+        }
+        return nullValue;
+    }
+
+    value parse(std::string_view text) {
+        return parser(text).parseDocument();
+    }
+
+    value parseFile(std::string_view file) {
+        std::ifstream in(file.data());
+        if (!in) {
+            throw std::runtime_error(std::string("cannot open ") + file.data() + "!");
+        }
+
+        std::stringstream ss;
+        ss << in.rdbuf();
+        return parse(ss.str());
+    }
+
+    void quote(std::ostream& out, std::string_view s) {
+        out << '"';
+        for (char c : s) {
+            switch (c) {
+                case '"': out << "\\\""; break;
+                case '\\': out << "\\\\"; break;
+                case '\n': out << "\\n"; break;
+                case '\t': out << "\\t"; break;
+                case '\r': out << "\\r"; break;
+                default: out << c; break;
+            }
+        }
+        out << '"';
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Minimal json reader for the few files we read back in (shader stat baselines, config).
+namespace json {
+    struct value {
+        enum kind { null, boolean, number, string, array, object };
+
+        kind type = null;
+        bool b = false;
+        double n = 0.0;
+        std::string s;
+        std::vector<value> arr;
+        std::vector<std::pair<std::string, value>> obj; // in file order
+
+        // returns a null value if this isn't an object or key isn't present
+        const value& operator[](std::string_view key) const;
+
+        double num(double fallback = 0.0) const { return type == number ? n : fallback; }
+        const std::string& str() const { return s; }
+    };
+
+    value parse(std::string_view text);
+    value parseFile(std::string_view file);
+
+    // write s as a quoted, escaped json string
+    void quote(std::ostream& out, std::string_view s);
+}
@@ -0,0 +1,284 @@
+#include "lod.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace lod {
+    namespace {
+        struct vec3 {
+            double x, y, z;
+        };
+
+        vec3 sub(vec3 a, vec3 b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+        double dot(vec3 a, vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+        vec3 cross(vec3 a, vec3 b) {
+            return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+        }
+
+        vec3 position(const float* positions, size_t stride, uint32_t v) {
+            const float* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + stride * v);
+            return { p[0], p[1], p[2] };
+        }
+
+        // sum of squared distances to a set of planes, weighted by triangle area
+        struct quadric {
+            double a2 = 0, ab = 0, ac = 0, ad = 0;
+            double b2 = 0, bc = 0, bd = 0;
+            double c2 = 0, cd = 0;
+            double d2 = 0;
+            double weight = 0;
+
+            void addPlane(vec3 n, double d, double w) {
+                a2 += w * n.x * n.x; ab += w * n.x * n.y; ac += w * n.x * n.z; ad += w * n.x * d;
+                b2 += w * n.y * n.y; bc += w * n.y * n.z; bd += w * n.y * d;
+                c2 += w * n.z * n.z; cd += w * n.z * d;
+                d2 += w * d * d;
+                weight += w;
+            }
+
+            quadric& operator+=(const quadric& q) {
+                a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+                b2 += q.b2; bc += q.bc; bd += q.bd;
+                c2 += q.c2; cd += q.cd;
+                d2 += q.d2;
+                weight += q.weight;
+                return *this;
+            }
+
+            // mean squared distance, so the error comes out in position units whatever the triangle sizes
+            double eval(vec3 p) const {
+                const double e = a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z + 2 * ad * p.x
+                    + b2 * p.y * p.y + 2 * bc * p.y * p.z + 2 * bd * p.y
+                    + c2 * p.z * p.z + 2 * cd * p.z
+                    + d2;
+                return weight > 0 ? std::max(e, 0.0) / weight : 0.0;
+            }
+        };
+
+        struct collapse {
+            uint32_t from;
+            uint32_t to;
+            double cost;
+        };
+
+        uint64_t edgeKey(uint32_t a, uint32_t b) {
+            return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+        }
+
+        struct positionHash {
+            size_t operator()(const vec3& p) const {
+                float f[3] = { float(p.x), float(p.y), float(p.z) };
+                uint32_t h[3];
+                std::memcpy(h, f, sizeof(h));
+                return (h[0] * 73856093u) ^ (h[1] * 19349663u) ^ (h[2] * 83492791u);
+            }
+        };
+
+        struct positionEqual {
+            bool operator()(const vec3& a, const vec3& b) const {
+                return a.x == b.x && a.y == b.y && a.z == b.z;
+            }
+        };
+    }
+
+    std::vector<uint32_t> simplify(const std::vector<uint32_t>& input, size_t vertexCount,
+        const float* positions, size_t stride, size_t targetIndexCount, float& error) {
+        std::vector<uint32_t> indices = input;
+        error = 0.0f;
+
+        std::vector<vec3> pos(vertexCount);
+        for (uint32_t v = 0; v < vertexCount; v++) {
+            pos[v] = position(positions, stride, v);
+        }
+
+        // vertices split for their attributes (uv seams, hard normals) can't move without tearing
+        std::vector<bool> locked(vertexCount, false);
+        std::vector<uint32_t> canonical(vertexCount);
+        {
+            std::unordered_map<vec3, uint32_t, positionHash, positionEqual> first;
+            for (uint32_t v = 0; v < vertexCount; v++) {
+                auto [it, inserted] = first.emplace(pos[v], v);
+                canonical[v] = it->second;
+                if (!inserted) {
+                    locked[v] = true;
+                    locked[it->second] = true;
+                }
+            }
+        }
+
+        // neither can open borders, edges with a single triangle once seams are welded
+        {
+            std::unordered_map<uint64_t, uint32_t> edgeUses;
+            for (size_t i = 0; i < indices.size(); i += 3) {
+                for (int e = 0; e < 3; e++) {
+                    edgeUses[edgeKey(canonical[indices[i + e]], canonical[indices[i + (e + 1) % 3]])]++;
+                }
+            }
+            for (size_t i = 0; i < indices.size(); i += 3) {
+                for (int e = 0; e < 3; e++) {
+                    const uint32_t a = indices[i + e];
+                    const uint32_t b = indices[i + (e + 1) % 3];
+                    if (edgeUses[edgeKey(canonical[a], canonical[b])] == 1) {
+                        locked[a] = true;
+                        locked[b] = true;
+                    }
+                }
+            }
+        }
+
+        std::vector<quadric> quadrics(vertexCount);
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            const vec3 p0 = pos[indices[i]];
+            vec3 n = cross(sub(pos[indices[i + 1]], p0), sub(pos[indices[i + 2]], p0));
+            const double len = std::sqrt(dot(n, n));
+            if (len == 0.0) {
+                continue;
+            }
+            n = { n.x / len, n.y / len, n.z / len };
+
+            const double area = 0.5 * len;
+            for (int c = 0; c < 3; c++) {
+                quadrics[indices[i + c]].addPlane(n, -dot(n, p0), area);
+            }
+        }
+
+        std::vector<uint32_t> remap(vertexCount);
+        std::vector<bool> touched(vertexCount);
+        std::vector<uint32_t> triStart(vertexCount + 1);
+        std::vector<uint32_t> triList;
+        std::vector<collapse> candidates;
+        std::vector<uint64_t> edges;
+
+        while (indices.size() > targetIndexCount) {
+            const size_t triangles = indices.size() / 3;
+
+            // triangles around each vertex
+            std::fill(triStart.begin(), triStart.end(), 0);
+            for (uint32_t v : indices) {
+                triStart[v + 1]++;
+            }
+            for (size_t v = 0; v < vertexCount; v++) {
+                triStart[v + 1] += triStart[v];
+            }
+            triList.resize(indices.size());
+            {
+                std::vector<uint32_t> fill(triStart.begin(), triStart.end() - 1);
+                for (size_t i = 0; i < indices.size(); i++) {
+                    triList[fill[indices[i]]++] = i / 3;
+                }
+            }
+
+            edges.clear();
+            for (size_t i = 0; i < indices.size(); i += 3) {
+                for (int e = 0; e < 3; e++) {
+                    edges.push_back(edgeKey(indices[i + e], indices[i + (e + 1) % 3]));
+                }
+            }
+            std::sort(edges.begin(), edges.end());
+            edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+            // each edge collapses whichever way is cheaper, onto the vertex that stays
+            candidates.clear();
+            for (uint64_t e : edges) {
+                const uint32_t a = e >> 32;
+                const uint32_t b = uint32_t(e);
+                quadric q = quadrics[a];
+                q += quadrics[b];
+
+                const double toB = locked[a] ? INFINITY : q.eval(pos[b]);
+                const double toA = locked[b] ? INFINITY : q.eval(pos[a]);
+                if (std::isinf(toA) && std::isinf(toB)) {
+                    continue;
+                }
+                candidates.push_back(toB <= toA ? collapse{ a, b, toB } : collapse{ b, a, toA });
+            }
+            std::sort(candidates.begin(), candidates.end(), [](const collapse& l, const collapse& r) { return l.cost < r.cost; });
+
+            for (size_t v = 0; v < vertexCount; v++) {
+                remap[v] = v;
+            }
+            std::fill(touched.begin(), touched.end(), false);
+
+            const size_t toRemove = triangles - targetIndexCount / 3;
+            size_t removed = 0;
+
+            for (const collapse& c : candidates) {
+                if (touched[c.from] || touched[c.to]) {
+                    continue;
+                }
+
+                // moving from onto to mustn't turn any of from's other triangles over
+                bool flips = false;
+                size_t shared = 0;
+                for (uint32_t k = triStart[c.from]; k < triStart[c.from + 1] && !flips; k++) {
+                    const uint32_t* tri = &indices[triList[k] * 3];
+                    if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+                        shared++;
+                        continue;
+                    }
+
+                    vec3 before[3], after[3];
+                    for (int i = 0; i < 3; i++) {
+                        before[i] = pos[tri[i]];
+                        after[i] = tri[i] == c.from ? pos[c.to] : pos[tri[i]];
+                    }
+                    const vec3 n0 = cross(sub(before[1], before[0]), sub(before[2], before[0]));
+                    const vec3 n1 = cross(sub(after[1], after[0]), sub(after[2], after[0]));
+                    flips = dot(n0, n1) <= 0.0;
+                }
+                if (flips) {
+                    continue;
+                }
+
+                // everything around the collapse is settled for this pass, so later flip tests see final positions
+                for (uint32_t k = triStart[c.from]; k < triStart[c.from + 1]; k++) {
+                    const uint32_t* tri = &indices[triList[k] * 3];
+                    touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+                }
+
+                remap[c.from] = c.to;
+                quadrics[c.to] += quadrics[c.from];
+                error = std::max(error, float(std::sqrt(c.cost)));
+
+                removed += shared;
+                if (removed >= toRemove) {
+                    break;
+                }
+            }
+
+            if (removed == 0) {
+                break; // nothing left that can go
+            }
+
+            size_t out = 0;
+            for (size_t i = 0; i < indices.size(); i += 3) {
+                const uint32_t a = remap[indices[i]];
+                const uint32_t b = remap[indices[i + 1]];
+                const uint32_t c = remap[indices[i + 2]];
+                if (a != b && b != c && a != c) {
+                    indices[out++] = a;
+                    indices[out++] = b;
+                    indices[out++] = c;
+                }
+            }
+            indices.resize(out);
+        }
+
+        return indices;
+    }
+
+    uint32_t select(const std::vector<float>& errors, float pixelsPerUnit, float threshold, uint32_t current, float hysteresis) {
+        uint32_t level = 0;
+        for (uint32_t i = 1; i < errors.size(); i++) {
+            const float limit = i > current ? threshold * (1.0f - hysteresis) : threshold;
+            if (errors[i] * pixelsPerUnit > limit) {
+                break; // errors only grow with the level
+            }
+            level = i;
+        }
+        return level;
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Levels of detail: simplified copies of a mesh made at load time by quadric edge collapse
+// (Garland and Heckbert 1997), and picking one per object per frame from its projected error.
+namespace lod {
+    // collapse edges cheapest first until at most targetIndexCount indices are left or nothing more can go.
+    // vertices only ever collapse onto other vertices, so the result indexes the same vertex list.
+    // seams (vertices sharing a position) and open borders stay put, so neither cracks.
+    // error is set to the worst collapse, roughly the distance moved in position units.
+    std::vector<uint32_t> simplify(const std::vector<uint32_t>& indices, size_t vertexCount,
+        const float* positions, size_t stride, size_t targetIndexCount, float& error);
+
+    // the coarsest level whose error, in pixels, stays under threshold. errors are per level, finest first,
+    // and pixelsPerUnit is how many pixels an object space unit covers at the object's distance.
+    // a level only gets coarser once its error is under threshold * (1 - hysteresis), so objects
+    // sitting on a boundary don't pop back and forth every frame
+    uint32_t select(const std::vector<float>& errors, float pixelsPerUnit, float threshold, uint32_t current, float hysteresis = 0.25f);
+}
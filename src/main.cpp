@@ -1,9 +1,10 @@
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
 #include "main.hpp"
 #include "extensions.hpp"
 
-#include "vloader.hpp"
-#include "iloader.hpp"
-
 #include "options.hpp"
 
 // config location from inside imgui folder
@@ -13,7 +14,10 @@
 #include "imgui_impl_vulkan.h"
 
 void appvk::recreateSwapChain() {
+	PROF_ZONE("recreateSwapChain");
+
 	vkDeviceWaitIdle(dev);
+	deletions.flush(); // idle, so none of it is in use
 
 	int width, height;
 	glfwGetFramebufferSize(w, &width, &height);
@@ -27,11 +31,28 @@ void appvk::recreateSwapChain() {
 	createSwapChain();
 	createSwapViews();
 
-	createRenderPass();
-	createGraphicsPipeline();
+	// pipelines only depend on the render pass, which only changes if the surface format does
+	if (swapFormat != renderPassFormat) {
+		VkRenderPass oldPass = renderPass;
+		createRenderPass();
+		pipelines.rebuild(oldPass, renderPass);
+		vkDestroyRenderPass(dev, oldPass, nullptr);
+
+		if (postAA()) {
+			oldPass = postPass;
+			createPostPass();
+			pipelines.rebuild(oldPass, postPass);
+			vkDestroyRenderPass(dev, oldPass, nullptr);
+		}
+	}
 
-	createDepthImage();
-	createMultisampleImage();
+	if (postAA()) {
+		createPostImages();
+	}
+	createFrameGraph();
+	if (postAA()) {
+		createPostDescriptors();
+	}
 	createFramebuffers();
 	createUniformBuffers();
 
@@ -40,16 +61,16 @@ void appvk::recreateSwapChain() {
 	for (thing& t : things) {
 		allocDescriptorSets(dPool, t);
 		allocDescriptorSetUniform(t);
+		if (virtualTextures) {
+			allocDescriptorSetVirtual(t);
+		} else {
+			for (size_t i = 0; i < t.maps.size(); i++) {
+				allocDescriptorSetTexture(t, t.maps[i], i);
+			}
+		}
+		t.staleSets.assign(swapImages.size(), false);
 	}
 
-	allocDescriptorSetTexture(t, t.diff, 0);
-	allocDescriptorSetTexture(t, t.norm, 1);
-	allocDescriptorSetTexture(t, t.disp, 2);
-
-	allocDescriptorSetTexture(flr, flr.diff, 0);
-	allocDescriptorSetTexture(flr, flr.norm, 1);
-	allocDescriptorSetTexture(flr, flr.disp, 2);
-
 	allocRenderCmdBuffers();
 
 	createSyncs();
@@ -58,7 +79,13 @@ void appvk::recreateSwapChain() {
 	initVulkanUI();
 }
 
-appvk::appvk() : basevk(false), c(0.0f, 0.0f, -3.0f) {
+appvk::appvk() : basevk(options::get().fullscreen), c(0.0f, 0.0f, -3.0f) {
+	PROF_ZONE("appvk::appvk");
+
+	captureShaderStats = !options::get().shaderStats.empty() || !options::get().shaderBaseline.empty();
+
+	const std::string& aaName = options::get().aa;
+	aa = aaName == "fxaa" ? aaMode::fxaa : aaName == "taa" ? aaMode::taa : aaMode::msaa;
 
 	IMGUI_CHECKVERSION(); // make sure imgui is set up properly
 	ImGui::CreateContext();
@@ -70,31 +97,30 @@ appvk::appvk() : basevk(false), c(0.0f, 0.0f, -3.0f) {
 	// disable and center cursor
 	// glfwSetInputMode(w, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-	constexpr std::string_view objstr = "models/sphere.obj";
-	vload::vloader obj(objstr, true, true, true);
-	obj.dispatch();
-
-	constexpr std::string_view fstr = "models/cube.obj";
-	vload::vloader f(fstr, true, true, true);
-	f.dispatch();
-
-	std::array<iload::iloader, 6> loaders = {
-		iload::iloader("textures/grass/diffuse.jpg", false),
-		iload::iloader("textures/grass/normal.jpg", false),
-		iload::iloader("textures/grass/height.jpg", false),
+	createSurface();
+	pickPhysicalDevice(any); // which also decides whether textures are virtual, so before loadAssets
 
-		iload::iloader("textures/grass2/diffuse.jpg", false),
-		iload::iloader("textures/grass2/normal.jpg", false),
-		iload::iloader("textures/grass2/height.jpg", false),
-	};
+	// assets stream in from here on, nothing below waits for them
+	loadAssets();
 
-	for (auto& ld : loaders) {
-		ld.dispatch();
+	// the loaders hold on to this, so a failure can't unwind it until they're done
+	try {
+		initVulkan();
+	} catch (...) {
+		abandonAssets();
+		throw;
 	}
+}
+
+void appvk::initVulkan() {
+	PROF_ZONE("initVulkan");
 
-	createSurface();
-	pickPhysicalDevice(any);
 	createLogicalDevice();
+	createProfilers();
+
+	deletions.init(dev, options::get().framesInFlight);
+	pipelines.init(dev, deletions, std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u));
+	frameGraph.init(dev, pdev, &memory);
 
 	createComputeBuffers();
 	createComputeDescriptors();
@@ -109,9 +135,23 @@ appvk::appvk() : basevk(false), c(0.0f, 0.0f, -3.0f) {
 	createDescriptorSetLayout();
 	createGraphicsPipeline();
 
+	if (postAA()) {
+		createPostPass();
+		createPostPipelines();
+	}
+
 	createCommandPool();
-	createDepthImage();
-	createMultisampleImage();
+	createGeometryArena();
+	createCulling();
+	createPlaceholders();
+	createVirtualTextures();
+	if (postAA()) {
+		createPostImages();
+	}
+	createFrameGraph();
+	if (postAA()) {
+		createPostDescriptors();
+	}
 	createFramebuffers();
 
 	createUniformBuffers();
@@ -120,42 +160,121 @@ appvk::appvk() : basevk(false), c(0.0f, 0.0f, -3.0f) {
 	for (thing& t : things) {
 		allocDescriptorSets(dPool, t);
 		allocDescriptorSetUniform(t);
+		if (virtualTextures) {
+			allocDescriptorSetVirtual(t);
+		} else {
+			for (size_t i = 0; i < t.maps.size(); i++) {
+				allocDescriptorSetTexture(t, t.maps[i], i);
+			}
+		}
+		t.staleSets.assign(swapImages.size(), false);
+	}
+
+	allocRenderCmdBuffers();
+
+	createSyncs();
+
+	initVulkanUI();
+
+	// the other pipelines fall back to this one until they're ready
+	pipelines.waitFor(t.pipe);
+	if (postAA()) {
+		pipelines.waitFor(postPipe); // the object pipeline can't stand in for it
+	}
+
+	if (captureShaderStats) {
+		pipelines.waitAll();
+		for (thing& t : things) {
+			collectShaderStats(pipelines.get(t.pipe), pipelines.name(t.pipe));
+		}
+		if (postAA()) {
+			collectShaderStats(pipelines.get(postPipe), pipelines.name(postPipe));
+		}
+		reportShaderStats();
 	}
+}
+
+// the scene's render pass, barriers on its targets come from the frame graph
+void appvk::recordScene(VkCommandBuffer cbuf, uint32_t imageIndex) {
+	VkRenderPassBeginInfo rBeginInfo{};
+	rBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	rBeginInfo.renderPass = renderPass;
+	rBeginInfo.framebuffer = postAA() ? sceneFramebuffer : swapFramebuffers[imageIndex];
+	rBeginInfo.renderArea.offset = { 0, 0 };
+	rBeginInfo.renderArea.extent = swapExtent;
 
-	obj.join();
+	std::array<VkClearValue, 2> attachClearValues;
+	attachClearValues[0].color = { { 0.15, 0.15, 0.15, 1.0 } };
+	attachClearValues[1].depthStencil = {1.0, 0};
+	
+	rBeginInfo.clearValueCount = attachClearValues.size();
+	rBeginInfo.pClearValues = attachClearValues.data();
+	
+	frameProf.begin(cbuf, "scene");
 
-	t.vert = createVertexBuffer(obj.meshList[0].verts);
-	t.index = createIndexBuffer(obj.meshList[0].indices);
-	cout << "loaded model " << objstr << "\n";
-	t.indices = obj.meshList[0].indices.size();
+	// commands here respect submission order, but draw command pipeline stages can go out of order
+	vkCmdBeginRenderPass(cbuf, &rBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-	f.join();
-	flr.vert = createVertexBuffer(f.meshList[0].verts);
-	flr.index = createIndexBuffer(f.meshList[0].indices);
-	cout << "loaded model " << fstr << "\n\n";
-	flr.indices = f.meshList[0].indices.size();
+		VkViewport viewport{};
+		viewport.x = 0.0f;
+		viewport.y = swapExtent.height;
+		viewport.width = swapExtent.width;
+		// Vulkan says -Y is up, not down, flip so we're compatible with OpenGL code and obj models
+		viewport.height = -1.0f * swapExtent.height;
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		vkCmdSetViewport(cbuf, 0, 1, &viewport);
 
-	for (size_t i = 0; i < loaders.size(); i++) {
-		loaders[i].join();
+		VkRect2D scissor{};
+		scissor.offset = { 0, 0 };
+		scissor.extent = swapExtent;
+		vkCmdSetScissor(cbuf, 0, 1, &scissor);
 
-		size_t thing_idx = i / 3;
-		thing& t = things[thing_idx];
+		frameProf.begin(cbuf, "objects");
+		passStats.begin(cbuf, "objects");
 
-		size_t map_idx = i % 3;
-		t.maps[map_idx] = createTextureImage(loaders[i].width, loaders[i].height, loaders[i].data);
-		t.maps[map_idx].view = createImageView(t.maps[map_idx].im, VK_FORMAT_R8G8B8A8_SRGB, t.maps[map_idx].mipLevels, VK_IMAGE_ASPECT_COLOR_BIT);
-		t.maps[map_idx].samp = createSampler(t.maps[map_idx].mipLevels);
+		bindGeometryArena(cbuf); // every mesh lives here, so this is the only bind
 
-		cout << "loaded texture " << loaders[i].path << "\n";
+		vkCmdBindPipeline(cbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.get(t.pipe));
+		vkCmdBindDescriptorSets(cbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, t.pipeLayout, 0, 1, &t.dsets[imageIndex], 0, nullptr);
+		vkCmdPushConstants(cbuf, t.pipeLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::vec3), &c.pos);
+		if (virtualTextures) {
+			const virtualPush vp = { t.virtualMaps, uint32_t(frameNumber) };
+			vkCmdPushConstants(cbuf, t.pipeLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 16, sizeof(vp), &vp);
+		}
+		if (gpuCulling) {
+			drawCulled(cbuf, t.drawn(), 0);
+		} else {
+			drawMesh(cbuf, t.drawn());
+		}
 
-		allocDescriptorSetTexture(t, t.maps[map_idx], thing_idx);
-	}
+		vkCmdBindPipeline(cbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.get(flr.pipe));
+		vkCmdBindDescriptorSets(cbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, flr.pipeLayout, 0, 1, &flr.dsets[imageIndex], 0, nullptr);
+		if (virtualTextures) {
+			const virtualPush vp = { flr.virtualMaps, uint32_t(frameNumber) };
+			vkCmdPushConstants(cbuf, flr.pipeLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 16, sizeof(vp), &vp);
+		}
+		if (gpuCulling) {
+			drawCulled(cbuf, flr.drawn(), 1);
+		} else {
+			drawMesh(cbuf, flr.drawn());
+		}
 
-	allocRenderCmdBuffers();
+		passStats.end(cbuf);
+		frameProf.end(cbuf);
 
-	createSyncs();
+		// with post aa the ui goes on after the filter, so it isn't blurred
+		if (!postAA()) {
+			frameProf.begin(cbuf, "ui");
+			passStats.begin(cbuf, "ui");
+			ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cbuf);
+			passStats.end(cbuf);
+			frameProf.end(cbuf);
+		}
 
-	initVulkanUI();
+	vkCmdEndRenderPass(cbuf);
+
+	frameProf.end(cbuf); // scene
 }
 
 void appvk::drawFrame() {
@@ -163,11 +282,33 @@ void appvk::drawFrame() {
 	// NOTE: acquiring an image, writing to it, and presenting it are all async operations.
 	// The relevant vulkan calls return before the operation completes.
 
+	using namespace std::chrono;
+	auto waitStart = steady_clock::now();
+
 	// wait for a command buffer to finish writing to the current image
-	vkWaitForFences(dev, 1, &inFlightFences[currFrame], VK_FALSE, UINT64_MAX);
+	{
+		PROF_ZONE("wait for frame fence");
+		vkWaitForFences(dev, 1, &inFlightFences[currFrame], VK_FALSE, UINT64_MAX);
+	}
+	fenceWaitMs = duration<float, std::milli>(steady_clock::now() - waitStart).count();
+
+	// results for the last frame that used this slot are ready now
+	frameProf.collect(currFrame);
+	passStats.collect(currFrame);
+	gpuFrameMs = frameProf.ms("frame");
+
+	// swap in pipelines that finished compiling, and free the ones they replaced once they're out of flight
+	pipelines.update(frameNumber);
+	deletions.collect(frameNumber);
 
 	uint32_t nextFrame;
-	VkResult r = vkAcquireNextImageKHR(dev, swap, UINT64_MAX, imageAvailSems[currFrame], VK_NULL_HANDLE, &nextFrame);
+	VkResult r;
+	{
+		PROF_ZONE("acquire");
+		const auto acquireStart = steady_clock::now();
+		r = vkAcquireNextImageKHR(dev, swap, UINT64_MAX, imageAvailSems[currFrame], VK_NULL_HANDLE, &nextFrame);
+		acquireMs = duration<float, std::milli>(steady_clock::now() - acquireStart).count();
+	}
 	// NOTE: currFrame may not always be equal to nextFrame (there's no guarantee that nextFrame increases linearly)
 
 	if (r == VK_ERROR_OUT_OF_DATE_KHR || resizeOccurred) {
@@ -180,13 +321,23 @@ void appvk::drawFrame() {
 
 	// wait for the previous frame to finish using the swapchain image at nextFrame
 	if (imagesInFlight[nextFrame] != VK_NULL_HANDLE) {
+		PROF_ZONE("wait for image fence");
+		waitStart = steady_clock::now();
 		vkWaitForFences(dev, 1, &imagesInFlight[nextFrame], VK_FALSE, UINT64_MAX);
+		fenceWaitMs += duration<float, std::milli>(steady_clock::now() - waitStart).count();
 	}
 
 	imagesInFlight[nextFrame] = inFlightFences[currFrame]; // this frame is using the fence at currFrame
 
+	// assets that finished loading go in, and this image's sets are free to point at them now
+	integrateAssets();
+	refreshTextureSets(nextFrame);
+	updateVirtualTextures();
+
 	updateFrame(nextFrame);
 
+	prof::cpu::zone recordZone("record");
+
 	VkCommandBufferBeginInfo beginInfo{};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
@@ -194,48 +345,29 @@ void appvk::drawFrame() {
 		throw std::runtime_error("cannot begin recording command buffer!");
 	}
 
-	VkRenderPassBeginInfo rBeginInfo{};
-	rBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	rBeginInfo.renderPass = renderPass;
-	rBeginInfo.framebuffer = swapFramebuffers[nextFrame];
-	rBeginInfo.renderArea.offset = { 0, 0 };
-	rBeginInfo.renderArea.extent = swapExtent;
-
-	std::array<VkClearValue, 2> attachClearValues;
-	attachClearValues[0].color = { { 0.15, 0.15, 0.15, 1.0 } };
-	attachClearValues[1].depthStencil = {1.0, 0};
-	
-	rBeginInfo.clearValueCount = attachClearValues.size();
-	rBeginInfo.pClearValues = attachClearValues.data();
-
 	auto& cbuf = commandBuffers[nextFrame];
-	
-	// commands here respect submission order, but draw command pipeline stages can go out of order
-	vkCmdBeginRenderPass(cbuf, &rBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-	
-		VkDeviceSize offset[] = { 0 };
 
-		vkCmdBindPipeline(cbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, t.pipe);
-		vkCmdBindVertexBuffers(cbuf, 0, 1, &t.vert.buf, offset);
-		vkCmdBindIndexBuffer(cbuf, t.index.buf, 0, VK_INDEX_TYPE_UINT32);
-		vkCmdBindDescriptorSets(cbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, t.pipeLayout, 0, 1, &t.dsets[nextFrame], 0, nullptr);
-		vkCmdPushConstants(cbuf, t.pipeLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::vec3), &c.pos);
-		vkCmdDrawIndexed(cbuf, t.indices, 1, 0, 0, 0);
+	frameProf.beginFrame(cbuf, currFrame);
+	passStats.beginFrame(cbuf, currFrame);
+	frameProf.begin(cbuf, "frame");
 
-		vkCmdBindPipeline(cbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, flr.pipe);
-		vkCmdBindVertexBuffers(cbuf, 0, 1, &flr.vert.buf, offset);
-		vkCmdBindIndexBuffer(cbuf, flr.index.buf, 0, VK_INDEX_TYPE_UINT32);
-		vkCmdBindDescriptorSets(cbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, flr.pipeLayout, 0, 1, &flr.dsets[nextFrame], 0, nullptr);
-		vkCmdDrawIndexed(cbuf, flr.indices, 1, 0, 0, 0);
+	frameGraph.execute(cbuf, nextFrame);
 
-		ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cbuf);
+	if (aa == aaMode::taa) {
+		// this frame's history is what the next one reprojects
+		historyIndex = 1 - historyIndex;
+		historyValid = true;
+		frameGraph.swapImports(historyCurr, historyPrev);
+	}
 
-	vkCmdEndRenderPass(cbuf);
+	frameProf.end(cbuf); // frame
 	
 	if (vkEndCommandBuffer(commandBuffers[nextFrame]) != VK_SUCCESS) {
 		throw std::runtime_error("cannot record into command buffer!");
 	}
 
+	recordZone.end();
+
 	VkSubmitInfo si{};
 	si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
@@ -253,8 +385,11 @@ void appvk::drawFrame() {
 	si.signalSemaphoreCount = 1;
 	si.pSignalSemaphores = &renderDoneSems[currFrame];
 
-	vkResetFences(dev, 1, &inFlightFences[currFrame]); // has to be unsignaled for vkQueueSubmit
-	vkQueueSubmit(gQueue, 1, &si, inFlightFences[currFrame]);
+	{
+		PROF_ZONE("submit");
+		vkResetFences(dev, 1, &inFlightFences[currFrame]); // has to be unsignaled for vkQueueSubmit
+		vkQueueSubmit(gQueue, 1, &si, inFlightFences[currFrame]);
+	}
 
 	VkPresentInfoKHR pInfo{};
 	pInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -264,7 +399,10 @@ void appvk::drawFrame() {
 	pInfo.pSwapchains = &swap;
 	pInfo.pImageIndices = &nextFrame;
 
-	r = vkQueuePresentKHR(gQueue, &pInfo);
+	{
+		PROF_ZONE("present");
+		r = vkQueuePresentKHR(gQueue, &pInfo);
+	}
 	if (r == VK_ERROR_OUT_OF_DATE_KHR || resizeOccurred) {
 		recreateSwapChain();
 		resizeOccurred = false;
@@ -273,16 +411,56 @@ void appvk::drawFrame() {
 		throw std::runtime_error("cannot submit to queue!");
 	}
 
-	currFrame = (currFrame + 1) % options::framesInFlight;
+	currFrame = (currFrame + 1) % options::get().framesInFlight;
+	frameNumber++;
 }
 
 void appvk::run() {
+	const options::settings& cfg = options::get();
+	if (cfg.bench.enabled) {
+		runBenchmark();
+		return;
+	}
+
+	bench::camPath recorded;
+	recorded.clear();
+
+	bool traceKeyDown = false;
+
 	while (!glfwWindowShouldClose(w)) {
+		PROF_ZONE("frame");
+
+		{
+			PROF_ZONE("poll events");
+			glfwPollEvents();
+		}
+
+		{
+			PROF_ZONE("camera update");
+			c.update(w);
+		}
+
+		animTime = glfwGetTime();
+
+		if (!cfg.bench.record.empty()) {
+			recorded.add({ float(animTime), c.pos, c.front });
+		}
 
-		glfwPollEvents();
-		c.update(w);
 		drawFrame();
 
+		// F12 starts and stops a cpu trace capture
+		bool traceKey = glfwGetKey(w, GLFW_KEY_F12) == GLFW_PRESS;
+		if (traceKey && !traceKeyDown) {
+			if (prof::cpu::capturing) {
+				prof::cpu::stop();
+				prof::cpu::dump(cfg.trace.empty() ? "trace.json" : cfg.trace);
+			} else {
+				cout << "capturing cpu trace\n";
+				prof::cpu::start();
+			}
+		}
+		traceKeyDown = traceKey;
+
 		if (glfwGetKey(w, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
 			glfwSetWindowShouldClose(w, GLFW_TRUE);
 		}
@@ -291,34 +469,180 @@ void appvk::run() {
 	cout << std::endl;
 
 	vkDeviceWaitIdle(dev);
+
+	reportTransientMemory();
+
+	if (!cfg.bench.record.empty()) {
+		recorded.save(cfg.bench.record);
+		cout << "saved camera path to " << cfg.bench.record << "\n";
+	}
+}
+
+// replay a camera path with a fixed timestep, so every run renders the same sequence of frames
+void appvk::runBenchmark() {
+	const bench::config& cfg = options::get().bench;
+
+	bench::camPath path;
+	if (!cfg.path.empty()) {
+		path.load(cfg.path);
+	}
+
+	bench::recorder rec;
+
+	finishLoading(); // every run measures the same scene, not however far loading got
+
+	// pages only load once frames ask for them, so the start of the path is drawn until a whole feedback sweep,
+	// and the frames in flight behind it, neither misses a page nor waits on one. a cache too small for the view
+	// never gets there, so give up after a while
+	if (virtualTextures) {
+		constexpr unsigned int maxSettleFrames = 1000;
+		const uint64_t quietFrames = vt::sweep + options::get().framesInFlight;
+
+		const bench::key k = path.sample(0.0f);
+		c.pos = k.pos;
+		c.front = k.front;
+		animTime = 0.0;
+
+		unsigned int frames = 0;
+		for (uint64_t quiet = 0; quiet < quietFrames && frames < maxSettleFrames && !glfwWindowShouldClose(w); frames++) {
+			glfwPollEvents();
+			drawFrame();
+			quiet = vtPages.inFlight() == 0 && vtMissing == 0 ? quiet + 1 : 0;
+		}
+		cout << "virtual texture pages " << (frames < maxSettleFrames ? "settled" : "still streaming") << " after " << frames << " frames\n";
+	}
+
+	cout << "benchmarking " << cfg.frames << " frames after " << cfg.warmup << " warmup frames\n";
+
+	using namespace std::chrono;
+	for (unsigned int frame = 0; frame < cfg.warmup + cfg.frames && !glfwWindowShouldClose(w); frame++) {
+		PROF_ZONE("frame");
+
+		auto start = steady_clock::now();
+
+		glfwPollEvents();
+
+		animTime = frame * cfg.dt;
+		bench::key k = path.sample(animTime);
+		c.pos = k.pos;
+		c.front = k.front;
+
+		drawFrame();
+
+		float frameMs = duration<float, std::milli>(steady_clock::now() - start).count();
+
+		// gpu results are only read back once the fence of the frame that used this slot signals, so they
+		// go on that frame's row, framesInFlight back. the last few rows are left without them
+		if (frame >= cfg.warmup) {
+			const size_t lag = options::get().framesInFlight;
+
+			rec.add("frame_ms", frameMs);
+			rec.add("cpu_ms", frameMs - fenceWaitMs - acquireMs);
+			rec.add("gpu_ms", gpuFrameMs, lag);
+			rec.add("fence_ms", fenceWaitMs);
+			rec.add("acquire_ms", acquireMs);
+
+			for (const auto& r : frameProf.results()) {
+				rec.add("gpu_" + r.path + "_ms", r.ms, lag);
+			}
+
+			const double pixels = double(swapExtent.width) * swapExtent.height;
+			for (const auto& r : passStats.results()) {
+				rec.add(r.name + "_vertices", r.iaVertices, lag);
+				rec.add(r.name + "_vs_invocations", r.vsInvocations, lag);
+				rec.add(r.name + "_clip_primitives", r.clipPrimitives, lag);
+				rec.add(r.name + "_fs_invocations", r.fsInvocations, lag);
+				rec.add(r.name + "_overdraw", r.fsInvocations / pixels, lag);
+			}
+
+			constexpr double mib = 1048576.0;
+			const auto heaps = memory.heaps();
+			for (size_t i = 0; i < heaps.size(); i++) {
+				const std::string heap = "heap" + std::to_string(i);
+				rec.add(heap + "_tracked_mib", heaps[i].tracked / mib);
+				if (memory.budgetSupported()) {
+					rec.add(heap + "_usage_mib", heaps[i].usage / mib);
+					rec.add(heap + "_budget_mib", heaps[i].budget / mib);
+				}
+			}
+			for (size_t i = 0; i < size_t(mem::category::count); i++) {
+				const auto cat = mem::category(i);
+				rec.add(std::string("mem_") + mem::name(cat) + "_mib", memory.total(cat) / mib);
+			}
+
+			if (virtualTextures) {
+				rec.add("vt_pages_resident", vtPages.resident());
+				rec.add("vt_pages_loading", vtPages.inFlight());
+			}
+
+			rec.endFrame();
+		}
+
+		if (glfwGetKey(w, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
+			glfwSetWindowShouldClose(w, GLFW_TRUE);
+		}
+	}
+
+	vkDeviceWaitIdle(dev);
+
+	rec.write(cfg.out);
+	reportTransientMemory();
 }
 
 appvk::~appvk() {
+	abandonAssets(); // before files and jobs go
 
+	deletions.flush();
     cleanupSwapChain();
 
+	pipelines.destroy();
+	if (postAA()) {
+		destroyPost();
+	}
+	vkDestroyRenderPass(dev, renderPass, nullptr);
+
 	for (thing& t : things) {
+		vkDestroyPipelineLayout(dev, t.pipeLayout, nullptr);
 		vkDestroyDescriptorSetLayout(dev, t.layout, nullptr);
 
-		for (texture tx : t.maps) {
+		for (size_t i = 0; i < t.maps.size(); i++) {
+			if (!t.mapsResident[i]) {
+				continue; // placeholders are shared, destroyPlaceholders has them
+			}
+
+			texture tx = t.maps[i];
 			vkDestroySampler(dev, tx.samp, nullptr);
 			vkDestroyImageView(dev, tx.view, nullptr);
 			vkDestroyImage(dev, tx.im, nullptr);
-			vkFreeMemory(dev, tx.mem, nullptr);
+			memory.free(dev, tx.mem);
 			tx.mem = VK_NULL_HANDLE; // prevent other frees from failing if all textures allocated together
 		}
 
-		vkDestroyBuffer(dev, t.index.buf, nullptr);
-		vkFreeMemory(dev, t.index.mem, nullptr);
-		t.index.mem = VK_NULL_HANDLE;
+		if (t.meshResident) {
+			for (mesh& m : t.lods) {
+				freeMesh(m);
+			}
+		}
+	}
+	destroyPlaceholders();
+	deletions.flush();
 
-		vkDestroyBuffer(dev, t.vert.buf, nullptr);
-		vkFreeMemory(dev, t.vert.mem, nullptr);
-		t.vert.mem = VK_NULL_HANDLE;
+	if (uploadWindow.buf != VK_NULL_HANDLE) {
+		vkUnmapMemory(dev, uploadWindow.mem);
+		vkDestroyBuffer(dev, uploadWindow.buf, nullptr);
+		memory.free(dev, uploadWindow.mem);
 	}
 
+	destroyVirtualTextures();
+	destroyCulling();
+	destroyGeometryArena();
+
     vkDestroyCommandPool(dev, cp, nullptr);
 
+	frameProf.destroy();
+	onceProf.destroy();
+	passStats.destroy();
+
 	ImGui_ImplVulkan_Shutdown();
 
 	vkDestroyCommandPool(dev, ccp, nullptr);
@@ -327,10 +651,10 @@ appvk::~appvk() {
 	vkDestroyPipelineLayout(dev, cPipeLayout, nullptr);
 
 	vkDestroyBuffer(dev, ibuf.buf, nullptr);
-	vkFreeMemory(dev, ibuf.mem, nullptr);
+	memory.free(dev, ibuf.mem);
 
 	vkDestroyBuffer(dev, obuf.buf, nullptr);
-	vkFreeMemory(dev, obuf.mem, nullptr);
+	memory.free(dev, obuf.mem);
 
 	vkDestroyDescriptorSetLayout(dev, cLayout, nullptr);
 	vkDestroyDescriptorPool(dev, cPool, nullptr);
@@ -343,8 +667,21 @@ appvk::~appvk() {
 }
 
 int main(int argc, char **argv) {
-	(void)argc;
-	(void)argv;
+	try {
+		if (!options::load(argc, argv)) {
+			return EXIT_SUCCESS;
+		}
+	} catch (const std::exception& e) {
+		cerr << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+
+	const options::settings& cfg = options::get();
+
+	prof::cpu::nameThread("main");
+	if (!cfg.trace.empty()) {
+		prof::cpu::start(); // include startup in the trace
+	}
 
 	appvk app;
 	try {
@@ -353,5 +690,14 @@ int main(int argc, char **argv) {
 		cerr << e.what() << "\n";
 		return EXIT_FAILURE;
 	}
+
+	if (prof::cpu::capturing) {
+		prof::cpu::stop();
+		prof::cpu::dump(cfg.trace.empty() ? "trace.json" : cfg.trace);
+	}
+
+	if (app.shaderRegressed()) {
+		return EXIT_FAILURE; // so scripted runs fail when a shader gets more expensive
+	}
 	return EXIT_SUCCESS;
 }
@@ -6,12 +6,31 @@
 #include <optional> // C++17, for device queue querying
 #include <utility> // for std::pair
 #include <tuple>
+#include <memory>
 
 #include "glm_mat_wrapper.hpp"
 
 #include "base.hpp"
+#include "baked.hpp"
+#include "bench.hpp"
+#include "cluster.hpp"
+#include "gpuprof.hpp"
+#include "deletion.hpp"
+#include "fileio.hpp"
+#include "geometry.hpp"
+#include "graph.hpp"
+#include "jobs.hpp"
+#include "lod.hpp"
+#include "memstats.hpp"
+#include "memtype.hpp"
+#include "meshopt.hpp"
+#include "cpuprof.hpp"
+#include "pipelines.hpp"
+#include "spv.hpp"
 
 #include "vformat.hpp"
+#include "vertex.hpp"
+#include "vtex.hpp"
 #include "camera.hpp"
 #include "terrain.hpp"
 
@@ -26,10 +45,12 @@ public:
 
 	void run();
 
+	bool shaderRegressed() const { return shaderRegression; }
+
 private:
 
-	constexpr static bool shader_debug = false;
-	
+	void initVulkan(); // everything after loadAssets in the constructor
+
 	VkPhysicalDevice pdev = VK_NULL_HANDLE;
     VkSampleCountFlagBits msaaSamples;
 
@@ -95,22 +116,57 @@ private:
 		VkSampler samp = VK_NULL_HANDLE;
 	};
 
+	// a mesh's place in the geometry arena
+	struct mesh {
+		// straight to vkCmdDrawIndexed, one per 16-bit chunk or just the one with 32-bit indices
+		struct draw {
+			int32_t vertexOffset;
+			uint32_t firstIndex;
+			uint32_t indexCount;
+		};
+		std::vector<draw> draws;
+		VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+
+		// arena ranges, the index range is in 16-bit units whatever the index type
+		uint32_t vertexStart = 0;
+		uint32_t vertexCount = 0;
+		uint32_t indexStart = 0;
+		uint32_t indexUnits = 0;
+
+		// with gpu culling, also its draw slots in the culling output
+		uint32_t meshletStart = 0;
+		uint32_t meshletCount = 0;
+
+		uint32_t triangles = 0;
+		float error = 0.0f; // simplification error in object space units, 0 at full detail
+		glm::vec4 sphere = glm::vec4(0.0f); // object space bounds of the full detail mesh
+	};
+
 	struct thing {
-		buffer vert;
-		buffer index;
-		unsigned int indices = 0;
+		std::vector<mesh> lods; // full detail first, each its own place in the arena
+		uint32_t lod = 0; // level drawn this frame
+		const mesh& drawn() const { return lods[lod]; }
+		glm::mat4 model = glm::mat4(1.0f); // as in this frame's ubo, for culling and lod selection
 
 		std::array<texture, 3> maps;
 		texture& diff = maps[0];
 		texture& norm = maps[1];
 		texture& disp = maps[2];
 
+		// placeholders stand in until the loaded mesh and maps arrive
+		bool meshResident = false;
+		std::array<bool, 3> mapsResident = {};
+
+		// with virtual textures the maps are these instead, vt::none until their tile files are open
+		std::array<uint32_t, 3> virtualMaps = { vt::none, vt::none, vt::none };
+
 		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
 		std::vector<VkDescriptorSet> dsets;
+		std::vector<bool> staleSets; // per swapchain image, maps changed since its set was written
 		bufslab ubos;
 
 		VkPipelineLayout pipeLayout = VK_NULL_HANDLE;
-		VkPipeline pipe = VK_NULL_HANDLE;
+		pso::handle pipe = 0;
 	};
 
 	buffer ibuf;
@@ -139,7 +195,8 @@ private:
     VkFormat findImageFormat(const std::vector<VkFormat>& formats, VkImageTiling tiling, VkFormatFeatureFlags features);
     VkImageView createImageView(VkImage im, VkFormat format, unsigned int mipLevels, VkImageAspectFlags aspectMask);
 	
-	VkRenderPass renderPass = VK_NULL_HANDLE;
+	VkRenderPass renderPass = VK_NULL_HANDLE; // kept across swapchain recreation unless the format changes
+	VkFormat renderPassFormat = VK_FORMAT_UNDEFINED;
 
     void createRenderPass();
 
@@ -159,14 +216,28 @@ private:
     void allocDescriptorSets(VkDescriptorPool pool, thing& t);
 	void allocDescriptorSetUniform(thing& t);
 	void allocDescriptorSetTexture(thing& t, texture tex, size_t index);
+	void allocDescriptorSetVirtual(thing& t);
 
-	std::vector<char> readFile(std::string_view path);
-    VkShaderModule createShaderModule(const std::vector<char>& spv);
+    VkShaderModule createShaderModule(const std::vector<uint32_t>& code);
 	
+	pso::manager pipelines;
 	void createGraphicsPipeline();
 
-	bool printed = false;
-    void printShaderStats(const VkPipeline& pipe);
+	struct shaderReport {
+		std::string pipeline;
+		std::string executable; // one per shader stage, named by the driver
+		uint32_t subgroupSize = 0;
+		double registers = -1.0; // summaries are -1 if the driver doesn't report them
+		double spills = -1.0;
+		double instructions = -1.0;
+		std::vector<std::pair<std::string, double>> stats; // everything the driver reports
+	};
+
+	bool captureShaderStats = false; // set if a stats file or baseline was given
+	bool shaderRegression = false;
+	std::vector<shaderReport> shaderReports;
+	void collectShaderStats(VkPipeline pipe, std::string_view name);
+	void reportShaderStats();
 
 	std::vector<VkFramebuffer> swapFramebuffers; // ties render attachments to image views in the swapchain
     void createFramebuffers();
@@ -174,40 +245,223 @@ private:
 	VkCommandPool cp = VK_NULL_HANDLE;
 	void createCommandPool();
 
-	uint32_t findMemoryType(uint32_t legalMemoryTypes, VkMemoryPropertyFlags properties);
-    buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags props);
-	bufslab createBuffers(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags props, unsigned int count);
-
-    VkCommandBuffer beginSingleCommand();
-    void endSingleCommand(VkCommandBuffer buf);
+	mem::tracker memory; // every allocation goes through here
+	bool memoryBudgetSupported = false; // VK_EXT_memory_budget
+	bool resizableBar = false; // static uploads write straight into vram
+	uint32_t findMemoryType(uint32_t legalMemoryTypes, const mem::policy& p);
+    buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, const mem::policy& p, mem::category cat);
+	bufslab createBuffers(VkDeviceSize size, VkBufferUsageFlags usage, const mem::policy& p, unsigned int count, mem::category cat);
+	buffer createDeviceBuffer(VkDeviceSize size, VkBufferUsageFlags usage, mem::category cat);
+	void writeBuffer(const buffer& dst, VkDeviceSize offset, const void* src, VkDeviceSize size);
+
+	bool hostImportSupported = false; // VK_EXT_external_memory_host
+	VkDeviceSize hostImportAlignment = 0;
+	buffer importHostBuffer(void* p, VkDeviceSize size); // empty if the driver won't take it
+	constexpr static VkDeviceSize uploadWindowSize = 4 << 20;
+	buffer uploadWindow; // a small persistently mapped staging buffer, made when first needed
+	void* uploadWindowMap = nullptr;
+
+    VkCommandBuffer beginSingleCommand(bool timed = true);
+    void endSingleCommand(VkCommandBuffer buf); // waits for it
+    VkFence submitSingleCommand(VkCommandBuffer buf); // doesn't, the deletion queue owns the fence
+
+	// destroys things once the gpu is done with them, collected at the start of every frame
+	del::queue deletions;
 
 	image createImage(unsigned int width, unsigned int height, VkFormat format, unsigned int mipLevels,
-		VkSampleCountFlagBits samples, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags props);
+		VkSampleCountFlagBits samples, VkImageTiling tiling, VkImageUsageFlags usage, const mem::policy& p, mem::category cat);
     void transitionImageLayout(image image, VkImageLayout oldl, VkImageLayout newl);
     
-    void copyBufferToImage(VkBuffer buf, VkImage img, uint32_t width, uint32_t height);
-    void copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size);
+    // height rows from firstRow down, tightly packed from offset in buf
+    void copyBufferToImage(VkBuffer buf, VkImage img, uint32_t width, uint32_t height, VkDeviceSize offset = 0, uint32_t firstRow = 0);
+    VkFence copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkDeviceSize dstOffset = 0);
 
 	std::array<thing, 2> things;
 	thing& t = things[0];
 	thing& flr = things[1];
 
-    buffer createVertexBuffer(std::vector<vformat::vertex>& v);
-	buffer createVertexBuffer(const std::vector<uint8_t>& verts);
-
-    buffer createIndexBuffer(const std::vector<uint32_t>& indices);
+	// every mesh's vertices and indices, so a frame binds one vertex buffer and one index buffer.
+	// these are the starting sizes, each doubles whenever a mesh doesn't fit
+	constexpr static uint32_t arenaVertices = 1 << 18;
+	constexpr static uint32_t arenaIndexUnits = 1 << 21; // 16-bit, 32-bit indices take two
+	buffer arenaVert;
+	buffer arenaIndex;
+	geo::ranges arenaVertRanges;
+	geo::ranges arenaIndexRanges;
+	void createGeometryArena();
+	void destroyGeometryArena();
+	uint32_t allocateArena(buffer& b, geo::ranges& r, VkDeviceSize elemSize, VkBufferUsageFlags usage, uint32_t count, uint32_t align = 1);
+
+	// everything a mesh needs before it goes in the arena, made off the main thread
+	struct cookedMesh {
+		struct level {
+			std::vector<vtx::packed> verts;
+			VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+			std::vector<uint16_t> indices16;
+			std::vector<uint32_t> indices32;
+			std::vector<mesh::draw> draws; // relative to the level's own vertices and indices
+			std::vector<cluster::cullable> meshlets; // likewise
+			uint32_t triangles = 0;
+			float error = 0.0f;
+		};
+		std::vector<level> levels; // full detail first
+		glm::vec4 sphere = glm::vec4(0.0f);
+	};
+	static cookedMesh::level cookLevel(std::vector<vtx::packed> verts, const std::vector<uint32_t>& indices);
+	static cookedMesh cookMesh(std::string_view name, const std::vector<vformat::vertex>& loaded, std::vector<uint32_t> indices);
+	mesh uploadLevel(const cookedMesh::level& l);
+	std::vector<mesh> uploadMesh(const cookedMesh& c);
+	void freeMesh(mesh& m);
+	void bindGeometryArena(VkCommandBuffer cbuf);
+	void drawMesh(VkCommandBuffer cbuf, const mesh& m);
+	void selectLods(); // per thing, from projected error with the camera this frame
+	VkIndexType arenaIndexType = VK_INDEX_TYPE_UINT16; // what the arena's index buffer is bound as
+
+	// assets load in the background and go in between frames in the order they finish,
+	// so the first frame doesn't wait on any of them
+	struct loadedAsset {
+		size_t thing = 0;
+		std::optional<size_t> map; // which of its maps, or its mesh if empty
+		std::string path;
+		cookedMesh cooked;
+		int width = 0;
+		int height = 0;
+		std::vector<uint8_t> pixels; // rgba
+		std::unique_ptr<baked::mapping> baked; // instead of pixels when there's a baked copy
+		std::unique_ptr<vt::tileFile> tiles; // instead of either with virtual textures
+	};
+	job::mailbox<loadedAsset> loadedAssets; // outlives the pool, whose last jobs still push here
+	job::group assetLoads;
+	size_t assetsPending = 0; // submitted and not yet integrated
+	std::vector<mesh> placeholderMesh;
+	std::array<texture, 3> placeholderMaps;
+	void loadAssets();
+	void prefetchAssets();
+	void createPlaceholders();
+	void destroyPlaceholders();
+	void integrateAssets();
+	void refreshTextureSets(uint32_t imageIndex); // only once the image's last frame is done with them
+	void finishLoading(); // everything resident, for benchmarks
+	void abandonAssets(); // waits out loads still running and drops their errors, before tearing down
+
+	// virtual textures: every map's pages go in one cache texture as the scene asks for them, read from tile
+	// files by jobs, copied in at the start of a frame and evicted least recently used first
+	bool virtualTextures = false; // maps are loaded whole without it, or without fragmentStoresAndAtomics
+	struct virtualPush {
+		std::array<uint32_t, 3> maps;
+		uint32_t frame;
+	};
+	constexpr static uint32_t vtStagingTiles = 64;
+	constexpr static uint32_t vtLoadsPerFrame = 32;
+	vt::residency vtPages;
+	std::vector<std::unique_ptr<vt::tileFile>> vtFiles; // by texture id
+	image vtCache;
+	VkSampler vtSampler = VK_NULL_HANDLE;
+	buffer vtTable; // texture infos then page table entries, as vtPages has them
+	buffer vtFeedback; // a bit per entry, set by the scene and cleared once copied out
+	buffer vtReadback; // a copy of the feedback per frame in flight
+	const uint32_t* vtReadbackMap = nullptr;
+	buffer vtStaging; // tiles read straight from the tile files
+	uint8_t* vtStagingMap = nullptr;
+	int vtStagingIndex = -1; // registered with files
+	std::vector<uint32_t> vtFreeStaging;
+	std::vector<VkBufferImageCopy> vtCopies; // into the cache this frame
+	size_t vtMissing = 0; // pages the last feedback asked for that were neither resident nor loading
+	struct tileLoad {
+		uint32_t page;
+		uint32_t staging;
+	};
+	job::mailbox<tileLoad> vtLoaded; // outlives the pool, like loadedAssets
+	job::group vtLoads;
+	rg::handle vtCacheRes = 0;
+	rg::handle vtTableRes = 0;
+	rg::handle vtFeedbackRes = 0;
+	rg::handle vtReadbackRes = 0;
+	void createVirtualTextures();
+	void destroyVirtualTextures();
+	void updateVirtualTextures(); // placing what arrived and asking for more, after integrateAssets
+	void recordVirtualUpload(VkCommandBuffer cbuf);
+	void recordVirtualReadback(VkCommandBuffer cbuf);
+
+	job::pool jobs; // asset loading, one thread per core
+	io::reader files{ jobs }; // io_uring where the kernel allows it, preads on the pool otherwise
+
+	// meshlets of every mesh, culled in a compute pass every frame into indirect draws. this one doesn't grow,
+	// the cull set and frame graph hold on to it, so levels that don't fit are drawn whole instead
+	constexpr static uint32_t arenaMeshlets = 1 << 16;
+	bool gpuCulling = false; // needs multiDrawIndirect, otherwise meshes are drawn whole
+	bool drawIndirectCountSupported = false; // otherwise culled draws are zeroed rather than compacted away
+	buffer arenaMeshlet; // cluster::cullable per meshlet
+	geo::ranges arenaMeshletRanges;
+	buffer cullDraws; // a VkDrawIndexedIndirectCommand slot per arena meshlet
+	buffer cullCounts; // survivors per thing
+	rg::handle cullDrawsRes = 0;
+	rg::handle cullCountsRes = 0;
+	VkDescriptorSetLayout cullLayout = VK_NULL_HANDLE;
+	VkPipelineLayout cullPipeLayout = VK_NULL_HANDLE;
+	VkPipeline cullPipeline = VK_NULL_HANDLE;
+	VkDescriptorPool cullPool = VK_NULL_HANDLE;
+	VkDescriptorSet cullSet = VK_NULL_HANDLE;
+	glm::mat4 cullViewProj = glm::mat4(1.0f); // as in this frame's ubos
+	void createCulling();
+	void destroyCulling();
+	void recordCullClear(VkCommandBuffer cbuf);
+	void recordCull(VkCommandBuffer cbuf);
+	void drawCulled(VkCommandBuffer cbuf, const mesh& m, uint32_t countIndex);
 
 	texture createTextureImage(int width, int height, const uint8_t* data, bool makeMips = true);
+	texture createBakedTexture(const baked::mapping& m);
 
     VkSampler createSampler(unsigned int mipLevels);
 	void generateMipmaps(VkImage image, VkFormat format, unsigned int width, unsigned int height, unsigned int levels);
 
-	image depth;
 	VkFormat depthFormat;
-    void createDepthImage();
 
-	image ms;
-    void createMultisampleImage();
+	// passes recorded every frame and the swapchain sized targets they use, rebuilt with the swapchain
+	rg::graph frameGraph;
+	rg::handle depthTarget = 0;
+	rg::handle msTarget = 0;
+	rg::handle sceneTarget = 0; // post aa only
+	rg::handle historyCurr = 0; // taa only, swapped after every frame
+	rg::handle historyPrev = 0;
+	void createFrameGraph();
+	void reportTransientMemory();
+	void recordScene(VkCommandBuffer cbuf, uint32_t imageIndex);
+
+	// post-process anti-aliasing, used instead of msaa when aa is fxaa or taa
+	enum class aaMode { msaa, fxaa, taa };
+	aaMode aa = aaMode::msaa;
+	bool postAA() const { return aa != aaMode::msaa; }
+
+	VkFramebuffer sceneFramebuffer = VK_NULL_HANDLE;
+	VkRenderPass postPass = VK_NULL_HANDLE; // filter into the swapchain, then draw the ui
+	VkSampler postSampler = VK_NULL_HANDLE;
+	VkDescriptorSetLayout postLayout = VK_NULL_HANDLE;
+	VkPipelineLayout postPipeLayout = VK_NULL_HANDLE;
+	pso::handle postPipe = 0;
+	VkDescriptorPool postPool = VK_NULL_HANDLE;
+	std::array<VkDescriptorSet, 2> postSets = {}; // one per history image with taa
+
+	std::array<image, 2> history; // taa history, ping-ponged between frames
+	uint32_t historyIndex = 0; // history written this frame
+	bool historyValid = false;
+	VkDescriptorSetLayout taaLayout = VK_NULL_HANDLE;
+	VkPipelineLayout taaPipeLayout = VK_NULL_HANDLE;
+	VkPipeline taaPipeline = VK_NULL_HANDLE;
+	std::array<VkDescriptorSet, 2> taaSets = {};
+	glm::mat4 prevViewProj = glm::mat4(1.0f);
+	glm::mat4 taaReproj = glm::mat4(1.0f);
+	glm::vec2 taaJitter = glm::vec2(0.0f);
+
+	void createPostPass();
+	void createPostPipelines();
+	void createPostImages();
+	void createPostDescriptors();
+	void destroyPostImages();
+	void destroyPost();
+	void jitterProjection(glm::mat4& proj, const glm::mat4& view);
+	void recordTaa(VkCommandBuffer cbuf);
+	void recordPost(VkCommandBuffer cbuf, uint32_t imageIndex);
 	
 	std::vector<VkCommandBuffer> commandBuffers;
 	
@@ -226,12 +480,29 @@ private:
 
 	// this scene is set up so that the camera is in -Z looking towards +Z.
     cam::camera c;
+	constexpr static float fovDegrees = 25.0f; // vertical
 	
+    double animTime = 0.0; // seconds, drives object animation instead of wall time so benchmarks are repeatable
     void updateFrame(uint32_t imageIndex);
 
+	prof::gpu frameProf; // one slot per frame in flight
+	prof::gpu onceProf; // single-command uploads and the startup compute dispatch, read back after the queue idles
+	prof::pipeStats passStats; // one slot per frame in flight
+	bool pipelineStatsSupported = false;
+	void createProfilers();
+	void drawProfilerUI();
+	void drawMemoryUI();
+
+	float fenceWaitMs = 0.0f; // time drawFrame spent blocked on fences
+	float acquireMs = 0.0f; // and in vkAcquireNextImageKHR
+	float gpuFrameMs = 0.0f; // gpu time of the last completed frame
+
 	uint32_t currFrame = 0;
+	uint64_t frameNumber = 0; // frames drawn since startup
 
 	void drawFrame();
 
+	void runBenchmark();
+
     void cleanupSwapChain();
 };
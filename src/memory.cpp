@@ -1,33 +1,36 @@
 #include "main.hpp"
+#include "extensions.hpp"
 
-void appvk::copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size) {
-    VkCommandBuffer buf = beginSingleCommand();
+// doesn't wait for the copy, anything submitted after it sees the result
+VkFence appvk::copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkDeviceSize dstOffset) {
+    VkCommandBuffer buf = beginSingleCommand(false);
 
     VkBufferCopy copy{};
     copy.size = size;
+    copy.dstOffset = dstOffset;
 
     vkCmdCopyBuffer(buf, src, dst, 1, &copy);
 
-    endSingleCommand(buf);
-}
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+        1, &barrier, 0, nullptr, 0, nullptr);
 
-// find a memory type that our image or buffer can use and that has the properties we want
-uint32_t appvk::findMemoryType(uint32_t legalMemoryTypes, VkMemoryPropertyFlags properties) {
-    VkPhysicalDeviceMemoryProperties memProp{};
-    vkGetPhysicalDeviceMemoryProperties(pdev, &memProp);
+    return submitSingleCommand(buf);
+}
 
-    // turn a one-hot legalMemoryTypes into an int representing the index we want in memoryTypes
-    for (size_t i = 0; i < memProp.memoryTypeCount; i++) {
-        // if the type matches one of the allowed types given to us and it has the right flags, return it
-        if ((legalMemoryTypes & (1 << i)) && (memProp.memoryTypes[i].propertyFlags & properties)) {
-            return i;
-        }
+// find the best memory type that our image or buffer can use under a policy
+uint32_t appvk::findMemoryType(uint32_t legalMemoryTypes, const mem::policy& p) {
+    if (auto type = mem::findType(pdev, legalMemoryTypes, p)) {
+        return *type;
     }
 
     throw std::runtime_error("cannot find proper memory type!");
 }
 
-appvk::buffer appvk::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags props) {
+appvk::buffer appvk::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, const mem::policy& p, mem::category cat) {
     VkBufferCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     createInfo.size = size;
@@ -45,9 +48,9 @@ appvk::buffer appvk::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, V
     VkMemoryAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     allocInfo.allocationSize = mreq.size;
-    allocInfo.memoryTypeIndex = findMemoryType(mreq.memoryTypeBits, props);
+    allocInfo.memoryTypeIndex = findMemoryType(mreq.memoryTypeBits, p);
 
-    if (vkAllocateMemory(dev, &allocInfo, nullptr, &(buf.mem)) != VK_SUCCESS) {
+    if (memory.allocate(dev, allocInfo, cat, &buf.mem) != VK_SUCCESS) {
         throw std::runtime_error("cannot allocate buffer memory!");
     }
 
@@ -56,7 +59,104 @@ appvk::buffer appvk::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, V
     return buf;
 }
 
-appvk::bufslab appvk::createBuffers(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags props, unsigned int count) {
+// a transfer source over host memory the device reads in place, instead of copying it into staging first.
+// p and size have to be aligned to hostImportAlignment, and p has to stay mapped until the buffer goes
+appvk::buffer appvk::importHostBuffer(void* p, VkDeviceSize size) {
+    if (!hostImportSupported || uintptr_t(p) % hostImportAlignment != 0 || size % hostImportAlignment != 0) {
+        return {};
+    }
+
+    const auto handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+
+    VkMemoryHostPointerPropertiesEXT hostProps{};
+    hostProps.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+    if (GetMemoryHostPointerPropertiesEXT(dev, handleType, p, &hostProps) != VK_SUCCESS) {
+        return {};
+    }
+
+    VkExternalMemoryBufferCreateInfo external{};
+    external.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+    external.handleTypes = handleType;
+
+    VkBufferCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    createInfo.pNext = &external;
+    createInfo.size = size;
+    createInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    buffer buf;
+    if (vkCreateBuffer(dev, &createInfo, nullptr, &(buf.buf)) != VK_SUCCESS) {
+        return {};
+    }
+
+    VkMemoryRequirements mreq{};
+    vkGetBufferMemoryRequirements(dev, buf.buf, &mreq);
+
+    const uint32_t types = mreq.memoryTypeBits & hostProps.memoryTypeBits;
+    if (types == 0 || mreq.size > size) {
+        vkDestroyBuffer(dev, buf.buf, nullptr);
+        return {};
+    }
+
+    VkImportMemoryHostPointerInfoEXT import{};
+    import.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+    import.handleType = handleType;
+    import.pHostPointer = p;
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.pNext = &import;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = 0; // any will do, the memory is the host's whatever the type says
+    while ((types & (1u << allocInfo.memoryTypeIndex)) == 0) {
+        allocInfo.memoryTypeIndex++;
+    }
+
+    if (memory.allocate(dev, allocInfo, mem::category::staging, &buf.mem) != VK_SUCCESS) {
+        vkDestroyBuffer(dev, buf.buf, nullptr);
+        return {};
+    }
+
+    vkBindBufferMemory(dev, buf.buf, buf.mem, 0);
+
+    return buf;
+}
+
+// device local buffer for writeBuffer, mappable when vram is and a copy destination otherwise
+appvk::buffer appvk::createDeviceBuffer(VkDeviceSize size, VkBufferUsageFlags usage, mem::category cat) {
+    if (resizableBar) {
+        return createBuffer(size, usage, mem::preset::direct, cat);
+    }
+    return createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, mem::preset::gpuOnly, cat);
+}
+
+// fill part of a createDeviceBuffer buffer, written in place when vram is mappable and through a staging copy otherwise
+void appvk::writeBuffer(const buffer& dst, VkDeviceSize offset, const void* src, VkDeviceSize size) {
+    void *data;
+
+    if (resizableBar) {
+        vkMapMemory(dev, dst.mem, offset, size, 0, &data);
+        memcpy(data, src, size);
+        vkUnmapMemory(dev, dst.mem);
+        return;
+    }
+
+    buffer staging = createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, mem::preset::staging, mem::category::staging);
+
+    vkMapMemory(dev, staging.mem, 0, size, 0, &data);
+    memcpy(data, src, size);
+    vkUnmapMemory(dev, staging.mem);
+
+    // staging goes once the copy is done, nothing waits for it here
+    VkFence copied = copyBuffer(staging.buf, dst.buf, size, offset);
+    deletions.push(copied, [this, staging] {
+        vkDestroyBuffer(dev, staging.buf, nullptr);
+        memory.free(dev, staging.mem);
+    });
+}
+
+appvk::bufslab appvk::createBuffers(VkDeviceSize size, VkBufferUsageFlags usage, const mem::policy& p, unsigned int count, mem::category cat) {
     bufslab s = { std::vector<VkBuffer>(count) };
 
     VkBufferCreateInfo createInfo{};
@@ -77,9 +177,9 @@ appvk::bufslab appvk::createBuffers(VkDeviceSize size, VkBufferUsageFlags usage,
     VkMemoryAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     allocInfo.allocationSize = mreq.size * count;
-    allocInfo.memoryTypeIndex = findMemoryType(mreq.memoryTypeBits, props);
+    allocInfo.memoryTypeIndex = findMemoryType(mreq.memoryTypeBits, p);
 
-    if (vkAllocateMemory(dev, &allocInfo, nullptr, &s.mem) != VK_SUCCESS) {
+    if (memory.allocate(dev, allocInfo, cat, &s.mem) != VK_SUCCESS) {
         throw std::runtime_error("cannot allocate buffer memory!");
     }
 
@@ -0,0 +1,104 @@
+#include "memstats.hpp"
+
+namespace mem {
+    const char* name(category c) {
+        switch (c) {
+            case category::mesh: return "mesh";
+            case category::texture: return "texture";
+            case category::ubo: return "ubo";
+            case category::attachment: return "attachment";
+            case category::staging: return "staging";
+            case category::compute: return "compute";
+            case category::count: break;
+        }
+        return "unknown";
+    }
+
+    void tracker::init(VkPhysicalDevice pdev, bool budgetSupported) {
+        this->pdev = pdev;
+        budgets = budgetSupported;
+
+        VkPhysicalDeviceMemoryProperties memProp{};
+        vkGetPhysicalDeviceMemoryProperties(pdev, &memProp);
+
+        types.resize(memProp.memoryTypeCount);
+        for (uint32_t i = 0; i < memProp.memoryTypeCount; i++) {
+            types[i] = { memProp.memoryTypes[i].propertyFlags, memProp.memoryTypes[i].heapIndex };
+        }
+
+        std::lock_guard<std::mutex> lk(m);
+        heapStats.resize(memProp.memoryHeapCount);
+        for (uint32_t i = 0; i < memProp.memoryHeapCount; i++) {
+            heapStats[i].flags = memProp.memoryHeaps[i].flags;
+            heapStats[i].size = memProp.memoryHeaps[i].size;
+        }
+    }
+
+    VkResult tracker::allocate(VkDevice dev, const VkMemoryAllocateInfo& info, category c, VkDeviceMemory* mem) {
+        VkResult r = vkAllocateMemory(dev, &info, nullptr, mem);
+        if (r != VK_SUCCESS) {
+            return r;
+        }
+
+        std::lock_guard<std::mutex> lk(m);
+        const uint32_t h = types[info.memoryTypeIndex].heap;
+        live[*mem] = { c, h, info.allocationSize };
+        heapStats[h].tracked += info.allocationSize;
+        heapStats[h].byCategory[size_t(c)] += info.allocationSize;
+
+        return r;
+    }
+
+    void tracker::free(VkDevice dev, VkDeviceMemory mem) {
+        if (mem == VK_NULL_HANDLE) {
+            return;
+        }
+
+        vkFreeMemory(dev, mem, nullptr);
+
+        std::lock_guard<std::mutex> lk(m);
+        auto it = live.find(mem);
+        if (it == live.end()) {
+            return;
+        }
+
+        const allocation& a = it->second;
+        heapStats[a.heap].tracked -= a.size;
+        heapStats[a.heap].byCategory[size_t(a.c)] -= a.size;
+        live.erase(it);
+    }
+
+    void tracker::update() {
+        if (!budgets) {
+            return;
+        }
+
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProps{};
+        budgetProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        VkPhysicalDeviceMemoryProperties2 memProp{};
+        memProp.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        memProp.pNext = &budgetProps;
+        vkGetPhysicalDeviceMemoryProperties2(pdev, &memProp);
+
+        std::lock_guard<std::mutex> lk(m);
+        for (size_t i = 0; i < heapStats.size(); i++) {
+            heapStats[i].budget = budgetProps.heapBudget[i];
+            heapStats[i].usage = budgetProps.heapUsage[i];
+        }
+    }
+
+    std::vector<tracker::heap> tracker::heaps() const {
+        std::lock_guard<std::mutex> lk(m);
+        return heapStats;
+    }
+
+    VkDeviceSize tracker::total(category c) const {
+        std::lock_guard<std::mutex> lk(m);
+        VkDeviceSize sum = 0;
+        for (const heap& h : heapStats) {
+            sum += h.byCategory[size_t(c)];
+        }
+        return sum;
+    }
+}
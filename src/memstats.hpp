@@ -0,0 +1,62 @@
+#pragma once
+
+#include "glfw_wrapper.hpp"
+
+#include <array>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Device memory accounting. Every allocation goes through a tracker and is tagged with what
+// it holds, so usage can be broken down per heap and per category, and compared against the
+// heap budgets reported by VK_EXT_memory_budget when the device has it.
+namespace mem {
+    enum class category { mesh, texture, ubo, attachment, staging, compute, count };
+
+    const char* name(category c);
+
+    class tracker {
+    public:
+        struct heap {
+            VkMemoryHeapFlags flags = 0;
+            VkDeviceSize size = 0;
+            VkDeviceSize budget = 0; // what the process can use before the driver starts evicting, 0 if unknown
+            VkDeviceSize usage = 0; // the process' usage as seen by the driver, 0 if unknown
+            VkDeviceSize tracked = 0; // sum of our own allocations
+            std::array<VkDeviceSize, size_t(category::count)> byCategory = {};
+        };
+
+        void init(VkPhysicalDevice pdev, bool budgetSupported);
+
+        // wrappers for vkAllocateMemory / vkFreeMemory, freeing null is a no-op
+        VkResult allocate(VkDevice dev, const VkMemoryAllocateInfo& info, category c, VkDeviceMemory* mem);
+        void free(VkDevice dev, VkDeviceMemory mem);
+
+        // re-query budgets, cheap enough for once a frame
+        void update();
+
+        bool budgetSupported() const { return budgets; }
+        VkMemoryPropertyFlags typeFlags(uint32_t type) const { return types[type].flags; }
+        std::vector<heap> heaps() const;
+        VkDeviceSize total(category c) const;
+
+    private:
+        struct allocation {
+            category c;
+            uint32_t heap;
+            VkDeviceSize size;
+        };
+
+        VkPhysicalDevice pdev = VK_NULL_HANDLE;
+        bool budgets = false;
+        struct typeInfo {
+            VkMemoryPropertyFlags flags;
+            uint32_t heap;
+        };
+        std::vector<typeInfo> types; // by memory type index
+
+        mutable std::mutex m; // allocations may come from loader threads
+        std::vector<heap> heapStats;
+        std::unordered_map<VkDeviceMemory, allocation> live;
+    };
+}
@@ -0,0 +1,47 @@
+#include "memtype.hpp"
+
+#include <bitset>
+
+namespace mem {
+    std::optional<uint32_t> findType(VkPhysicalDevice pdev, uint32_t legalTypes, const policy& p) {
+        VkPhysicalDeviceMemoryProperties memProp{};
+        vkGetPhysicalDeviceMemoryProperties(pdev, &memProp);
+
+        std::optional<uint32_t> best;
+        size_t bestCost = SIZE_MAX;
+
+        // drivers list types roughly fastest first, so ties go to the earlier one
+        for (uint32_t i = 0; i < memProp.memoryTypeCount; i++) {
+            const VkMemoryPropertyFlags flags = memProp.memoryTypes[i].propertyFlags;
+            if (!(legalTypes & (1u << i)) || (flags & p.required) != p.required) {
+                continue;
+            }
+
+            const size_t cost = std::bitset<32>(p.preferred & ~flags).count() + std::bitset<32>(p.avoided & flags).count();
+            if (cost < bestCost) {
+                best = i;
+                bestCost = cost;
+            }
+        }
+
+        return best;
+    }
+
+    bool hasResizableBar(VkPhysicalDevice pdev) {
+        VkPhysicalDeviceMemoryProperties memProp{};
+        vkGetPhysicalDeviceMemoryProperties(pdev, &memProp);
+
+        constexpr VkMemoryPropertyFlags mappableVram = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        constexpr VkDeviceSize legacyBar = 256ull * 1024 * 1024;
+
+        for (uint32_t i = 0; i < memProp.memoryTypeCount; i++) {
+            if ((memProp.memoryTypes[i].propertyFlags & mappableVram) == mappableVram &&
+                memProp.memoryHeaps[memProp.memoryTypes[i].heapIndex].size > legacyBar) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "glfw_wrapper.hpp"
+
+#include <optional>
+
+// Memory type selection. A policy lists the property flags a type must have, the ones we'd
+// like and the ones we'd rather not pay for, and the best legal type is the one missing the
+// fewest preferred flags and carrying the fewest avoided ones.
+namespace mem {
+    struct policy {
+        VkMemoryPropertyFlags required = 0;
+        VkMemoryPropertyFlags preferred = 0;
+        VkMemoryPropertyFlags avoided = 0;
+    };
+
+    namespace preset {
+        // rendered to, sampled or copied into, never touched by the cpu
+        inline constexpr policy gpuOnly = {
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT };
+
+        // attachments that never leave a render pass, tilers may never back them
+        inline constexpr policy transient = {
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT };
+
+        // written once by the cpu and copied from, kept out of vram so mappable vram is left for dynamic data
+        inline constexpr policy staging = {
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT };
+
+        // rewritten by the cpu every frame and read by the gpu, goes in mappable vram when there is any
+        inline constexpr policy dynamic = {
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT };
+
+        // written by the gpu and read back by the cpu, coherent since nothing invalidates mapped ranges
+        inline constexpr policy readback = {
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            VK_MEMORY_PROPERTY_HOST_CACHED_BIT, 0 };
+
+        // written by the cpu straight into vram, only worth it with resizable bar
+        inline constexpr policy direct = {
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            0, VK_MEMORY_PROPERTY_HOST_CACHED_BIT };
+    }
+
+    // legalTypes is VkMemoryRequirements::memoryTypeBits, nullopt if no legal type has every required flag
+    std::optional<uint32_t> findType(VkPhysicalDevice pdev, uint32_t legalTypes, const policy& p);
+
+    // whether the cpu can map more of vram than the legacy 256 MiB window, i.e. ReBAR/SAM or unified memory,
+    // in which case static uploads can skip staging too
+    bool hasResizableBar(VkPhysicalDevice pdev);
+}
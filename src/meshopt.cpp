@@ -0,0 +1,299 @@
+#include "meshopt.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+
+namespace opt {
+    namespace {
+        // fifo cache simulation, a vertex is cached if fewer than size misses came after its own
+        class fifo {
+        public:
+            // stamps start at 0, so time starts far enough ahead that nothing looks cached
+            fifo(size_t vertexCount, unsigned int cacheSize) : stamps(vertexCount, 0), size(cacheSize), time(cacheSize + 1) {}
+
+            // true on a miss
+            bool touch(uint32_t v) {
+                if (time - stamps[v] <= size) {
+                    return false;
+                }
+                stamps[v] = time++;
+                return true;
+            }
+
+            void clear() {
+                time += size + 1;
+            }
+
+        private:
+            std::vector<unsigned int> stamps;
+            unsigned int size;
+            unsigned int time;
+        };
+
+        struct vec3 {
+            float x, y, z;
+        };
+
+        vec3 position(const float* positions, size_t stride, uint32_t v) {
+            const float* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + stride * v);
+            return { p[0], p[1], p[2] };
+        }
+    }
+
+    cacheStats analyse(const std::vector<uint32_t>& indices, size_t vertexCount, unsigned int cacheSize) {
+        fifo cache(vertexCount, cacheSize);
+
+        size_t misses = 0;
+        for (uint32_t v : indices) {
+            misses += cache.touch(v);
+        }
+
+        cacheStats s;
+        if (!indices.empty()) {
+            s.acmr = float(misses) / (indices.size() / 3);
+        }
+        if (vertexCount > 0) {
+            s.atvr = float(misses) / vertexCount;
+        }
+        return s;
+    }
+
+    std::vector<uint32_t> cacheOrder(std::vector<uint32_t>& indices, size_t vertexCount, unsigned int cacheSize) {
+        const size_t triCount = indices.size() / 3;
+
+        // triangles using each vertex
+        std::vector<uint32_t> adjOffsets(vertexCount + 1, 0);
+        for (uint32_t v : indices) {
+            adjOffsets[v + 1]++;
+        }
+        std::partial_sum(adjOffsets.begin(), adjOffsets.end(), adjOffsets.begin());
+
+        std::vector<uint32_t> adj(indices.size());
+        std::vector<uint32_t> fill(adjOffsets.begin(), adjOffsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++) {
+            adj[fill[indices[i]]++] = i / 3;
+        }
+
+        std::vector<uint32_t> live(vertexCount); // triangles not yet emitted
+        for (size_t v = 0; v < vertexCount; v++) {
+            live[v] = adjOffsets[v + 1] - adjOffsets[v];
+        }
+
+        std::vector<unsigned int> stamps(vertexCount, 0);
+        std::vector<bool> emitted(triCount, false);
+        std::vector<uint32_t> deadEnd; // recently used vertices, to restart from when we run out of candidates
+        std::vector<uint32_t> candidates;
+
+        std::vector<uint32_t> out;
+        out.reserve(indices.size());
+        std::vector<uint32_t> clusters;
+
+        unsigned int time = cacheSize + 1;
+        size_t cursor = 0;
+        bool jumped = true; // the next triangle starts a cluster
+
+        auto next = [&]() -> int64_t {
+            // a candidate that will still be in the cache once its remaining triangles are emitted, the oldest such
+            int64_t best = -1;
+            int64_t bestPriority = -1;
+            for (uint32_t v : candidates) {
+                if (live[v] == 0) {
+                    continue;
+                }
+                int64_t priority = 0;
+                if (int64_t(time - stamps[v]) + 2 * int64_t(live[v]) <= int64_t(cacheSize)) {
+                    priority = time - stamps[v];
+                }
+                if (priority > bestPriority) {
+                    best = v;
+                    bestPriority = priority;
+                }
+            }
+            if (best >= 0) {
+                return best;
+            }
+
+            // otherwise a hard boundary: back to something recent, or the next vertex with triangles left
+            jumped = true;
+            while (!deadEnd.empty()) {
+                uint32_t v = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[v] > 0) {
+                    return v;
+                }
+            }
+            while (cursor < vertexCount) {
+                if (live[cursor] > 0) {
+                    return cursor;
+                }
+                cursor++;
+            }
+            return -1;
+        };
+
+        int64_t fan = vertexCount > 0 ? 0 : -1;
+        if (fan == 0 && live[0] == 0) {
+            fan = next();
+        }
+
+        while (fan >= 0) {
+            candidates.clear();
+
+            for (uint32_t a = adjOffsets[fan]; a < adjOffsets[fan + 1]; a++) {
+                const uint32_t tri = adj[a];
+                if (emitted[tri]) {
+                    continue;
+                }
+
+                if (jumped) {
+                    clusters.push_back(out.size() / 3);
+                    jumped = false;
+                }
+
+                for (size_t k = 0; k < 3; k++) {
+                    const uint32_t v = indices[tri * 3 + k];
+                    out.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+                    if (time - stamps[v] > cacheSize) {
+                        stamps[v] = time++;
+                    }
+                }
+                emitted[tri] = true;
+            }
+
+            fan = next();
+        }
+
+        indices = std::move(out);
+        return clusters;
+    }
+
+    void sortClusters(std::vector<uint32_t>& indices, const std::vector<uint32_t>& clusters, size_t vertexCount,
+        const float* positions, size_t stride, unsigned int cacheSize, float threshold) {
+        const size_t triCount = indices.size() / 3;
+        if (triCount == 0) {
+            return;
+        }
+
+        // split hard clusters wherever the cache has done as well as it will over the whole cluster,
+        // so sorting them costs at most threshold times the acmr
+        std::vector<uint32_t> soft;
+        fifo cache(vertexCount, cacheSize);
+
+        for (size_t c = 0; c < clusters.size(); c++) {
+            const size_t first = clusters[c];
+            const size_t last = c + 1 < clusters.size() ? clusters[c + 1] : triCount;
+
+            cache.clear();
+            size_t misses = 0;
+            for (size_t i = first * 3; i < last * 3; i++) {
+                misses += cache.touch(indices[i]);
+            }
+            const float target = threshold * float(misses) / (last - first);
+
+            cache.clear();
+            soft.push_back(first);
+            size_t start = first;
+            size_t running = 0;
+            for (size_t t = first; t < last; t++) {
+                for (size_t k = 0; k < 3; k++) {
+                    running += cache.touch(indices[t * 3 + k]);
+                }
+                if (t + 1 < last && running <= target * (t + 1 - start)) {
+                    soft.push_back(t + 1);
+                    start = t + 1;
+                    running = 0;
+                    cache.clear();
+                }
+            }
+        }
+
+        // area-weighted centroids and normals
+        struct cluster {
+            uint32_t first;
+            uint32_t last;
+            vec3 centroid;
+            vec3 normal;
+            float key;
+        };
+        std::vector<cluster> cs(soft.size());
+        vec3 meshCentroid = { 0.0f, 0.0f, 0.0f };
+        float meshArea = 0.0f;
+
+        for (size_t c = 0; c < soft.size(); c++) {
+            cluster& cl = cs[c];
+            cl.first = soft[c];
+            cl.last = c + 1 < soft.size() ? soft[c + 1] : triCount;
+            cl.centroid = { 0.0f, 0.0f, 0.0f };
+            cl.normal = { 0.0f, 0.0f, 0.0f };
+
+            float area = 0.0f;
+            for (uint32_t t = cl.first; t < cl.last; t++) {
+                const vec3 a = position(positions, stride, indices[t * 3 + 0]);
+                const vec3 b = position(positions, stride, indices[t * 3 + 1]);
+                const vec3 d = position(positions, stride, indices[t * 3 + 2]);
+
+                const vec3 e1 = { b.x - a.x, b.y - a.y, b.z - a.z };
+                const vec3 e2 = { d.x - a.x, d.y - a.y, d.z - a.z };
+                const vec3 n = { e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x };
+                const float twiceArea = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+
+                cl.normal = { cl.normal.x + n.x, cl.normal.y + n.y, cl.normal.z + n.z }; // already weighted by area
+                cl.centroid.x += (a.x + b.x + d.x) / 3.0f * twiceArea;
+                cl.centroid.y += (a.y + b.y + d.y) / 3.0f * twiceArea;
+                cl.centroid.z += (a.z + b.z + d.z) / 3.0f * twiceArea;
+                area += twiceArea;
+            }
+
+            meshCentroid = { meshCentroid.x + cl.centroid.x, meshCentroid.y + cl.centroid.y, meshCentroid.z + cl.centroid.z };
+            meshArea += area;
+
+            if (area > 0.0f) {
+                cl.centroid = { cl.centroid.x / area, cl.centroid.y / area, cl.centroid.z / area };
+            }
+            const float len = std::sqrt(cl.normal.x * cl.normal.x + cl.normal.y * cl.normal.y + cl.normal.z * cl.normal.z);
+            if (len > 0.0f) {
+                cl.normal = { cl.normal.x / len, cl.normal.y / len, cl.normal.z / len };
+            }
+        }
+
+        if (meshArea > 0.0f) {
+            meshCentroid = { meshCentroid.x / meshArea, meshCentroid.y / meshArea, meshCentroid.z / meshArea };
+        }
+
+        // clusters facing away from the middle of the mesh are the likeliest to occlude the rest from any direction
+        for (cluster& cl : cs) {
+            cl.key = (cl.centroid.x - meshCentroid.x) * cl.normal.x +
+                (cl.centroid.y - meshCentroid.y) * cl.normal.y +
+                (cl.centroid.z - meshCentroid.z) * cl.normal.z;
+        }
+        std::stable_sort(cs.begin(), cs.end(), [](const cluster& a, const cluster& b) { return a.key > b.key; });
+
+        std::vector<uint32_t> out;
+        out.reserve(indices.size());
+        for (const cluster& cl : cs) {
+            out.insert(out.end(), indices.begin() + cl.first * 3, indices.begin() + cl.last * 3);
+        }
+        indices = std::move(out);
+    }
+
+    std::vector<uint32_t> fetchOrder(std::vector<uint32_t>& indices, size_t vertexCount) {
+        std::vector<uint32_t> newIndex(vertexCount, UINT32_MAX);
+        std::vector<uint32_t> order;
+        order.reserve(vertexCount);
+
+        for (uint32_t& v : indices) {
+            if (newIndex[v] == UINT32_MAX) {
+                newIndex[v] = order.size();
+                order.push_back(v);
+            }
+            v = newIndex[v];
+        }
+
+        return order;
+    }
+}
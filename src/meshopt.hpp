@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Mesh optimisation, run on every mesh at load time:
+// - triangles are reordered for the post-transform vertex cache (tipsify, Sander et al. 2007)
+// - clusters of that order are sorted so outward facing ones draw first, which cuts overdraw from any view
+// - vertices are renumbered in order of first use so fetches walk memory forwards
+// Everything works on triangle lists.
+namespace opt {
+    // acmr is cache misses per triangle (0.5 is ideal, 3 is worst), atvr is misses per vertex (1 is ideal)
+    struct cacheStats {
+        float acmr = 0.0f;
+        float atvr = 0.0f;
+    };
+
+    // simulates a fifo cache of cacheSize entries, like most hardware has
+    cacheStats analyse(const std::vector<uint32_t>& indices, size_t vertexCount, unsigned int cacheSize = 16);
+
+    // reorder triangles in place for a cache of cacheSize, returns the first triangle of each cluster for sortClusters
+    std::vector<uint32_t> cacheOrder(std::vector<uint32_t>& indices, size_t vertexCount, unsigned int cacheSize = 16);
+
+    // reorder cacheOrder's clusters in place, positions are float3s stride bytes apart.
+    // a cluster is split further where the cache order would survive it, threshold bounds how much acmr can worsen
+    void sortClusters(std::vector<uint32_t>& indices, const std::vector<uint32_t>& clusters, size_t vertexCount,
+        const float* positions, size_t stride, unsigned int cacheSize = 16, float threshold = 1.05f);
+
+    // renumber vertices in order of first use and rewrite indices to match,
+    // returns old index by new index, unreferenced vertices are dropped
+    std::vector<uint32_t> fetchOrder(std::vector<uint32_t>& indices, size_t vertexCount);
+
+    template <typename V>
+    std::vector<V> remap(const std::vector<V>& verts, const std::vector<uint32_t>& order) {
+        std::vector<V> out;
+        out.reserve(order.size());
+        for (uint32_t v : order) {
+            out.push_back(verts[v]);
+        }
+        return out;
+    }
+
+    // all of the above
+    template <typename V>
+    void optimise(std::vector<V>& verts, std::vector<uint32_t>& indices, const float* positions, unsigned int cacheSize = 16) {
+        auto clusters = cacheOrder(indices, verts.size(), cacheSize);
+        sortClusters(indices, clusters, verts.size(), positions, sizeof(V), cacheSize);
+        verts = remap(verts, fetchOrder(indices, verts.size()));
+    }
+}
@@ -0,0 +1,174 @@
+#include "options.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string_view>
+
+namespace options {
+    namespace {
+        settings current;
+
+        bool parseBool(const std::string& v) {
+            if (v == "true" || v == "1" || v == "on" || v == "yes") {
+                return true;
+            } else if (v == "false" || v == "0" || v == "off" || v == "no") {
+                return false;
+            }
+            throw std::invalid_argument("expected a boolean, got " + v + "!");
+        }
+
+        // std::stoul takes "-1" and wraps it around, and stops quietly at trailing junk
+        unsigned long parseUnsigned(const std::string& v) {
+            size_t end = 0;
+            const unsigned long n = v.find('-') == std::string::npos ? std::stoul(v, &end) : 0;
+            if (end == 0 || end != v.size()) {
+                throw std::invalid_argument("expected a non-negative integer, got " + v + "!");
+            }
+            return n;
+        }
+
+        struct entry {
+            std::string_view name; // "--name" on the command line, "name = value" in a config file
+            bool flag; // boolean that can be given on the command line without a value
+            std::string_view help;
+            void (*set)(settings& s, const std::string& v);
+        };
+
+        const entry entries[] = {
+            { "width", false, "window width", [](settings& s, const std::string& v) { s.screenWidth = parseUnsigned(v); } },
+            { "height", false, "window height", [](settings& s, const std::string& v) { s.screenHeight = parseUnsigned(v); } },
+            { "fullscreen", true, "fullscreen on the primary monitor", [](settings& s, const std::string& v) { s.fullscreen = parseBool(v); } },
+            { "msaa", false, "msaa sample count (1, 2, 4, 8 or 16)", [](settings& s, const std::string& v) { s.msaaSamples = parseUnsigned(v); } },
+            { "aa", false, "anti-aliasing: msaa, fxaa or taa", [](settings& s, const std::string& v) { s.aa = v; } },
+            { "frames-in-flight", false, "frames the cpu can record ahead of the gpu", [](settings& s, const std::string& v) { s.framesInFlight = parseUnsigned(v); } },
+            { "present-mode", false, "mailbox, fifo, fifo_relaxed or immediate", [](settings& s, const std::string& v) { s.presentMode = v; } },
+            { "cull", true, "cull meshlets on the gpu, false draws meshes whole", [](settings& s, const std::string& v) { s.cull = parseBool(v); } },
+            { "lod-error", false, "screen space error in pixels allowed before drawing a finer level of detail", [](settings& s, const std::string& v) { s.lodError = std::stof(v); } },
+            { "bake-textures", true, "keep decoded textures next to their sources as .baked files, later runs map those instead of decoding", [](settings& s, const std::string& v) { s.bakeTextures = parseBool(v); } },
+            { "virtual-textures", true, "stream textures in pages as the scene samples them, false loads them whole", [](settings& s, const std::string& v) { s.virtualTextures = parseBool(v); } },
+            { "vt-cache", false, "MiB of texture memory that holds resident virtual texture pages", [](settings& s, const std::string& v) { s.vtCacheMiB = parseUnsigned(v); } },
+            { "verbose", true, "verbose validation layer output", [](settings& s, const std::string& v) { s.verbose = parseBool(v); } },
+            { "trace", false, "capture a cpu trace from startup and write it here on exit", [](settings& s, const std::string& v) { s.trace = v; } },
+            { "shader-stats", false, "write shader statistics for every pipeline here", [](settings& s, const std::string& v) { s.shaderStats = v; } },
+            { "shader-baseline", false, "fail if shaders regress against this statistics file", [](settings& s, const std::string& v) { s.shaderBaseline = v; } },
+            { "benchmark", true, "replay a camera path and record frame times", [](settings& s, const std::string& v) { s.bench.enabled = parseBool(v); } },
+            { "frames", false, "benchmark frames to record", [](settings& s, const std::string& v) { s.bench.frames = parseUnsigned(v); } },
+            { "warmup", false, "benchmark frames to render before recording", [](settings& s, const std::string& v) { s.bench.warmup = parseUnsigned(v); } },
+            { "bench-out", false, "benchmark csv output", [](settings& s, const std::string& v) { s.bench.out = v; } },
+            { "camera-path", false, "camera path for the benchmark to replay", [](settings& s, const std::string& v) { s.bench.path = v; } },
+            { "record-path", false, "save the camera path flown during the session here", [](settings& s, const std::string& v) { s.bench.record = v; } },
+        };
+
+        const entry& find(std::string_view name) {
+            for (const auto& e : entries) {
+                if (e.name == name) {
+                    return e;
+                }
+            }
+            throw std::invalid_argument("unknown setting " + std::string(name) + "!");
+        }
+
+        std::string trim(const std::string& s) {
+            const size_t start = s.find_first_not_of(" \t\r");
+            if (start == std::string::npos) {
+                return "";
+            }
+            return s.substr(start, s.find_last_not_of(" \t\r") - start + 1);
+        }
+
+        // one "key = value" per line, '#' starts a comment
+        void loadFile(const std::string& file) {
+            std::ifstream in(file);
+            if (!in) {
+                throw std::runtime_error("cannot open config file " + file + "!");
+            }
+
+            std::string line;
+            for (unsigned int num = 1; std::getline(in, line); num++) {
+                line = trim(line.substr(0, line.find('#')));
+                if (line.empty()) {
+                    continue;
+                }
+
+                const size_t eq = line.find('=');
+                if (eq == std::string::npos) {
+                    throw std::invalid_argument(file + ":" + std::to_string(num) + ": expected key = value!");
+                }
+
+                find(trim(line.substr(0, eq))).set(current, trim(line.substr(eq + 1)));
+            }
+        }
+
+        void printHelp() {
+            std::cout << "usage: demo [--config file] [--setting value]...\n"
+                << "settings can also be given as \"setting = value\" lines in settings.cfg\n\n";
+            for (const auto& e : entries) {
+                std::cout << "  --" << e.name << (e.flag ? "" : " <value>") << "\n      " << e.help << "\n";
+            }
+        }
+    }
+
+    bool load(int argc, char** argv) {
+        std::string config = "settings.cfg";
+        bool explicitConfig = false;
+
+        for (int i = 1; i < argc; i++) {
+            const std::string_view arg = argv[i];
+            if (arg == "--help" || arg == "-h") {
+                printHelp();
+                return false;
+            } else if (arg == "--config" && i + 1 < argc) {
+                config = argv[i + 1];
+                explicitConfig = true;
+            }
+        }
+
+        if (explicitConfig || std::filesystem::exists(config)) {
+            loadFile(config);
+        }
+
+        for (int i = 1; i < argc; i++) {
+            std::string_view arg = argv[i];
+            if (arg.substr(0, 2) != "--") {
+                throw std::invalid_argument(std::string("unexpected argument ") + argv[i] + "!");
+            }
+            arg.remove_prefix(2);
+
+            if (arg == "config") {
+                i++; // already loaded
+                continue;
+            }
+
+            const entry& e = find(arg);
+
+            // flags only take a value if the next argument isn't another setting
+            if (e.flag && (i + 1 >= argc || std::string_view(argv[i + 1]).substr(0, 2) == "--")) {
+                e.set(current, "true");
+            } else if (i + 1 < argc) {
+                e.set(current, argv[++i]);
+            } else {
+                throw std::invalid_argument(std::string("missing value for ") + argv[i] + "!");
+            }
+        }
+
+        if (current.aa != "msaa" && current.aa != "fxaa" && current.aa != "taa") {
+            throw std::invalid_argument("aa must be msaa, fxaa or taa!");
+        }
+
+        if (current.framesInFlight == 0) {
+            throw std::invalid_argument("frames-in-flight must be at least 1!");
+        }
+
+        if (current.lodError < 0.0f) {
+            throw std::invalid_argument("lod-error can't be negative!");
+        }
+
+        return true;
+    }
+
+    const settings& get() {
+        return current;
+    }
+}
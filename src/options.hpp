@@ -1,20 +1,47 @@
 #pragma once
 
+#include <string>
+
+#include "bench.hpp"
+
 namespace options {
-    constexpr static unsigned int screenWidth = 3840;
-	constexpr static unsigned int screenHeight = 2160;
+    // Renderer settings, read once at startup from a config file and then the command line,
+    // which takes precedence. Run with --help for the list of keys.
+    struct settings {
+        // window options
+        unsigned int screenWidth = 3840;
+        unsigned int screenHeight = 2160;
+        bool fullscreen = false;
+
+        // graphics options
+        unsigned int msaaSamples = 2;
+        std::string aa = "msaa"; // msaa, fxaa or taa, post-process modes render without msaa
+        unsigned int framesInFlight = 2;
+        std::string presentMode = "mailbox"; // mailbox, fifo, fifo_relaxed or immediate, falls back to fifo
+        bool cull = true; // meshlet culling on the gpu, meshes are drawn whole without it
+        float lodError = 1.0f; // pixels of error a coarser level of detail may add, 0 always draws full detail
+        bool bakeTextures = true; // keep decoded textures as .baked files next to their sources and map those
+        bool virtualTextures = true; // stream texture pages the scene samples into a fixed size cache, .vt tile files next to the sources
+        unsigned int vtCacheMiB = 32; // size of that cache
+
+        // dev options
+        bool verbose = false;
+        std::string trace; // capture cpu zones from startup and write a chrome trace here on exit
+        std::string shaderStats; // write per-pipeline shader statistics here as json
+        std::string shaderBaseline; // compare shader statistics against this earlier json output
 
-    // graphics options
-    constexpr unsigned int msaaSamples = 2;
+        bench::config bench;
+    };
 
-    constexpr unsigned int framesInFlight = 2;
+    // reads "settings.cfg" if present (or the file given with --config), then argv
+    // returns false if the program should exit without running (e.g. after --help)
+    bool load(int argc, char** argv);
 
-    // dev options
-    constexpr static bool verbose = false;
+    const settings& get();
 
 #ifndef NDEBUG
 	constexpr static bool debug = true;
 #else
 	constexpr static bool debug = false;
 #endif
-}
\ No newline at end of file
+}
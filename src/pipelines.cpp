@@ -0,0 +1,363 @@
+#include "pipelines.hpp"
+
+#include "cpuprof.hpp"
+#include "spv.hpp"
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <stdexcept>
+
+namespace pso {
+    void manager::init(VkDevice dev, del::queue& deletions, unsigned int workers) {
+        this->dev = dev;
+        this->deletions = &deletions;
+
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        if (vkCreatePipelineCache(dev, &cacheInfo, nullptr, &cache) != VK_SUCCESS) {
+            throw std::runtime_error("cannot create pipeline cache!");
+        }
+
+        lastPoll = std::chrono::steady_clock::now();
+
+        stopping = false;
+        for (unsigned int i = 0; i < std::max(workers, 1u); i++) {
+            threads.emplace_back(&manager::work, this);
+        }
+    }
+
+    void manager::destroy() {
+        {
+            std::lock_guard<std::mutex> lk(jobMutex);
+            stopping = true;
+            jobs.clear();
+        }
+        jobCv.notify_all();
+
+        for (auto& t : threads) {
+            t.join();
+        }
+        threads.clear();
+
+        for (const auto& r : done) {
+            vkDestroyPipeline(dev, r.pipe, nullptr);
+        }
+        done.clear();
+
+        for (auto& e : entries) {
+            vkDestroyPipeline(dev, e.pipe, nullptr);
+        }
+        entries.clear();
+
+        vkDestroyPipelineCache(dev, cache, nullptr);
+        cache = VK_NULL_HANDLE;
+    }
+
+    handle manager::request(std::string_view name, const desc& d) {
+        entry e;
+        e.name = name;
+        e.d = d;
+        entries.push_back(std::move(e));
+
+        const handle h = entries.size() - 1;
+        queue(h);
+        return h;
+    }
+
+    void manager::queue(handle h) {
+        entry& e = entries[h];
+        e.generation++;
+        e.compiling = true;
+
+        // record times before reading, so a write that lands mid-compile is picked up on the next poll
+        std::error_code err;
+        e.vertTime = std::filesystem::last_write_time(e.d.vert, err);
+        e.fragTime = std::filesystem::last_write_time(e.d.frag, err);
+
+        {
+            std::lock_guard<std::mutex> lk(jobMutex);
+            jobs.push_back({ h, e.generation, e.reloaded, e.d });
+        }
+        jobCv.notify_one();
+    }
+
+    void manager::waitFor(handle h) {
+        PROF_ZONE("wait for pipeline");
+
+        while (entries[h].compiling) {
+            {
+                std::unique_lock<std::mutex> lk(doneMutex);
+                doneCv.wait(lk, [this] { return !done.empty(); });
+            }
+            swapIn();
+        }
+
+        if (entries[h].pipe == VK_NULL_HANDLE) {
+            throw std::runtime_error("cannot create pipeline " + entries[h].name + "!");
+        }
+    }
+
+    void manager::waitAll() {
+        for (handle h = 0; h < entries.size(); h++) {
+            waitFor(h);
+        }
+    }
+
+    VkPipeline manager::get(handle h) const {
+        if (entries[h].pipe != VK_NULL_HANDLE) {
+            return entries[h].pipe;
+        }
+        return entries[fallback].pipe;
+    }
+
+    size_t manager::pending() const {
+        size_t n = 0;
+        for (const auto& e : entries) {
+            n += e.compiling;
+        }
+        return n;
+    }
+
+    void manager::update(uint64_t frame) {
+        this->frame = frame;
+
+        swapIn();
+
+        const auto now = std::chrono::steady_clock::now();
+        if (now - lastPoll >= pollInterval) {
+            lastPoll = now;
+            pollShaders();
+        }
+    }
+
+    void manager::rebuild(VkRenderPass oldPass, VkRenderPass newPass) {
+        PROF_ZONE("rebuild pipelines");
+
+        swapIn();
+
+        for (handle h = 0; h < entries.size(); h++) {
+            if (entries[h].d.renderPass != oldPass) {
+                continue;
+            }
+            vkDestroyPipeline(dev, entries[h].pipe, nullptr);
+            entries[h].pipe = VK_NULL_HANDLE;
+            entries[h].d.renderPass = newPass;
+            queue(h);
+        }
+
+        // the fallback only stands in for pipelines with a compatible layout and render pass
+        waitAll();
+    }
+
+    void manager::swapIn() {
+        std::vector<result> finished;
+        {
+            std::lock_guard<std::mutex> lk(doneMutex);
+            finished.swap(done);
+        }
+
+        for (const auto& r : finished) {
+            entry& e = entries[r.h];
+            if (r.generation != e.generation) {
+                vkDestroyPipeline(dev, r.pipe, nullptr); // superseded by a later request
+                continue;
+            }
+
+            e.compiling = false;
+            if (r.pipe == VK_NULL_HANDLE) {
+                continue; // keep drawing with whatever we had, the error has been printed
+            }
+
+            if (e.pipe != VK_NULL_HANDLE) {
+                // last recorded in the frame before this one, so destroying after this one completes is safe
+                deletions->push(frame, [dev = dev, pipe = e.pipe] { vkDestroyPipeline(dev, pipe, nullptr); });
+                std::cout << "reloaded pipeline " << e.name << "\n";
+            }
+            e.pipe = r.pipe;
+        }
+    }
+
+    void manager::pollShaders() {
+        PROF_ZONE("poll shaders");
+
+        for (handle h = 0; h < entries.size(); h++) {
+            entry& e = entries[h];
+
+            std::error_code vertErr, fragErr;
+            const auto vertTime = std::filesystem::last_write_time(e.d.vert, vertErr);
+            const auto fragTime = std::filesystem::last_write_time(e.d.frag, fragErr);
+            if (vertErr || fragErr) {
+                continue; // probably being rewritten
+            }
+
+            if (vertTime != e.vertTime || fragTime != e.fragTime) {
+                e.reloaded = true; // from now on this pipeline's shaders come from disk
+                queue(h);
+            }
+        }
+    }
+
+    void manager::work() {
+        prof::cpu::nameThread("pipeline compiler");
+
+        while (true) {
+            job j;
+            {
+                std::unique_lock<std::mutex> lk(jobMutex);
+                jobCv.wait(lk, [this] { return stopping || !jobs.empty(); });
+                if (stopping) {
+                    return;
+                }
+                j = std::move(jobs.front());
+                jobs.pop_front();
+            }
+
+            VkPipeline pipe = VK_NULL_HANDLE;
+            try {
+                pipe = build(j.d, j.fromDisk);
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << "\n";
+            }
+
+            {
+                std::lock_guard<std::mutex> lk(doneMutex);
+                done.push_back({ j.h, j.generation, pipe });
+            }
+            doneCv.notify_all();
+        }
+    }
+
+    VkShaderModule manager::loadModule(const std::string& path, bool fromDisk) {
+        const std::vector<uint32_t> code = spv::load(path, !fromDisk);
+
+        VkShaderModuleCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = code.size() * sizeof(uint32_t);
+        createInfo.pCode = code.data();
+
+        VkShaderModule mod;
+        if (vkCreateShaderModule(dev, &createInfo, nullptr, &mod) != VK_SUCCESS) {
+            throw std::runtime_error("cannot create shader module from " + path + "!");
+        }
+        return mod;
+    }
+
+    VkPipeline manager::build(const desc& d, bool fromDisk) {
+        PROF_ZONE("build pipeline");
+
+        VkShaderModule vmod = loadModule(d.vert, fromDisk);
+        VkShaderModule fmod = VK_NULL_HANDLE;
+        try {
+            fmod = loadModule(d.frag, fromDisk);
+        } catch (...) {
+            vkDestroyShaderModule(dev, vmod, nullptr);
+            throw;
+        }
+
+        std::array<VkPipelineShaderStageCreateInfo, 2> shaders = {};
+
+        shaders[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaders[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+        shaders[0].module = vmod;
+        shaders[0].pName = "main";
+
+        shaders[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaders[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        shaders[1].module = fmod;
+        shaders[1].pName = "main";
+
+        VkPipelineVertexInputStateCreateInfo vinCreateInfo{};
+        vinCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vinCreateInfo.vertexBindingDescriptionCount = d.bindings.size();
+        vinCreateInfo.pVertexBindingDescriptions = d.bindings.data();
+        vinCreateInfo.vertexAttributeDescriptionCount = d.attributes.size();
+        vinCreateInfo.pVertexAttributeDescriptions = d.attributes.data();
+
+        VkPipelineInputAssemblyStateCreateInfo inAsmCreateInfo{};
+        inAsmCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inAsmCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inAsmCreateInfo.primitiveRestartEnable = VK_FALSE;
+
+        // viewport and scissor are dynamic, so pipelines survive swapchain resizes
+        VkPipelineViewportStateCreateInfo viewCreateInfo{};
+        viewCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewCreateInfo.viewportCount = 1;
+        viewCreateInfo.scissorCount = 1;
+
+        VkPipelineRasterizationStateCreateInfo rasterCreateInfo{};
+        rasterCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterCreateInfo.depthClampEnable = VK_FALSE; // clamps depth to range instead of discarding it
+        rasterCreateInfo.rasterizerDiscardEnable = VK_FALSE; // disables rasterization if true
+        rasterCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterCreateInfo.cullMode = d.cullMode;
+        rasterCreateInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE; // flip cull order due to inverting y in rasterizer
+        rasterCreateInfo.depthBiasEnable = VK_FALSE;
+        rasterCreateInfo.lineWidth = 1.0f;
+
+        VkPipelineMultisampleStateCreateInfo msCreateInfo{};
+        msCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        msCreateInfo.sampleShadingEnable = VK_FALSE;
+        msCreateInfo.rasterizationSamples = d.samples;
+
+        VkPipelineDepthStencilStateCreateInfo dCreateInfo{};
+        dCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        dCreateInfo.depthTestEnable = d.depthTest;
+        dCreateInfo.depthWriteEnable = d.depthTest;
+        dCreateInfo.depthCompareOp = VK_COMPARE_OP_LESS;
+        dCreateInfo.depthBoundsTestEnable = VK_FALSE;
+        dCreateInfo.stencilTestEnable = VK_FALSE;
+
+        VkPipelineColorBlendAttachmentState colorAttachment{}; // blending information per fb
+        colorAttachment.blendEnable = VK_FALSE;
+        colorAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT |
+                                            VK_COLOR_COMPONENT_G_BIT |
+                                            VK_COLOR_COMPONENT_B_BIT |
+                                            VK_COLOR_COMPONENT_A_BIT;
+
+        VkPipelineColorBlendStateCreateInfo colorCreateInfo{};
+        colorCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorCreateInfo.logicOpEnable = VK_FALSE;
+        colorCreateInfo.attachmentCount = 1;
+        colorCreateInfo.pAttachments = &colorAttachment;
+
+        std::array<VkDynamicState, 2> dynStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+        VkPipelineDynamicStateCreateInfo dynCreateInfo{};
+        dynCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynCreateInfo.dynamicStateCount = dynStates.size();
+        dynCreateInfo.pDynamicStates = dynStates.data();
+
+        VkGraphicsPipelineCreateInfo pipeCreateInfo{};
+        pipeCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+
+        if (d.captureStats) {
+            pipeCreateInfo.flags = VK_PIPELINE_CREATE_CAPTURE_STATISTICS_BIT_KHR;
+        }
+
+        pipeCreateInfo.stageCount = shaders.size();
+        pipeCreateInfo.pStages = shaders.data();
+        pipeCreateInfo.pVertexInputState = &vinCreateInfo;
+        pipeCreateInfo.pInputAssemblyState = &inAsmCreateInfo;
+        pipeCreateInfo.pViewportState = &viewCreateInfo;
+        pipeCreateInfo.pRasterizationState = &rasterCreateInfo;
+        pipeCreateInfo.pMultisampleState = &msCreateInfo;
+        pipeCreateInfo.pDepthStencilState = &dCreateInfo;
+        pipeCreateInfo.pColorBlendState = &colorCreateInfo;
+        pipeCreateInfo.pDynamicState = &dynCreateInfo;
+        pipeCreateInfo.layout = d.layout;
+        pipeCreateInfo.renderPass = d.renderPass;
+        pipeCreateInfo.subpass = 0;
+
+        VkPipeline pipe;
+        const VkResult r = vkCreateGraphicsPipelines(dev, cache, 1, &pipeCreateInfo, nullptr, &pipe);
+
+        vkDestroyShaderModule(dev, vmod, nullptr); // we can destroy shader modules once the graphics pipeline is created.
+        vkDestroyShaderModule(dev, fmod, nullptr);
+
+        if (r != VK_SUCCESS) {
+            throw std::runtime_error("cannot create graphics pipeline!");
+        }
+        return pipe;
+    }
+}
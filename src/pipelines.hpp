@@ -0,0 +1,123 @@
+#pragma once
+
+#include "glfw_wrapper.hpp"
+
+#include "deletion.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Graphics pipelines compiled on worker threads.
+// Until a pipeline is ready, get() returns the fallback so drawing never waits on a compile.
+// Shaders are watched for changes and recompiled in the background, finished pipelines are
+// swapped in by update() at the start of a frame and the ones they replace go to the deletion
+// queue, to be destroyed once no frame in flight can still be using them.
+namespace pso {
+    // everything that varies between our pipelines, the rest of the fixed function state is shared
+    struct desc {
+        std::string vert; // spv paths
+        std::string frag;
+
+        std::vector<VkVertexInputBindingDescription> bindings;
+        std::vector<VkVertexInputAttributeDescription> attributes;
+
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+        VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+        bool depthTest = true; // and depth write
+        bool captureStats = false; // for VK_KHR_pipeline_executable_properties
+    };
+
+    using handle = uint32_t;
+
+    class manager {
+    public:
+        // replaced pipelines are pushed to deletions, which must outlive the manager's last update
+        void init(VkDevice dev, del::queue& deletions, unsigned int workers);
+        void destroy();
+
+        // queue a compile and return immediately
+        handle request(std::string_view name, const desc& d);
+
+        // pipeline drawn with in place of any pipeline that isn't ready, layouts must be compatible
+        void setFallback(handle h) { fallback = h; }
+
+        // block until h has compiled, only meant for startup and render pass changes
+        void waitFor(handle h);
+        void waitAll();
+
+        // the pipeline for h if compiled, otherwise the fallback's
+        VkPipeline get(handle h) const;
+        bool ready(handle h) const { return entries[h].pipe != VK_NULL_HANDLE; }
+        const std::string& name(handle h) const { return entries[h].name; }
+        size_t size() const { return entries.size(); }
+        size_t pending() const;
+
+        // call once per frame after the frame's fence wait and before recording
+        void update(uint64_t frame);
+
+        // recompile the pipelines using oldPass against newPass, the device must be idle
+        void rebuild(VkRenderPass oldPass, VkRenderPass newPass);
+
+    private:
+        constexpr static auto pollInterval = std::chrono::milliseconds(500);
+
+        struct entry {
+            std::string name;
+            desc d;
+            VkPipeline pipe = VK_NULL_HANDLE;
+            uint32_t generation = 0; // bumped on every compile request, results for older generations are dropped
+            bool compiling = false;
+            bool reloaded = false; // shaders changed on disk since startup, so embedded spir-v is stale
+            std::filesystem::file_time_type vertTime;
+            std::filesystem::file_time_type fragTime;
+        };
+
+        struct job {
+            handle h;
+            uint32_t generation;
+            bool fromDisk; // skip embedded spir-v
+            desc d;
+        };
+
+        struct result {
+            handle h;
+            uint32_t generation;
+            VkPipeline pipe; // null if the compile failed
+        };
+
+        VkDevice dev = VK_NULL_HANDLE;
+        VkPipelineCache cache = VK_NULL_HANDLE; // internally synchronized, shared by the workers
+        del::queue* deletions = nullptr;
+        uint64_t frame = 0;
+        handle fallback = 0;
+
+        std::vector<entry> entries; // main thread only
+        std::chrono::steady_clock::time_point lastPoll;
+
+        std::vector<std::thread> threads;
+        std::mutex jobMutex;
+        std::condition_variable jobCv;
+        std::deque<job> jobs;
+        bool stopping = false;
+
+        std::mutex doneMutex;
+        std::condition_variable doneCv;
+        std::vector<result> done;
+
+        void queue(handle h);
+        void swapIn(); // move finished compiles into entries
+        void pollShaders();
+        void work();
+        VkPipeline build(const desc& d, bool fromDisk);
+        VkShaderModule loadModule(const std::string& path, bool fromDisk);
+    };
+}
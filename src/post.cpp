@@ -0,0 +1,398 @@
+#include "main.hpp"
+
+#include "options.hpp"
+
+#include "imgui.h"
+#include "imgui_impl_vulkan.h"
+
+#include <cmath>
+
+// post-process anti-aliasing: with aa = fxaa or taa the scene renders single-sampled into an offscreen target,
+// and a second render pass filters it into the swapchain image and draws the ui on top
+
+namespace {
+    struct postPush {
+        glm::vec2 texel;
+        uint32_t fxaa;
+    };
+
+    struct taaPush {
+        glm::mat4 reproj;
+        glm::vec2 jitter;
+        float feedback;
+        uint32_t reset;
+    };
+
+    constexpr float taaFeedback = 0.9f;
+    constexpr uint32_t taaSamples = 8; // length of the jitter sequence
+
+    float halton(uint32_t i, uint32_t base) {
+        float f = 1.0f;
+        float r = 0.0f;
+        while (i > 0) {
+            f /= base;
+            r += f * (i % base);
+            i /= base;
+        }
+        return r;
+    }
+}
+
+void appvk::createPostPass() {
+    PROF_ZONE("createPostPass");
+
+    VkAttachmentDescription attachment{};
+    attachment.format = swapFormat;
+    attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE; // every pixel is overwritten by the fullscreen triangle
+    attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    VkAttachmentReference colorAttachmentRef;
+    colorAttachmentRef.attachment = 0;
+    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription sub{};
+    sub.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    sub.colorAttachmentCount = 1;
+    sub.pColorAttachments = &colorAttachmentRef;
+
+    // same as the scene pass without post aa, wait for the swapchain image to be acquired
+    VkSubpassDependency dep{};
+    dep.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dep.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dep.srcAccessMask = 0;
+    dep.dstSubpass = 0;
+    dep.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dep.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    VkRenderPassCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    createInfo.attachmentCount = 1;
+    createInfo.pAttachments = &attachment;
+    createInfo.subpassCount = 1;
+    createInfo.pSubpasses = &sub;
+    createInfo.dependencyCount = 1;
+    createInfo.pDependencies = &dep;
+
+    if (vkCreateRenderPass(dev, &createInfo, nullptr, &postPass) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create post render pass!");
+    }
+}
+
+void appvk::createPostPipelines() {
+    PROF_ZONE("createPostPipelines");
+
+    VkSamplerCreateInfo sampInfo{};
+    sampInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampInfo.magFilter = VK_FILTER_LINEAR;
+    sampInfo.minFilter = VK_FILTER_LINEAR;
+    sampInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampInfo.maxLod = 0.0f;
+
+    if (vkCreateSampler(dev, &sampInfo, nullptr, &postSampler) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create post sampler!");
+    }
+
+    // fullscreen filter into the swapchain
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+
+    if (vkCreateDescriptorSetLayout(dev, &layoutInfo, nullptr, &postLayout) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create post descriptor set layout!");
+    }
+
+    VkPushConstantRange pcr{};
+    pcr.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pcr.offset = 0;
+    pcr.size = sizeof(postPush);
+
+    VkPipelineLayoutCreateInfo pipeLayoutCreateInfo{};
+    pipeLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeLayoutCreateInfo.setLayoutCount = 1;
+    pipeLayoutCreateInfo.pSetLayouts = &postLayout;
+    pipeLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipeLayoutCreateInfo.pPushConstantRanges = &pcr;
+
+    if (vkCreatePipelineLayout(dev, &pipeLayoutCreateInfo, nullptr, &postPipeLayout) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create post pipeline layout!");
+    }
+
+    pso::desc d;
+    d.vert = ".spv/post.vert.spv";
+    d.frag = ".spv/post.frag.spv";
+    d.layout = postPipeLayout;
+    d.renderPass = postPass;
+    d.cullMode = VK_CULL_MODE_NONE;
+    d.depthTest = false;
+    d.captureStats = captureShaderStats;
+    postPipe = pipelines.request("post", d);
+
+    if (aa != aaMode::taa) {
+        return;
+    }
+
+    // taa resolve, reads the scene, depth and last frame's history and writes the new history
+    std::array<VkDescriptorSetLayoutBinding, 4> taaBindings = {};
+    for (uint32_t i = 0; i < taaBindings.size(); i++) {
+        taaBindings[i].binding = i;
+        taaBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        taaBindings[i].descriptorCount = 1;
+        taaBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    taaBindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
+    layoutInfo.bindingCount = taaBindings.size();
+    layoutInfo.pBindings = taaBindings.data();
+
+    if (vkCreateDescriptorSetLayout(dev, &layoutInfo, nullptr, &taaLayout) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create taa descriptor set layout!");
+    }
+
+    pcr.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pcr.size = sizeof(taaPush);
+    pipeLayoutCreateInfo.pSetLayouts = &taaLayout;
+
+    if (vkCreatePipelineLayout(dev, &pipeLayoutCreateInfo, nullptr, &taaPipeLayout) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create taa pipeline layout!");
+    }
+
+    VkShaderModule cmod = createShaderModule(spv::load(".spv/taa.comp.spv"));
+
+    VkComputePipelineCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    createInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    createInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    createInfo.stage.module = cmod;
+    createInfo.stage.pName = "main";
+    createInfo.layout = taaPipeLayout;
+
+    if (captureShaderStats) {
+        createInfo.flags = VK_PIPELINE_CREATE_CAPTURE_STATISTICS_BIT_KHR;
+    }
+
+    if (vkCreateComputePipelines(dev, VK_NULL_HANDLE, 1, &createInfo, nullptr, &taaPipeline) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create taa pipeline!");
+    }
+
+    collectShaderStats(taaPipeline, "taa");
+
+    vkDestroyShaderModule(dev, cmod, nullptr);
+}
+
+// taa history outlives a frame, so it's imported into the frame graph rather than being a transient
+void appvk::createPostImages() {
+    PROF_ZONE("createPostImages");
+
+    if (aa != aaMode::taa) {
+        return;
+    }
+
+    for (image& h : history) {
+        h = createImage(swapExtent.width, swapExtent.height, VK_FORMAT_R16G16B16A16_SFLOAT, 1, VK_SAMPLE_COUNT_1_BIT,
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            mem::preset::gpuOnly, mem::category::attachment);
+        h.view = createImageView(h.im, VK_FORMAT_R16G16B16A16_SFLOAT, 1, VK_IMAGE_ASPECT_COLOR_BIT);
+    }
+    historyValid = false;
+}
+
+// descriptors for the frame graph's scene targets, so this runs after createFrameGraph
+void appvk::createPostDescriptors() {
+    PROF_ZONE("createPostDescriptors");
+
+    const VkImageView sceneView = frameGraph.view(sceneTarget);
+
+    std::array<VkDescriptorPoolSize, 2> sizes{};
+    sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    sizes[0].descriptorCount = postSets.size() + 3 * taaSets.size();
+    sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    sizes[1].descriptorCount = taaSets.size();
+
+    VkDescriptorPoolCreateInfo poolCreateInfo{};
+    poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolCreateInfo.maxSets = postSets.size() + taaSets.size();
+    poolCreateInfo.poolSizeCount = sizes.size();
+    poolCreateInfo.pPoolSizes = sizes.data();
+
+    if (vkCreateDescriptorPool(dev, &poolCreateInfo, nullptr, &postPool) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create post descriptor pool!");
+    }
+
+    auto alloc = [&](VkDescriptorSetLayout layout, VkDescriptorSet* sets, uint32_t count) {
+        std::vector<VkDescriptorSetLayout> layouts(count, layout);
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = postPool;
+        allocInfo.descriptorSetCount = count;
+        allocInfo.pSetLayouts = layouts.data();
+
+        if (vkAllocateDescriptorSets(dev, &allocInfo, sets) != VK_SUCCESS) {
+            throw std::runtime_error("cannot allocate post descriptor sets!");
+        }
+    };
+
+    std::vector<VkDescriptorImageInfo> infos;
+    std::vector<VkWriteDescriptorSet> writes;
+    infos.reserve(postSets.size() + 4 * taaSets.size()); // writes point into infos
+
+    auto write = [&](VkDescriptorSet set, uint32_t binding, VkDescriptorType type, VkImageView view, VkImageLayout layout) {
+        infos.push_back({ postSampler, view, layout });
+
+        VkWriteDescriptorSet w{};
+        w.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        w.dstSet = set;
+        w.dstBinding = binding;
+        w.descriptorCount = 1;
+        w.descriptorType = type;
+        w.pImageInfo = &infos.back();
+        writes.push_back(w);
+    };
+
+    // layouts match what the frame graph transitions each use to
+    constexpr VkDescriptorType sampled = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    constexpr VkImageLayout readOnly = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    if (aa == aaMode::fxaa) {
+        alloc(postLayout, postSets.data(), 1);
+        write(postSets[0], 0, sampled, sceneView, readOnly);
+    } else {
+        alloc(postLayout, postSets.data(), postSets.size());
+        alloc(taaLayout, taaSets.data(), taaSets.size());
+
+        // set i writes history i and reads the other one
+        for (size_t i = 0; i < taaSets.size(); i++) {
+            write(taaSets[i], 0, sampled, sceneView, readOnly);
+            write(taaSets[i], 1, sampled, frameGraph.view(depthTarget), readOnly);
+            write(taaSets[i], 2, sampled, history[1 - i].view, readOnly);
+            write(taaSets[i], 3, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, history[i].view, VK_IMAGE_LAYOUT_GENERAL);
+
+            write(postSets[i], 0, sampled, history[i].view, readOnly);
+        }
+    }
+
+    vkUpdateDescriptorSets(dev, writes.size(), writes.data(), 0, nullptr);
+}
+
+void appvk::destroyPostImages() {
+    vkDestroyDescriptorPool(dev, postPool, nullptr);
+    vkDestroyFramebuffer(dev, sceneFramebuffer, nullptr);
+
+    for (image* im : { &history[0], &history[1] }) {
+        vkDestroyImageView(dev, im->view, nullptr);
+        vkDestroyImage(dev, im->im, nullptr);
+        memory.free(dev, im->mem);
+        *im = image{};
+    }
+}
+
+void appvk::destroyPost() {
+    vkDestroyPipeline(dev, taaPipeline, nullptr);
+    vkDestroyPipelineLayout(dev, taaPipeLayout, nullptr);
+    vkDestroyDescriptorSetLayout(dev, taaLayout, nullptr);
+
+    vkDestroyPipelineLayout(dev, postPipeLayout, nullptr);
+    vkDestroyDescriptorSetLayout(dev, postLayout, nullptr);
+    vkDestroySampler(dev, postSampler, nullptr);
+
+    vkDestroyRenderPass(dev, postPass, nullptr);
+}
+
+// offset the projection by a subpixel amount each frame, so taa accumulates samples across the pixel
+void appvk::jitterProjection(glm::mat4& proj, const glm::mat4& view) {
+    const glm::mat4 viewProj = proj * view;
+    taaReproj = (historyValid ? prevViewProj : viewProj) * glm::inverse(viewProj);
+    prevViewProj = viewProj;
+
+    const uint32_t i = frameNumber % taaSamples + 1; // halton(0) is 0 on both axes
+    const glm::vec2 px = glm::vec2(halton(i, 2), halton(i, 3)) - 0.5f;
+    const glm::vec2 ndc = 2.0f * px / glm::vec2(swapExtent.width, swapExtent.height);
+
+    // w = -z, so subtracting here moves ndc by +ndc
+    proj[2][0] -= ndc.x;
+    proj[2][1] -= ndc.y;
+
+    // ndc y is flipped by the viewport
+    taaJitter = glm::vec2(0.5f * ndc.x, -0.5f * ndc.y);
+}
+
+// barriers around the resolve come from the frame graph
+void appvk::recordTaa(VkCommandBuffer cbuf) {
+    frameProf.begin(cbuf, "taa");
+
+    taaPush push;
+    push.reproj = taaReproj;
+    push.jitter = taaJitter;
+    push.feedback = taaFeedback;
+    push.reset = !historyValid;
+
+    vkCmdBindPipeline(cbuf, VK_PIPELINE_BIND_POINT_COMPUTE, taaPipeline);
+    vkCmdBindDescriptorSets(cbuf, VK_PIPELINE_BIND_POINT_COMPUTE, taaPipeLayout, 0, 1, &taaSets[historyIndex], 0, nullptr);
+    vkCmdPushConstants(cbuf, taaPipeLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(taaPush), &push);
+    vkCmdDispatch(cbuf, (swapExtent.width + 7) / 8, (swapExtent.height + 7) / 8, 1);
+
+    frameProf.end(cbuf);
+}
+
+void appvk::recordPost(VkCommandBuffer cbuf, uint32_t imageIndex) {
+    VkRenderPassBeginInfo rBeginInfo{};
+    rBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    rBeginInfo.renderPass = postPass;
+    rBeginInfo.framebuffer = swapFramebuffers[imageIndex];
+    rBeginInfo.renderArea.offset = { 0, 0 };
+    rBeginInfo.renderArea.extent = swapExtent;
+
+    frameProf.begin(cbuf, "post");
+
+    vkCmdBeginRenderPass(cbuf, &rBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        VkViewport viewport{};
+        viewport.width = swapExtent.width;
+        viewport.height = swapExtent.height;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(cbuf, 0, 1, &viewport);
+
+        VkRect2D scissor{};
+        scissor.extent = swapExtent;
+        vkCmdSetScissor(cbuf, 0, 1, &scissor);
+
+        frameProf.begin(cbuf, aa == aaMode::fxaa ? "fxaa" : "taa copy");
+
+        postPush push;
+        push.texel = 1.0f / glm::vec2(swapExtent.width, swapExtent.height);
+        push.fxaa = aa == aaMode::fxaa;
+
+        const VkDescriptorSet set = aa == aaMode::taa ? postSets[historyIndex] : postSets[0];
+        vkCmdBindPipeline(cbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.get(postPipe));
+        vkCmdBindDescriptorSets(cbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, postPipeLayout, 0, 1, &set, 0, nullptr);
+        vkCmdPushConstants(cbuf, postPipeLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(postPush), &push);
+        vkCmdDraw(cbuf, 3, 1, 0, 0);
+
+        frameProf.end(cbuf);
+
+        frameProf.begin(cbuf, "ui");
+        passStats.begin(cbuf, "ui");
+        ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cbuf);
+        passStats.end(cbuf);
+        frameProf.end(cbuf);
+
+    vkCmdEndRenderPass(cbuf);
+
+    frameProf.end(cbuf); // post
+}
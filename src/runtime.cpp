@@ -11,9 +11,9 @@
 #include "imgui_impl_vulkan.h"
 
 void appvk::createSyncs() {
-    imageAvailSems.resize(options::framesInFlight, VK_NULL_HANDLE);
-    renderDoneSems.resize(options::framesInFlight, VK_NULL_HANDLE);
-    inFlightFences.resize(options::framesInFlight, VK_NULL_HANDLE);
+    imageAvailSems.resize(options::get().framesInFlight, VK_NULL_HANDLE);
+    renderDoneSems.resize(options::get().framesInFlight, VK_NULL_HANDLE);
+    inFlightFences.resize(options::get().framesInFlight, VK_NULL_HANDLE);
     imagesInFlight = std::vector<VkFence>(swapImages.size(), VK_NULL_HANDLE); // this needs to be re-created on a window resize
     
     VkSemaphoreCreateInfo createInfo{};
@@ -23,7 +23,7 @@ void appvk::createSyncs() {
     fCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
     fCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-    for (unsigned int i = 0; i < options::framesInFlight; i++) {
+    for (unsigned int i = 0; i < options::get().framesInFlight; i++) {
         VkResult r1 = vkCreateSemaphore(dev, &createInfo, nullptr, &imageAvailSems[i]);
         VkResult r2 = vkCreateSemaphore(dev, &createInfo, nullptr, &renderDoneSems[i]);
         VkResult r3 = vkCreateFence(dev, &fCreateInfo, nullptr, &inFlightFences[i]);
@@ -34,12 +34,131 @@ void appvk::createSyncs() {
     }
 }
 
+void appvk::createProfilers() {
+    uint32_t numQueues;
+    vkGetPhysicalDeviceQueueFamilyProperties(pdev, &numQueues, nullptr);
+    std::vector<VkQueueFamilyProperties> queues(numQueues);
+    vkGetPhysicalDeviceQueueFamilyProperties(pdev, &numQueues, queues.data());
+
+    const uint32_t graphicsBits = queues[gQueueFamily].timestampValidBits;
+    const uint32_t computeBits = queues[cQueueFamily].timestampValidBits;
+
+    if (graphicsBits == 0) {
+        cout << "graphics queue does not support timestamps, gpu times will read as zero\n";
+    }
+
+    frameProf.init(dev, pdev, graphicsBits, options::get().framesInFlight);
+    onceProf.init(dev, pdev, computeBits != 0 ? graphicsBits : 0, 1, true); // uploads go on the graphics queue
+
+    passStats.init(dev, pipelineStatsSupported, options::get().framesInFlight);
+}
+
+void appvk::drawProfilerUI() {
+    // indent nested scopes by two spaces per level
+    auto show = [](const std::vector<prof::gpu::result>& results) {
+        for (const auto& r : results) {
+            ImGui::Text("%*s%s: %.3f ms", int(2 * r.depth), "", r.name.c_str(), r.ms);
+        }
+    };
+
+    if (ImGui::CollapsingHeader("gpu timings", ImGuiTreeNodeFlags_DefaultOpen)) {
+        show(frameProf.results());
+    }
+
+    if (ImGui::CollapsingHeader("gpu uploads")) {
+        show(onceProf.history());
+    }
+
+    if (passStats.supported() && ImGui::CollapsingHeader("pipeline statistics", ImGuiTreeNodeFlags_DefaultOpen)) {
+        const double pixels = double(swapExtent.width) * swapExtent.height;
+
+        for (const auto& r : passStats.results()) {
+            ImGui::Text("%s:", r.name.c_str());
+            ImGui::Text("  vertices: %lu (%lu vs invocations)", r.iaVertices, r.vsInvocations);
+            ImGui::Text("  primitives: %lu in, %lu clip invocations, %lu out of clipping", r.iaPrimitives, r.clipInvocations, r.clipPrimitives);
+            ImGui::Text("  fs invocations: %lu (%.2fx overdraw)", r.fsInvocations, r.fsInvocations / pixels);
+        }
+    }
+
+    drawMemoryUI();
+}
+
+void appvk::drawMemoryUI() {
+    if (!ImGui::CollapsingHeader("memory")) {
+        return;
+    }
+
+    constexpr double mib = 1048576.0;
+    const auto heaps = memory.heaps();
+
+    for (size_t i = 0; i < heaps.size(); i++) {
+        const auto& h = heaps[i];
+        const char* kind = (h.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? "device local" : "host";
+
+        if (memory.budgetSupported()) {
+            ImGui::Text("heap %zu (%s): %.1f / %.1f MiB used, %.1f MiB ours", i, kind,
+                h.usage / mib, h.budget / mib, h.tracked / mib);
+            if (h.budget > 0) {
+                ImGui::ProgressBar(float(double(h.usage) / h.budget));
+            }
+        } else {
+            ImGui::Text("heap %zu (%s): %.1f / %.1f MiB ours", i, kind, h.tracked / mib, h.size / mib);
+        }
+
+        for (size_t c = 0; c < h.byCategory.size(); c++) {
+            if (h.byCategory[c] > 0) {
+                ImGui::Text("  %s: %.2f MiB", mem::name(mem::category(c)), h.byCategory[c] / mib);
+            }
+        }
+    }
+
+    if (!memory.budgetSupported()) {
+        ImGui::Text("no VK_EXT_memory_budget, budgets unknown");
+    }
+    ImGui::Text("mesh uploads: %s", resizableBar ? "direct to vram (resizable bar)" : "staged");
+    ImGui::Text("geometry arena: %u / %u vertices, %.2f / %.2f MiB indices",
+        arenaVertRanges.used(), arenaVertRanges.capacity(),
+        arenaIndexRanges.used() * sizeof(uint16_t) / mib, arenaIndexRanges.capacity() * sizeof(uint16_t) / mib);
+    ImGui::Text("pending deletions: %zu", deletions.pending());
+}
+
+// each thing draws the coarsest level that's still within lodError pixels of full detail
+void appvk::selectLods() {
+    // pixels covered by an object space unit one unit away, which falls off linearly with distance
+    const float pixelsPerUnit = swapExtent.height / (2.0f * std::tan(0.5f * glm::radians(fovDegrees)));
+
+    std::vector<float> errors;
+    for (thing& t : things) {
+        errors.clear();
+        for (const mesh& m : t.lods) {
+            errors.push_back(m.error);
+        }
+
+        // the nearest point of the bounds, since that's where the error shows most
+        const glm::vec4 sphere = t.lods[0].sphere;
+        const glm::vec3 center = t.model * glm::vec4(glm::vec3(sphere), 1.0f);
+        const float distance = std::max(glm::length(center - c.pos) - sphere.w, 0.1f); // near plane
+
+        t.lod = lod::select(errors, pixelsPerUnit / distance, options::get().lodError, t.lod);
+    }
+}
+
 void appvk::updateFrame(uint32_t imageIndex) {
+    PROF_ZONE("updateFrame");
+
+    memory.update();
+
     ubo u;
     // u.model = glm::mat4(1.0f);
-    u.model = glm::rotate(glm::mat4(1.0f), glm::radians((float)glfwGetTime() * 20), glm::vec3(1.0f));
+    u.model = glm::rotate(glm::mat4(1.0f), glm::radians((float)animTime * 20), glm::vec3(1.0f));
     u.view = glm::lookAt(c.pos, c.pos + c.front, glm::vec3(0.0f, 1.0f, 0.0f));
-    u.proj = glm::perspective(glm::radians(25.0f), swapExtent.width / float(swapExtent.height), 0.1f, 100.0f);
+    u.proj = glm::perspective(glm::radians(fovDegrees), swapExtent.width / float(swapExtent.height), 0.1f, 100.0f);
+    if (aa == aaMode::taa) {
+        jitterProjection(u.proj, u.view);
+    }
+
+    t.model = u.model;
+    cullViewProj = u.proj * u.view;
 
     void* data;
     vkMapMemory(dev, t.ubos.mem, imageIndex * t.ubos.elemSize, sizeof(ubo), 0, &data);
@@ -47,11 +166,16 @@ void appvk::updateFrame(uint32_t imageIndex) {
     vkUnmapMemory(dev, t.ubos.mem);
 
     u.model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+    flr.model = u.model;
+
+    selectLods();
 
     vkMapMemory(dev, flr.ubos.mem, imageIndex * t.ubos.elemSize, sizeof(ubo), 0, &data);
     memcpy(data, &u, sizeof(ubo));
     vkUnmapMemory(dev, flr.ubos.mem);
 
+    PROF_ZONE("imgui");
+
     ImGui_ImplVulkan_NewFrame();
 	ImGui_ImplGlfw_NewFrame();
 	ImGui::NewFrame();
@@ -64,9 +188,48 @@ void appvk::updateFrame(uint32_t imageIndex) {
     	float time = duration<float, seconds::period>(current - last).count();
     	last = current;
 
-		ImGui::Text("screen dimensions: %dx%d", options::screenWidth, options::screenHeight);
-		ImGui::Text("msaa samples: %d", options::msaaSamples);
+		ImGui::Text("screen dimensions: %ux%u", swapExtent.width, swapExtent.height);
+		if (postAA()) {
+			ImGui::Text("anti-aliasing: %s", aa == aaMode::fxaa ? "fxaa" : "taa");
+		} else {
+			ImGui::Text("msaa samples: %d", int(msaaSamples)); // sample count bits are the count itself
+		}
+		ImGui::Text("frame graph: %zu passes (%zu culled), %.1f MiB transient (%.1f MiB unaliased)",
+			frameGraph.passCount(), frameGraph.culledCount(),
+			frameGraph.transientBytes() / 1048576.0, frameGraph.unaliasedBytes() / 1048576.0);
+		if (frameGraph.lazyBytes() > 0) {
+			ImGui::Text("lazily allocated: %.1f MiB (%.1f MiB committed)",
+				frameGraph.lazyBytes() / 1048576.0, frameGraph.committedLazyBytes() / 1048576.0);
+		}
 		ImGui::Text("frame time: %.2f ms (%.2f fps)", time * 1000, 1.0f / time);
+		ImGui::Text("gpu time: %.2f ms", gpuFrameMs);
+		ImGui::Text("fence wait: %.2f ms", fenceWaitMs);
+		uint32_t submitted = 0, available = 0;
+		for (const thing& t : things) {
+			submitted += t.drawn().triangles;
+			available += t.lods[0].triangles;
+		}
+		ImGui::Text("lod triangles: %u / %u (levels %u/%zu, %u/%zu)", submitted, available,
+			t.lod, t.lods.size() - 1, flr.lod, flr.lods.size() - 1);
+		if (gpuCulling) {
+			ImGui::Text("gpu culling: %u meshlets, %s", arenaMeshletRanges.used(),
+				drawIndirectCountSupported ? "compacted draws" : "culled draws zeroed");
+		} else {
+			ImGui::Text("gpu culling: off");
+		}
+		if (virtualTextures) {
+			ImGui::Text("virtual textures: %u / %u pages resident, %u loading", vtPages.resident(), vtPages.slots(), vtPages.inFlight());
+		} else {
+			ImGui::Text("virtual textures: off");
+		}
+		if (size_t n = pipelines.pending(); n > 0) {
+			ImGui::Text("compiling %zu pipelines", n);
+		}
+		if (assetsPending > 0) {
+			ImGui::Text("loading %zu assets", assetsPending);
+		}
+
+		drawProfilerUI();
 		ImGui::Text("camera pos: (%.2f, %.2f, %.2f)", c.pos.x, c.pos.y, c.pos.z);
 	}
 
@@ -1,32 +1,22 @@
 #include "extensions.hpp"
 #include "main.hpp"
 
+#include "json.hpp"
+#include "options.hpp"
+
+#include <algorithm>
+#include <cctype>
 #include <fstream>
+#include <iomanip>
 #include <string>
 
-std::vector<char> appvk::readFile(std::string_view path) {
-    std::ifstream file(path.data(), std::ios::ate | std::ios::binary);
+VkShaderModule appvk::createShaderModule(const std::vector<uint32_t>& code) {
+    PROF_ZONE("createShaderModule");
 
-    if (!file) {
-        throw std::runtime_error(std::string("cannot open file ") + path.data() + "!");
-    }
-    
-    size_t len = static_cast<size_t>(file.tellg());
-    file.seekg(0);
-    
-    std::vector<char> contents(len); // using vector of char because spir-v isn't a string
-    file.read(contents.data(), len);
-    
-    file.close();
-
-    return contents;
-}
-
-VkShaderModule appvk::createShaderModule(const std::vector<char>& spv) {
     VkShaderModuleCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = spv.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(spv.data());
+    createInfo.codeSize = code.size() * sizeof(uint32_t);
+    createInfo.pCode = code.data();
 
     VkShaderModule mod;
     if (vkCreateShaderModule(dev, &createInfo, nullptr, &mod) != VK_SUCCESS) {
@@ -35,12 +25,65 @@ VkShaderModule appvk::createShaderModule(const std::vector<char>& spv) {
     return mod;
 }
 
-void appvk::printShaderStats(const VkPipeline& printPipe) {
+// driver statistic names aren't standardized, so summary values are found by name
+namespace {
+    enum class statKind { registers, spills, instructions };
+
+    std::string lower(std::string_view s) {
+        std::string l(s);
+        std::transform(l.begin(), l.end(), l.begin(), [](unsigned char c) { return std::tolower(c); });
+        return l;
+    }
+
+    // returns -1 if the driver doesn't report anything that looks like kind
+    double summarize(const std::vector<std::pair<std::string, double>>& stats, statKind kind) {
+        double sum = 0.0;
+        bool found = false;
+
+        for (const auto& [name, value] : stats) {
+            const std::string l = lower(name);
+            const bool spill = l.find("spill") != std::string::npos;
+
+            bool match = false;
+            switch (kind) {
+                case statKind::registers: // e.g. "SGPRs" + "VGPRs" on radv, "Register Count" on nvidia
+                    match = !spill && (l.find("gpr") != std::string::npos || l.find("register") != std::string::npos);
+                    break;
+                case statKind::spills: // "Spilled VGPRs" on radv, "Spill Count" on anv
+                    match = spill;
+                    break;
+                case statKind::instructions:
+                    match = l.find("instruction") != std::string::npos;
+                    break;
+            }
+
+            if (match) {
+                sum += value;
+                found = true;
+            }
+        }
+
+        return found ? sum : -1.0;
+    }
+}
+
+void appvk::collectShaderStats(VkPipeline pipe, std::string_view name) {
+    if (!captureShaderStats) {
+        return;
+    }
+
+    // pipelines are recreated along with the swapchain, only report the first one
+    for (const auto& r : shaderReports) {
+        if (r.pipeline == name) {
+            return;
+        }
+    }
+
     VkPipelineInfoKHR pipeInfo{};
     pipeInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INFO_KHR;
-    pipeInfo.pipeline = printPipe;
+    pipeInfo.pipeline = pipe;
 
-    unsigned int numShaders;
+    uint32_t numShaders;
     if (GetPipelineExecutablePropertiesKHR(dev, &pipeInfo, &numShaders, nullptr) != VK_SUCCESS) {
         throw std::runtime_error("cannot get shader statistics!");
     }
@@ -51,45 +94,146 @@ void appvk::printShaderStats(const VkPipeline& printPipe) {
         prop.sType = VK_STRUCTURE_TYPE_PIPELINE_EXECUTABLE_PROPERTIES_KHR;
     }
     GetPipelineExecutablePropertiesKHR(dev, &pipeInfo, &numShaders, shaderProps.data());
-    
-    VkPipelineExecutableInfoKHR shaderInfo{};
-    shaderInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_EXECUTABLE_INFO_KHR;
-    shaderInfo.pipeline = printPipe;
-    
-    unsigned int numStats;
-    GetPipelineExecutableStatisticsKHR(dev, &shaderInfo, &numStats, nullptr);
-    std::vector<VkPipelineExecutableStatisticKHR> shaderStats(numStats);
-    for (auto& stat : shaderStats) {
-        stat.sType = VK_STRUCTURE_TYPE_PIPELINE_EXECUTABLE_STATISTIC_KHR;
-    }
-    
-    for (size_t i = 0; i < numShaders; i++) {
+
+    for (uint32_t i = 0; i < numShaders; i++) {
+        VkPipelineExecutableInfoKHR shaderInfo{};
+        shaderInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_EXECUTABLE_INFO_KHR;
+        shaderInfo.pipeline = pipe;
+        shaderInfo.executableIndex = i;
+
+        uint32_t numStats;
+        GetPipelineExecutableStatisticsKHR(dev, &shaderInfo, &numStats, nullptr);
+        std::vector<VkPipelineExecutableStatisticKHR> shaderStats(numStats);
+        for (auto& stat : shaderStats) {
+            stat.sType = VK_STRUCTURE_TYPE_PIPELINE_EXECUTABLE_STATISTIC_KHR;
+        }
         GetPipelineExecutableStatisticsKHR(dev, &shaderInfo, &numStats, shaderStats.data());
 
-        cout << shaderProps[i].name << " statistics:\n";
-        
-        for (auto stat : shaderStats) {
-            cout << "  ~ " << stat.name << " = ";
+        shaderReport r;
+        r.pipeline = name;
+        r.executable = shaderProps[i].name;
+        r.subgroupSize = shaderProps[i].subgroupSize;
+
+        for (const auto& stat : shaderStats) {
+            double value;
             switch (stat.format) {
                 case VK_PIPELINE_EXECUTABLE_STATISTIC_FORMAT_BOOL32_KHR:
-                    cout << stat.value.b32;
+                    value = stat.value.b32;
                     break;
                 case VK_PIPELINE_EXECUTABLE_STATISTIC_FORMAT_INT64_KHR:
-                    cout << stat.value.i64;
+                    value = stat.value.i64;
                     break;
                 case VK_PIPELINE_EXECUTABLE_STATISTIC_FORMAT_UINT64_KHR:
-                    cout << stat.value.u64;
+                    value = stat.value.u64;
                     break;
                 case VK_PIPELINE_EXECUTABLE_STATISTIC_FORMAT_FLOAT64_KHR:
-                    cout << stat.value.f64;
+                    value = stat.value.f64;
                     break;
                 default:
-                    break;
+                    continue;
             }
-            cout << "\n";
+            r.stats.emplace_back(stat.name, value);
         }
 
-        cout << "  ~ Subgroup Size: " << shaderProps[i].subgroupSize << "\n";
-        shaderInfo.executableIndex++;
+        r.registers = summarize(r.stats, statKind::registers);
+        r.spills = summarize(r.stats, statKind::spills);
+        r.instructions = summarize(r.stats, statKind::instructions);
+
+        shaderReports.push_back(std::move(r));
     }
-}
\ No newline at end of file
+}
+
+// write every collected report as json, then compare against a baseline from an earlier build if given
+void appvk::reportShaderStats() {
+    const options::settings& cfg = options::get();
+
+    for (const auto& r : shaderReports) {
+        cout << r.pipeline << " / " << r.executable << ": " << r.registers << " registers, " << r.spills << " spills, "
+            << r.instructions << " instructions, subgroup size " << r.subgroupSize << "\n";
+    }
+
+    if (!cfg.shaderStats.empty()) {
+        std::ofstream out(cfg.shaderStats);
+        if (!out) {
+            throw std::runtime_error("cannot write shader statistics to " + cfg.shaderStats + "!");
+        }
+
+        VkPhysicalDeviceProperties dprop;
+        vkGetPhysicalDeviceProperties(pdev, &dprop);
+
+        out << "{\n  \"device\": ";
+        json::quote(out, dprop.deviceName);
+        out << ",\n  \"driverVersion\": " << dprop.driverVersion << ",\n  \"executables\": [";
+
+        for (size_t i = 0; i < shaderReports.size(); i++) {
+            const auto& r = shaderReports[i];
+            out << (i ? "," : "") << "\n    {\n      \"pipeline\": ";
+            json::quote(out, r.pipeline);
+            out << ",\n      \"executable\": ";
+            json::quote(out, r.executable);
+            out << ",\n      \"subgroupSize\": " << r.subgroupSize
+                << ",\n      \"registers\": " << r.registers
+                << ",\n      \"spills\": " << r.spills
+                << ",\n      \"instructions\": " << r.instructions
+                << ",\n      \"stats\": {";
+
+            for (size_t j = 0; j < r.stats.size(); j++) {
+                out << (j ? "," : "") << "\n        ";
+                json::quote(out, r.stats[j].first);
+                out << ": " << r.stats[j].second;
+            }
+            out << "\n      }\n    }";
+        }
+        out << "\n  ]\n}\n";
+
+        cout << "wrote shader statistics to " << cfg.shaderStats << "\n";
+    }
+
+    if (cfg.shaderBaseline.empty()) {
+        return;
+    }
+
+    const json::value base = json::parseFile(cfg.shaderBaseline);
+
+    // any growth in registers or spills counts, instruction counts are allowed a little noise
+    constexpr double instructionTolerance = 0.02;
+
+    auto check = [&](const shaderReport& r, const char* what, double before, double after, double tolerance) {
+        if (before < 0.0 || after < 0.0 || after <= before * (1.0 + tolerance)) {
+            return;
+        }
+        cout << "shader regression: " << r.pipeline << " / " << r.executable << " " << what << " " << before << " -> " << after;
+        if (before > 0.0) {
+            cout << " (+" << std::fixed << std::setprecision(1) << 100.0 * (after - before) / before << "%)" << std::defaultfloat;
+        }
+        cout << "\n";
+        shaderRegression = true;
+    };
+
+    for (const auto& r : shaderReports) {
+        const json::value* prev = nullptr;
+        for (const auto& e : base["executables"].arr) {
+            if (e["pipeline"].str() == r.pipeline && e["executable"].str() == r.executable) {
+                prev = &e;
+                break;
+            }
+        }
+
+        if (prev == nullptr) {
+            cout << "no baseline for " << r.pipeline << " / " << r.executable << "\n";
+            continue;
+        }
+
+        check(r, "registers", (*prev)["registers"].num(-1.0), r.registers, 0.0);
+        check(r, "spills", (*prev)["spills"].num(-1.0), r.spills, 0.0);
+        check(r, "instructions", (*prev)["instructions"].num(-1.0), r.instructions, instructionTolerance);
+
+        if ((*prev)["subgroupSize"].num() != r.subgroupSize) {
+            cout << "subgroup size changed for " << r.pipeline << " / " << r.executable << "\n";
+        }
+    }
+
+    if (!shaderRegression) {
+        cout << "no shader regressions against " << cfg.shaderBaseline << "\n";
+    }
+}
@@ -0,0 +1,63 @@
+#include "spv.hpp"
+
+#include "cpuprof.hpp"
+
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace spv {
+    namespace {
+        struct entry {
+            std::string_view path;
+            const uint32_t* code;
+            size_t size;
+        };
+
+#ifdef EMBED_SPV
+#include "embedded.hpp" // generated into .spv/ by shader/makefile, defines embeddedShaders[]
+#else
+        constexpr entry embeddedShaders[] = { { "", nullptr, 0 } };
+#endif
+
+        constexpr uint32_t magic = 0x07230203;
+    }
+
+    blob embedded(std::string_view path) {
+        for (const auto& e : embeddedShaders) {
+            if (e.code != nullptr && e.path == path) {
+                return { e.code, e.size };
+            }
+        }
+        return {};
+    }
+
+    std::vector<uint32_t> load(std::string_view path, bool allowEmbedded) {
+        if (allowEmbedded) {
+            const blob b = embedded(path);
+            if (b.code != nullptr) {
+                return std::vector<uint32_t>(b.code, b.code + b.size / sizeof(uint32_t));
+            }
+        }
+
+        PROF_ZONE("read spv");
+
+        std::ifstream file(std::string(path), std::ios::ate | std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("cannot open file " + std::string(path) + "!");
+        }
+
+        const size_t size = static_cast<size_t>(file.tellg());
+        file.seekg(0);
+
+        std::vector<uint32_t> code(size / sizeof(uint32_t));
+        file.read(reinterpret_cast<char*>(code.data()), code.size() * sizeof(uint32_t));
+
+        // a shader caught halfway through being rewritten shouldn't make it to the driver
+        if (!file || size % sizeof(uint32_t) != 0 || code.empty() || code[0] != magic) {
+            throw std::runtime_error("invalid spir-v in " + std::string(path) + "!");
+        }
+
+        return code;
+    }
+}
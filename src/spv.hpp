@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// SPIR-V loading. Builds made with EMBED_SPV=1 carry optimised copies of every shader in .spv/,
+// so startup does no file io for shaders and doesn't depend on the working directory.
+namespace spv {
+    struct blob {
+        const uint32_t* code = nullptr;
+        size_t size = 0; // bytes
+    };
+
+    // the embedded copy of path (e.g. ".spv/shader.vert.spv"), empty if there isn't one
+    blob embedded(std::string_view path);
+
+    // the embedded copy if allowed and present, otherwise read from disk
+    // throws if neither exists or the result isn't spir-v
+    std::vector<uint32_t> load(std::string_view path, bool allowEmbedded = true);
+}
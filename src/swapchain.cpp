@@ -46,13 +46,26 @@ VkSurfaceFormatKHR appvk::chooseSwapSurfaceFormat(const std::vector<VkSurfaceFor
 }
 
 VkPresentModeKHR appvk::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& modeList) {
+    const std::string& name = options::get().presentMode;
+
+    VkPresentModeKHR want = VK_PRESENT_MODE_FIFO_KHR;
+    if (name == "mailbox") { // triple buffer
+        want = VK_PRESENT_MODE_MAILBOX_KHR;
+    } else if (name == "immediate") {
+        want = VK_PRESENT_MODE_IMMEDIATE_KHR;
+    } else if (name == "fifo_relaxed") {
+        want = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+    } else if (name != "fifo") {
+        cerr << "unknown present mode " << name << ", using fifo\n";
+    }
+
     for (const auto& mode : modeList) {
-        if (mode == VK_PRESENT_MODE_MAILBOX_KHR) { // triple buffer if possible
+        if (mode == want) {
             return mode;
         }
     }
 
-    return VK_PRESENT_MODE_FIFO_KHR;
+    return VK_PRESENT_MODE_FIFO_KHR; // always supported
 }
 
 VkExtent2D appvk::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& cap) {
@@ -61,16 +74,19 @@ VkExtent2D appvk::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& cap) {
     } else {
         VkExtent2D newV;
         // clamp width and height to [min, max] extent height
-        
-        glfwGetFramebufferSize(w, (int*)&options::screenWidth, (int*)&options::screenHeight);
-        
-        newV.width = std::max(cap.minImageExtent.width, std::min(cap.maxImageExtent.width, static_cast<uint32_t>(options::screenWidth)));
-        newV.height = std::max(cap.minImageExtent.height, std::min(cap.minImageExtent.height, static_cast<uint32_t>(options::screenHeight)));
+
+        int width, height;
+        glfwGetFramebufferSize(w, &width, &height);
+
+        newV.width = std::max(cap.minImageExtent.width, std::min(cap.maxImageExtent.width, static_cast<uint32_t>(width)));
+        newV.height = std::max(cap.minImageExtent.height, std::min(cap.maxImageExtent.height, static_cast<uint32_t>(height)));
         return newV;
     }
 }
 
 void appvk::createSwapChain() {
+    PROF_ZONE("createSwapChain");
+
     swapChainSupportDetails sdet = querySwapChainSupport(pdev);
 
     VkSurfaceFormatKHR f = chooseSwapSurfaceFormat(sdet.formats);
@@ -119,8 +135,9 @@ void appvk::createSwapViews() {
 }
 
 void appvk::cleanupSwapChain() {
+    PROF_ZONE("cleanupSwapChain");
 
-    for (unsigned int i = 0; i < options::framesInFlight; i++){
+    for (unsigned int i = 0; i < options::get().framesInFlight; i++){
         vkDestroySemaphore(dev, imageAvailSems[i], nullptr);
         vkDestroySemaphore(dev, renderDoneSems[i], nullptr);
         vkDestroyFence(dev, inFlightFences[i], nullptr);
@@ -128,24 +145,19 @@ void appvk::cleanupSwapChain() {
 
     vkFreeCommandBuffers(dev, cp, commandBuffers.size(), commandBuffers.data());
 
-    vkDestroyImageView(dev, depth.view, nullptr);
-    vkDestroyImage(dev, depth.im, nullptr);
-    vkFreeMemory(dev, depth.mem, nullptr);
+    frameGraph.reset();
 
-    vkDestroyImageView(dev, ms.view, nullptr);
-    vkDestroyImage(dev, ms.im, nullptr);
-    vkFreeMemory(dev, ms.mem, nullptr);
+    if (postAA()) {
+        destroyPostImages();
+    }
 
     for (thing& t : things) {
         for (VkBuffer buf : t.ubos.bufs) {
             vkDestroyBuffer(dev, buf, nullptr);
         }
 
-        vkFreeMemory(dev, t.ubos.mem, nullptr);
+        memory.free(dev, t.ubos.mem);
         t.ubos.mem = VK_NULL_HANDLE;
-
-        vkDestroyPipeline(dev, t.pipe, nullptr);
-        vkDestroyPipelineLayout(dev, t.pipeLayout, nullptr);
     }
 
     vkDestroyDescriptorPool(dev, dPool, nullptr);
@@ -155,8 +167,6 @@ void appvk::cleanupSwapChain() {
         vkDestroyFramebuffer(dev, framebuffer, nullptr);
     }
 
-    vkDestroyRenderPass(dev, renderPass, nullptr);
-    
     for (const auto& view : swapImageViews) {
         vkDestroyImageView(dev, view, nullptr);
     }
@@ -15,6 +15,7 @@ void imguiCheck(VkResult r) {
 
 // seperate from generic ui init so we only rebuild the vulkan part on a window resize
 void appvk::initVulkanUI() {	
+	PROF_ZONE("initVulkanUI");
 
 	// creating a whole new pool of descriptors for imgui
     // (not sure what these correspond to, but set up in example vulkan code...) 
@@ -54,10 +55,10 @@ void appvk::initVulkanUI() {
     initInfo.DescriptorPool = uiPool;
     initInfo.Allocator = nullptr;
     initInfo.MinImageCount = 2;
-    initInfo.ImageCount = options::framesInFlight;
-	initInfo.MSAASamples = getSamples(options::msaaSamples);
+    initInfo.ImageCount = swapImages.size();
+	initInfo.MSAASamples = msaaSamples;
     initInfo.CheckVkResultFn = imguiCheck;
-    ImGui_ImplVulkan_Init(&initInfo, renderPass);
+    ImGui_ImplVulkan_Init(&initInfo, postAA() ? postPass : renderPass); // ui is drawn after post aa
 
     VkCommandBuffer font = beginSingleCommand();
     ImGui_ImplVulkan_CreateFontsTexture(font);
@@ -3,12 +3,12 @@
 void appvk::createUniformBuffers() {
     for (thing& t : things) {
         t.ubos = createBuffers(sizeof(ubo), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, swapImages.size());
+            mem::preset::dynamic, swapImages.size(), mem::category::ubo);
     }
 }
 
 void appvk::createDescriptorSetLayout() {
-    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+    std::array<VkDescriptorSetLayoutBinding, 4> bindings = {};
 
     bindings[0].binding = 0;
     bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
@@ -21,9 +21,21 @@ void appvk::createDescriptorSetLayout() {
     bindings[1].descriptorCount = t.maps.size(); // descriptors for different kinds of maps
     bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
+    // with virtual textures every map comes out of the one cache, through the page table, and feedback goes back
+    if (virtualTextures) {
+        bindings[1].descriptorCount = 1;
+
+        for (uint32_t i = 2; i < 4; i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        }
+    }
+
     VkDescriptorSetLayoutCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    createInfo.bindingCount = bindings.size();
+    createInfo.bindingCount = virtualTextures ? 4 : 2;
     createInfo.pBindings = bindings.data();
 
     if (vkCreateDescriptorSetLayout(dev, &createInfo, nullptr, &t.layout) != VK_SUCCESS) {
@@ -36,7 +48,7 @@ void appvk::createDescriptorSetLayout() {
 }
 
 void appvk::createDescriptorPool() {
-    std::array<VkDescriptorPoolSize, 2> poolSizes;
+    std::array<VkDescriptorPoolSize, 3> poolSizes;
 
     // reserve worst-case pool memory
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
@@ -45,6 +57,9 @@ void appvk::createDescriptorPool() {
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     poolSizes[1].descriptorCount = things.size() * t.maps.size() * swapImages.size();
 
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER; // virtual texture page table and feedback
+    poolSizes[2].descriptorCount = things.size() * 2 * swapImages.size();
+
     VkDescriptorPoolCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     createInfo.maxSets = swapImages.size() * things.size();
@@ -109,4 +124,38 @@ void appvk::allocDescriptorSetTexture(thing& t, texture tex, size_t index) {
 
         vkUpdateDescriptorSets(dev, 1, &set, 0, nullptr);
     }
-}
\ No newline at end of file
+}
+
+void appvk::allocDescriptorSetVirtual(thing& t) {
+    for (size_t i = 0; i < swapImages.size(); i++) {
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.sampler = vtSampler;
+        imageInfo.imageView = vtCache.view;
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        std::array<VkDescriptorBufferInfo, 2> bufferInfos = {};
+        bufferInfos[0].buffer = vtTable.buf;
+        bufferInfos[0].range = VK_WHOLE_SIZE;
+        bufferInfos[1].buffer = vtFeedback.buf;
+        bufferInfos[1].range = VK_WHOLE_SIZE;
+
+        std::array<VkWriteDescriptorSet, 3> sets = {};
+        for (auto& set : sets) {
+            set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            set.dstSet = t.dsets[i];
+            set.descriptorCount = 1;
+        }
+
+        sets[0].dstBinding = 1;
+        sets[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        sets[0].pImageInfo = &imageInfo;
+
+        for (uint32_t b = 0; b < 2; b++) {
+            sets[b + 1].dstBinding = b + 2;
+            sets[b + 1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            sets[b + 1].pBufferInfo = &bufferInfos[b];
+        }
+
+        vkUpdateDescriptorSets(dev, sets.size(), sets.data(), 0, nullptr);
+    }
+}
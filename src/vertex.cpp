@@ -0,0 +1,58 @@
+#include "vertex.hpp"
+
+#include <glm/common.hpp>
+#include <glm/packing.hpp>
+
+#include <cmath>
+#include <cstring>
+
+namespace vtx {
+    namespace {
+        // vformat::vertex as the pipeline used to fetch it, every member padded to 16 bytes
+        struct loaded {
+            alignas(16) glm::vec3 position;
+            alignas(16) glm::vec3 normal;
+            alignas(16) glm::vec2 uv;
+            alignas(16) glm::vec3 tangent;
+        };
+        static_assert(sizeof(loaded) == sizeof(vformat::vertex));
+
+        // fold the octahedron's lower half over the upper one and flatten it onto [-1, 1]^2,
+        // shader.vert undoes this
+        oct16 octEncode(glm::vec3 n) {
+            const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+            if (l1 == 0.0f) {
+                return { glm::packSnorm2x16(glm::vec2(0.0f)) }; // decodes to +z rather than nan
+            }
+            n /= l1;
+
+            glm::vec2 p(n.x, n.y);
+            if (n.z < 0.0f) {
+                const glm::vec2 signs(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+                p = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * signs;
+            }
+            return { glm::packSnorm2x16(p) };
+        }
+    }
+
+    packed pack(const glm::vec3& position, const glm::vec3& normal, const glm::vec2& uv, const glm::vec3& tangent) {
+        packed out;
+        out.position = position;
+        out.normal = octEncode(normal);
+        out.uv = { glm::packHalf2x16(uv) };
+        out.tangent = octEncode(tangent);
+        return out;
+    }
+
+    std::vector<packed> pack(const std::vector<vformat::vertex>& verts) {
+        std::vector<packed> out(verts.size());
+
+        for (size_t i = 0; i < verts.size(); i++) {
+            loaded v;
+            memcpy(&v, &verts[i], sizeof(loaded));
+            out[i] = pack(v.position, v.normal, v.uv, v.tangent);
+        }
+
+        return out;
+    }
+}
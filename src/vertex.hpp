@@ -0,0 +1,83 @@
+#pragma once
+
+#include "glfw_wrapper.hpp"
+#include "glm_mat_wrapper.hpp"
+#include "vformat.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compact vertex formats. Meshes come out of the loader as vformat::vertex, which pads every member
+// to 16 bytes for 64 bytes a vertex, and are quantised at load time into something a third the size.
+// A layout lists a vertex's member types in order, and the attribute descriptions are generated from it.
+namespace vtx {
+    // fetched as float vectors, so the shader doesn't care which of these it gets
+    struct half2 { uint32_t xy; }; // two halves
+    struct oct16 { uint32_t xy; }; // a unit vector as two octahedral snorm16s, decoded in the shader
+
+    // the format each member type is fetched with
+    template <typename T> struct format;
+    template <> struct format<glm::vec3> { static constexpr VkFormat value = VK_FORMAT_R32G32B32_SFLOAT; };
+    template <> struct format<glm::vec2> { static constexpr VkFormat value = VK_FORMAT_R32G32_SFLOAT; };
+    template <> struct format<half2> { static constexpr VkFormat value = VK_FORMAT_R16G16_SFLOAT; };
+    template <> struct format<oct16> { static constexpr VkFormat value = VK_FORMAT_R16G16_SNORM; };
+
+    // members are placed the way a struct would place them, location i is the i-th type
+    template <typename... Ts>
+    struct layout {
+        static constexpr uint32_t count = sizeof...(Ts);
+
+        static constexpr std::array<uint32_t, count> offsets = [] {
+            std::array<uint32_t, count> o{};
+            uint32_t at = 0;
+            size_t i = 0;
+            ((at = (at + alignof(Ts) - 1) / alignof(Ts) * alignof(Ts), o[i++] = at, at += sizeof(Ts)), ...);
+            return o;
+        }();
+
+        static constexpr uint32_t stride = [] {
+            uint32_t at = 0;
+            ((at = (at + alignof(Ts) - 1) / alignof(Ts) * alignof(Ts) + sizeof(Ts)), ...);
+            constexpr uint32_t align = std::max({ uint32_t(alignof(Ts))... });
+            return (at + align - 1) / align * align;
+        }();
+
+        static std::array<VkVertexInputAttributeDescription, count> attributes(uint32_t binding) {
+            constexpr std::array<VkFormat, count> formats = { format<Ts>::value... };
+
+            std::array<VkVertexInputAttributeDescription, count> a{};
+            for (uint32_t i = 0; i < count; i++) {
+                a[i].location = i;
+                a[i].binding = binding;
+                a[i].format = formats[i];
+                a[i].offset = offsets[i];
+            }
+            return a;
+        }
+    };
+
+    // 24 bytes. positions stay float, half is only good to about 1/1000 of a unit near the origin
+    struct packed {
+        glm::vec3 position;
+        oct16 normal;
+        half2 uv;
+        oct16 tangent;
+
+        using layout = vtx::layout<glm::vec3, oct16, half2, oct16>;
+    };
+
+    static_assert(sizeof(packed) == packed::layout::stride);
+    static_assert(offsetof(packed, position) == 0);
+    static_assert(offsetof(packed, normal) == packed::layout::offsets[1]);
+    static_assert(offsetof(packed, uv) == packed::layout::offsets[2]);
+    static_assert(offsetof(packed, tangent) == packed::layout::offsets[3]);
+
+    // quantise a loaded mesh
+    std::vector<packed> pack(const std::vector<vformat::vertex>& verts);
+
+    // or a single vertex, for meshes made in code
+    packed pack(const glm::vec3& position, const glm::vec3& normal, const glm::vec2& uv, const glm::vec3& tangent);
+}
@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+#include "main.hpp"
+
+#include "options.hpp"
+
+// virtual texturing: the scene's pixels record which pages they wanted in a feedback bitset, a frame in flight later
+// that's read back and the missing pages are read from their tile files on the job pool, straight into staging.
+// pages that arrived are copied into the cache and the page table at the start of the next frame recorded
+
+namespace {
+    constexpr VkDeviceSize feedbackBytes = vt::maxPages / 8;
+    constexpr VkDeviceSize tableBytes = sizeof(vt::textureInfo) * vt::maxTextures + VkDeviceSize(vt::maxPages) * sizeof(uint32_t);
+    constexpr uint32_t maxSlotsPerSide = 4096; // 12 bits each way in a page table entry
+}
+
+void appvk::createVirtualTextures() {
+    PROF_ZONE("createVirtualTextures");
+
+    if (!virtualTextures) {
+        return;
+    }
+
+    VkPhysicalDeviceProperties prop;
+    vkGetPhysicalDeviceProperties(pdev, &prop);
+
+    // a square of slots within the budget, no bigger than an image can be
+    const double slotBytes = double(vt::slotSize) * vt::slotSize * 4;
+    const uint32_t fits = uint32_t(std::sqrt(options::get().vtCacheMiB * 1048576.0 / slotBytes));
+    const uint32_t side = std::clamp(fits, 1u, std::min(prop.limits.maxImageDimension2D / vt::slotSize, maxSlotsPerSide));
+    vtPages.init(side, side);
+
+    const uint32_t size = side * vt::slotSize;
+    vtCache = createImage(size, size, VK_FORMAT_R8G8B8A8_SRGB, 1, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, mem::preset::gpuOnly, mem::category::texture);
+    vtCache.view = createImageView(vtCache.im, VK_FORMAT_R8G8B8A8_SRGB, 1, VK_IMAGE_ASPECT_COLOR_BIT);
+
+    // the layout the frame graph imports it in. slots are garbage until a page is copied in, but nothing points at them
+    transitionImageLayout(vtCache, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    transitionImageLayout(vtCache, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    // pages carry their own mips as separate pages, and the border keeps anisotropic taps inside the slot
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.anisotropyEnable = VK_TRUE;
+    samplerInfo.maxAnisotropy = std::min(8.0f, prop.limits.maxSamplerAnisotropy); // maxAniso in shader.frag
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = 0.0f;
+
+    if (vkCreateSampler(dev, &samplerInfo, nullptr, &vtSampler) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create virtual texture sampler!");
+    }
+
+    // updated from the frame's command buffer, so in vram even with resizable bar
+    vtTable = createBuffer(tableBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        mem::preset::gpuOnly, mem::category::texture);
+    vtFeedback = createBuffer(feedbackBytes,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        mem::preset::gpuOnly, mem::category::texture);
+
+    const VkDeviceSize readbackBytes = feedbackBytes * options::get().framesInFlight;
+    vtReadback = createBuffer(readbackBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT, mem::preset::readback, mem::category::staging);
+    void* p;
+    vkMapMemory(dev, vtReadback.mem, 0, readbackBytes, 0, &p);
+    std::memset(p, 0, readbackBytes); // the first frames have nothing to read back yet
+    vtReadbackMap = static_cast<const uint32_t*>(p);
+
+    const VkDeviceSize stagingBytes = VkDeviceSize(vtStagingTiles) * vt::tileStride;
+    vtStaging = createBuffer(stagingBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, mem::preset::staging, mem::category::staging);
+    vkMapMemory(dev, vtStaging.mem, 0, stagingBytes, 0, &p);
+    vtStagingMap = static_cast<uint8_t*>(p);
+    vtStagingIndex = files.registerBuffer(vtStagingMap, stagingBytes);
+
+    for (uint32_t i = vtStagingTiles; i-- > 0;) {
+        vtFreeStaging.push_back(i);
+    }
+
+    // nothing resident and nothing asked for
+    VkCommandBuffer cbuf = beginSingleCommand();
+    vkCmdFillBuffer(cbuf, vtTable.buf, 0, VK_WHOLE_SIZE, 0);
+    vkCmdFillBuffer(cbuf, vtFeedback.buf, 0, VK_WHOLE_SIZE, 0);
+    endSingleCommand(cbuf);
+
+    cout << "virtual texture cache of " << side << "x" << side << " pages, " << size << "x" << size << " texels\n";
+}
+
+void appvk::destroyVirtualTextures() {
+    if (!virtualTextures) {
+        return;
+    }
+
+    // reads still going write into staging
+    try {
+        jobs.wait(vtLoads);
+    } catch (const std::exception&) {
+        // shutting down anyway
+    }
+    vtLoaded.take();
+    vtFiles.clear();
+
+    vkDestroySampler(dev, vtSampler, nullptr);
+    vkDestroyImageView(dev, vtCache.view, nullptr);
+    vkDestroyImage(dev, vtCache.im, nullptr);
+    memory.free(dev, vtCache.mem);
+
+    vkUnmapMemory(dev, vtStaging.mem);
+    vkUnmapMemory(dev, vtReadback.mem);
+
+    for (buffer* b : { &vtTable, &vtFeedback, &vtReadback, &vtStaging }) {
+        vkDestroyBuffer(dev, b->buf, nullptr);
+        memory.free(dev, b->mem);
+    }
+}
+
+// after integrateAssets, so textures that just arrived are asked for this frame
+void appvk::updateVirtualTextures() {
+    PROF_ZONE("updateVirtualTextures");
+
+    if (!virtualTextures) {
+        return;
+    }
+
+    // written by the last frame to use this slot, whose fence has signalled
+    const uint32_t* feedback = vtReadbackMap + currFrame * (feedbackBytes / sizeof(uint32_t));
+    const std::vector<uint32_t> missing = vtPages.use(feedback, frameNumber);
+    vtMissing = missing.size();
+
+    for (const tileLoad& l : vtLoaded.take()) {
+        const std::optional<uint32_t> slot = vtPages.place(l.page, frameNumber);
+        if (!slot) {
+            vtFreeStaging.push_back(l.staging);
+            continue;
+        }
+
+        const auto [x, y] = vtPages.slot(*slot);
+
+        VkBufferImageCopy copy{};
+        copy.bufferOffset = VkDeviceSize(l.staging) * vt::tileStride;
+        copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        copy.imageSubresource.layerCount = 1;
+        copy.imageOffset = { int32_t(x * vt::slotSize), int32_t(y * vt::slotSize), 0 };
+        copy.imageExtent = { vt::slotSize, vt::slotSize, 1 };
+        vtCopies.push_back(copy);
+
+        // this frame copies out of it
+        deletions.push(frameNumber, [this, s = l.staging] { vtFreeStaging.push_back(s); });
+    }
+
+    jobs.rethrowIfFailed(vtLoads);
+
+    // no more than there are slots to put them in, coarsest first so everything has something to fall back to soonest
+    const uint32_t room = vtPages.room(frameNumber);
+    const uint32_t space = room > vtPages.inFlight() ? room - vtPages.inFlight() : 0;
+    const size_t count = std::min({ missing.size(), vtFreeStaging.size(), size_t(space), size_t(vtLoadsPerFrame) });
+    if (count == 0) {
+        return;
+    }
+
+    std::vector<io::request> batch(count);
+    std::vector<tileLoad> loads(count);
+    for (size_t i = 0; i < count; i++) {
+        const uint32_t page = missing[i];
+        const vt::tileFile& f = *vtFiles[vtPages.texture(page)];
+
+        loads[i] = { page, vtFreeStaging.back() };
+        vtFreeStaging.pop_back();
+        vtPages.loading(page);
+
+        batch[i].fd = f.fd();
+        batch[i].offset = f.offset(vtPages.local(page));
+        batch[i].size = vt::tileStride;
+        batch[i].dst = vtStagingMap + VkDeviceSize(loads[i].staging) * vt::tileStride;
+        batch[i].buffer = vtStagingIndex;
+    }
+
+    // one batch, so they're all queued on the device together
+    jobs.submit(vtLoads, [this, batch = std::move(batch), loads = std::move(loads)]() mutable {
+        PROF_ZONE("load pages");
+
+        files.read(batch);
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (batch[i].read != batch[i].size) {
+                throw std::runtime_error("cannot read virtual texture page, tile file is short!");
+            }
+            vtLoaded.push(loads[i]);
+        }
+    });
+}
+
+// barriers on the cache and the table come from the frame graph
+void appvk::recordVirtualUpload(VkCommandBuffer cbuf) {
+    if (!vtCopies.empty()) {
+        vkCmdCopyBufferToImage(cbuf, vtStaging.buf, vtCache.im, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, vtCopies.size(), vtCopies.data());
+        vtCopies.clear();
+    }
+
+    // vkCmdUpdateBuffer takes at most 64 KiB at a time
+    constexpr VkDeviceSize maxUpdate = 65536;
+    auto update = [&](VkDeviceSize offset, const void* data, VkDeviceSize size) {
+        for (VkDeviceSize done = 0; done < size; done += maxUpdate) {
+            vkCmdUpdateBuffer(cbuf, vtTable.buf, offset + done, std::min(maxUpdate, size - done), static_cast<const uint8_t*>(data) + done);
+        }
+    };
+
+    if (vtPages.texturesDirty()) {
+        update(0, vtPages.textures().data(), vtPages.textures().size() * sizeof(vt::textureInfo));
+    }
+
+    const auto [from, to] = vtPages.dirty();
+    if (from != to) {
+        update(sizeof(vt::textureInfo) * vt::maxTextures + VkDeviceSize(from) * sizeof(uint32_t),
+            vtPages.table().data() + from, VkDeviceSize(to - from) * sizeof(uint32_t));
+    }
+
+    vtPages.clean();
+}
+
+// this frame's slice, read once its fence has signalled. the graph doesn't do host access, so that barrier is here
+void appvk::recordVirtualReadback(VkCommandBuffer cbuf) {
+    VkBufferCopy copy{};
+    copy.dstOffset = currFrame * feedbackBytes;
+    copy.size = feedbackBytes;
+    vkCmdCopyBuffer(cbuf, vtFeedback.buf, vtReadback.buf, 1, &copy);
+
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = vtReadback.buf;
+    barrier.offset = copy.dstOffset;
+    barrier.size = copy.size;
+
+    vkCmdPipelineBarrier(cbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
@@ -0,0 +1,440 @@
+#include "vtex.hpp"
+
+#include "cpuprof.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace vt {
+    namespace {
+        constexpr uint32_t magic = 0x78657476; // "vtex"
+        constexpr uint32_t version = 1;
+        constexpr uint64_t dataOffset = io::directAlignment; // tiles start on the page after the header
+
+        struct fileHeader {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t width;
+            uint32_t height;
+            uint32_t pages;
+            uint32_t tileStride;
+        };
+
+        uint32_t roundUpPow2(uint32_t n) {
+            uint32_t p = 1;
+            while (p < n) {
+                p <<= 1;
+            }
+            return p;
+        }
+
+        float toLinear(uint8_t c) {
+            const float s = c / 255.0f;
+            return s <= 0.04045f ? s / 12.92f : std::pow((s + 0.055f) / 1.055f, 2.4f);
+        }
+
+        uint8_t toSrgb(float l) {
+            l = std::clamp(l, 0.0f, 1.0f);
+            const float s = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            return uint8_t(s * 255.0f + 0.5f);
+        }
+
+        // rgba, colour linear and alpha as is
+        struct level {
+            uint32_t width = 0;
+            uint32_t height = 0;
+            std::vector<float> texels;
+
+            const float* at(uint32_t x, uint32_t y) const { return &texels[(size_t(y) * width + x) * 4]; }
+        };
+
+        level decode(uint32_t width, uint32_t height, const uint8_t* pixels) {
+            std::array<float, 256> lut;
+            for (int i = 0; i < 256; i++) {
+                lut[i] = toLinear(uint8_t(i));
+            }
+
+            level l{ width, height, std::vector<float>(size_t(width) * height * 4) };
+            for (size_t i = 0; i < l.texels.size(); i++) {
+                l.texels[i] = i % 4 == 3 ? pixels[i] / 255.0f : lut[pixels[i]];
+            }
+            return l;
+        }
+
+        // bilinear with wrapping, only ever upsampling to the next power of two
+        level resample(const level& src, uint32_t width, uint32_t height) {
+            level dst{ width, height, std::vector<float>(size_t(width) * height * 4) };
+
+            for (uint32_t y = 0; y < height; y++) {
+                const float sy = (y + 0.5f) * src.height / height - 0.5f;
+                const float fy = sy - std::floor(sy);
+                const uint32_t y0 = uint32_t(int64_t(std::floor(sy)) + src.height) % src.height;
+                const uint32_t y1 = (y0 + 1) % src.height;
+
+                for (uint32_t x = 0; x < width; x++) {
+                    const float sx = (x + 0.5f) * src.width / width - 0.5f;
+                    const float fx = sx - std::floor(sx);
+                    const uint32_t x0 = uint32_t(int64_t(std::floor(sx)) + src.width) % src.width;
+                    const uint32_t x1 = (x0 + 1) % src.width;
+
+                    float* out = &dst.texels[(size_t(y) * width + x) * 4];
+                    for (int c = 0; c < 4; c++) {
+                        const float top = src.at(x0, y0)[c] * (1.0f - fx) + src.at(x1, y0)[c] * fx;
+                        const float bottom = src.at(x0, y1)[c] * (1.0f - fx) + src.at(x1, y1)[c] * fx;
+                        out[c] = top * (1.0f - fy) + bottom * fy;
+                    }
+                }
+            }
+            return dst;
+        }
+
+        // a 2x2 box, a side that's already one texel just repeats
+        level halve(const level& src) {
+            level dst{ std::max(src.width / 2, 1u), std::max(src.height / 2, 1u), {} };
+            dst.texels.resize(size_t(dst.width) * dst.height * 4);
+
+            for (uint32_t y = 0; y < dst.height; y++) {
+                const uint32_t y0 = std::min(2 * y, src.height - 1);
+                const uint32_t y1 = std::min(2 * y + 1, src.height - 1);
+                for (uint32_t x = 0; x < dst.width; x++) {
+                    const uint32_t x0 = std::min(2 * x, src.width - 1);
+                    const uint32_t x1 = std::min(2 * x + 1, src.width - 1);
+
+                    float* out = &dst.texels[(size_t(y) * dst.width + x) * 4];
+                    for (int c = 0; c < 4; c++) {
+                        out[c] = 0.25f * (src.at(x0, y0)[c] + src.at(x1, y0)[c] + src.at(x0, y1)[c] + src.at(x1, y1)[c]);
+                    }
+                }
+            }
+            return dst;
+        }
+    }
+
+    layout layoutFor(uint32_t width, uint32_t height) {
+        layout l;
+        l.width = width;
+        l.height = height;
+
+        for (uint32_t w = width, h = height;; w = std::max(w / 2, 1u), h = std::max(h / 2, 1u)) {
+            if (l.levels == maxLevels) {
+                throw std::runtime_error("cannot make a virtual texture that large!");
+            }
+
+            l.pagesX[l.levels] = (w + pageSize - 1) / pageSize;
+            l.pagesY[l.levels] = (h + pageSize - 1) / pageSize;
+            l.first[l.levels] = l.pages;
+            l.pages += l.pagesX[l.levels] * l.pagesY[l.levels];
+            l.levels++;
+
+            if (w == 1 && h == 1) {
+                return l;
+            }
+        }
+    }
+
+    uint32_t entry(uint32_t slotX, uint32_t slotY, uint32_t level) {
+        return 0x80000000u | (level << 24) | (slotY << 12) | slotX;
+    }
+
+    std::string pathFor(std::string_view source) {
+        return std::string(source) + ".vt";
+    }
+
+    bool fresh(std::string_view source) {
+        struct stat src, dst;
+        if (stat(std::string(source).c_str(), &src) != 0 || stat(pathFor(source).c_str(), &dst) != 0) {
+            return false;
+        }
+        return dst.st_mtime >= src.st_mtime;
+    }
+
+    void bake(std::string_view path, uint32_t width, uint32_t height, const uint8_t* pixels) {
+        PROF_ZONE("bake virtual texture");
+
+        level l = decode(width, height, pixels);
+        if (roundUpPow2(width) != width || roundUpPow2(height) != height) {
+            l = resample(l, roundUpPow2(width), roundUpPow2(height));
+        }
+        const layout lay = layoutFor(l.width, l.height);
+
+        fileHeader h{};
+        h.magic = magic;
+        h.version = version;
+        h.width = lay.width;
+        h.height = lay.height;
+        h.pages = lay.pages;
+        h.tileStride = tileStride;
+
+        const std::string p(path);
+        const std::string temp = p + ".tmp";
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            const std::vector<char> zeros(dataOffset, 0);
+            out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+            out.write(zeros.data(), dataOffset - sizeof(h));
+
+            std::vector<uint8_t> encoded;
+            std::vector<uint8_t> tile(tileStride, 0); // the padding stays zero
+            for (uint32_t lv = 0; lv < lay.levels; lv++) {
+                if (lv > 0) {
+                    l = halve(l);
+                }
+
+                encoded.resize(l.texels.size());
+                for (size_t i = 0; i < encoded.size(); i++) {
+                    encoded[i] = i % 4 == 3 ? uint8_t(std::clamp(l.texels[i], 0.0f, 1.0f) * 255.0f + 0.5f) : toSrgb(l.texels[i]);
+                }
+
+                for (uint32_t py = 0; py < lay.pagesY[lv]; py++) {
+                    for (uint32_t px = 0; px < lay.pagesX[lv]; px++) {
+                        // levels smaller than a page repeat across it, like the sampler would
+                        for (uint32_t ty = 0; ty < slotSize; ty++) {
+                            const int64_t sy = int64_t(py) * pageSize + ty - border;
+                            const uint32_t y = uint32_t((sy % l.height + l.height) % l.height);
+                            for (uint32_t tx = 0; tx < slotSize; tx++) {
+                                const int64_t sx = int64_t(px) * pageSize + tx - border;
+                                const uint32_t x = uint32_t((sx % l.width + l.width) % l.width);
+                                std::memcpy(&tile[(size_t(ty) * slotSize + tx) * 4], &encoded[(size_t(y) * l.width + x) * 4], 4);
+                            }
+                        }
+                        out.write(reinterpret_cast<const char*>(tile.data()), tile.size());
+                    }
+                }
+            }
+
+            if (!out) {
+                std::remove(temp.c_str());
+                throw std::runtime_error("cannot write " + temp + "!");
+            }
+        }
+
+        if (std::rename(temp.c_str(), p.c_str()) != 0) {
+            std::remove(temp.c_str());
+            throw std::runtime_error("cannot write " + p + "!");
+        }
+    }
+
+    tileFile::tileFile(std::string_view path) : f(path) {
+        fileHeader h{};
+        if (::pread(f.fd(), &h, sizeof(h), 0) != ssize_t(sizeof(h)) || h.magic != magic || h.version != version
+            || h.tileStride != tileStride || h.width == 0 || h.height == 0) {
+            throw std::runtime_error("invalid tile file " + std::string(path) + "!");
+        }
+
+        l = layoutFor(h.width, h.height);
+        if (l.pages != h.pages || f.size() < dataOffset + uint64_t(l.pages) * tileStride) {
+            throw std::runtime_error("invalid tile file " + std::string(path) + "!");
+        }
+    }
+
+    uint64_t tileFile::offset(uint32_t page) const {
+        return dataOffset + uint64_t(page) * tileStride;
+    }
+
+    void residency::init(uint32_t slotsX, uint32_t slotsY) {
+        this->slotsX = slotsX;
+        this->slotsY = slotsY;
+
+        owners.assign(slots(), none);
+        freeSlots.clear();
+        for (uint32_t s = slots(); s-- > 0;) {
+            freeSlots.push_back(s); // popped from the back, so slots fill from the top left
+        }
+    }
+
+    uint32_t residency::add(const layout& l) {
+        if (infos.size() == maxTextures || pages.size() + l.pages > maxPages) {
+            throw std::runtime_error("cannot fit virtual texture in the page table!");
+        }
+
+        const uint32_t id = infos.size();
+        const uint32_t base = pages.size();
+
+        textureInfo info;
+        info.width = l.width;
+        info.height = l.height;
+        info.levels = l.levels;
+        for (uint32_t lv = 0; lv < l.levels; lv++) {
+            info.offsets[lv] = base + l.first[lv];
+            for (uint32_t y = 0; y < l.pagesY[lv]; y++) {
+                for (uint32_t x = 0; x < l.pagesX[lv]; x++) {
+                    page p;
+                    p.texture = id;
+                    p.level = uint8_t(lv);
+                    p.x = uint16_t(x);
+                    p.y = uint16_t(y);
+                    pages.push_back(p);
+                }
+            }
+        }
+        infos.push_back(info);
+        infosDirty = true;
+
+        entries.resize(pages.size(), 0); // nothing to fall back to until the last level arrives
+        wanted.resize(pages.size(), UINT64_MAX);
+
+        pages.back().pinned = true;
+        pinned.push_back(pages.size() - 1);
+
+        return id;
+    }
+
+    std::vector<uint32_t> residency::use(const uint32_t* feedback, uint64_t frame) {
+        std::vector<uint32_t> missing;
+
+        auto want = [&](uint32_t p) {
+            if (pages[p].st == state::absent && wanted[p] != frame) {
+                wanted[p] = frame;
+                missing.push_back(p);
+            }
+        };
+
+        for (uint32_t word = 0; word < (pages.size() + 31) / 32; word++) {
+            for (uint32_t bits = feedback[word]; bits != 0; bits &= bits - 1) {
+                const uint32_t first = word * 32 + __builtin_ctz(bits);
+                if (first >= pages.size()) {
+                    break;
+                }
+
+                // coarser pages are what it falls back to and what trilinear blends with, so they're kept too
+                for (std::optional<uint32_t> p = first; p && pages[*p].used != frame; p = parent(*p)) {
+                    pages[*p].used = frame;
+                    want(*p);
+                }
+            }
+        }
+
+        for (uint32_t p : pinned) {
+            want(p);
+        }
+
+        std::stable_sort(missing.begin(), missing.end(), [&](uint32_t a, uint32_t b) { return pages[a].level > pages[b].level; });
+        return missing;
+    }
+
+    void residency::loading(uint32_t p) {
+        pages[p].st = state::loading;
+        loadingCount++;
+    }
+
+    std::optional<uint32_t> residency::place(uint32_t p, uint64_t frame) {
+        loadingCount--;
+
+        if (freeSlots.empty()) {
+            // a scan, but there are only ever a few hundred slots and a few dozen loads a frame
+            uint32_t victim = none;
+            for (uint32_t owner : owners) {
+                const page& o = pages[owner];
+                if (!o.pinned && o.used + sweep <= frame && (victim == none || o.used < pages[victim].used)) {
+                    victim = owner;
+                }
+            }
+
+            if (victim == none) {
+                pages[p].st = state::absent; // the cache is too small for what's on screen
+                return std::nullopt;
+            }
+            evict(victim);
+        }
+
+        const uint32_t s = freeSlots.back();
+        freeSlots.pop_back();
+        owners[s] = p;
+
+        page& pg = pages[p];
+        pg.st = state::resident;
+        pg.slot = s;
+        pg.used = std::max(pg.used, frame); // so it isn't the next to go
+        residentCount++;
+
+        const uint32_t e = entry(s % slotsX, s / slotsX, pg.level);
+        set(p, e);
+        inherit(p, e);
+
+        return s;
+    }
+
+    uint32_t residency::room(uint64_t frame) const {
+        uint32_t n = freeSlots.size();
+        for (uint32_t owner : owners) {
+            if (owner != none && !pages[owner].pinned && pages[owner].used + sweep <= frame) {
+                n++;
+            }
+        }
+        return n;
+    }
+
+    void residency::clean() {
+        dirtyFrom = dirtyTo = 0;
+        infosDirty = false;
+    }
+
+    std::optional<uint32_t> residency::parent(uint32_t p) const {
+        const page& pg = pages[p];
+        const textureInfo& info = infos[pg.texture];
+        if (pg.level + 1u >= info.levels) {
+            return std::nullopt;
+        }
+
+        const uint32_t w = std::max(info.width >> (pg.level + 1), 1u);
+        const uint32_t pagesX = (w + pageSize - 1) / pageSize;
+        return info.offsets[pg.level + 1] + (pg.y / 2u) * pagesX + pg.x / 2u;
+    }
+
+    void residency::set(uint32_t p, uint32_t e) {
+        entries[p] = e;
+
+        if (dirtyFrom == dirtyTo) {
+            dirtyFrom = p;
+            dirtyTo = p + 1;
+        } else {
+            dirtyFrom = std::min(dirtyFrom, p);
+            dirtyTo = std::max(dirtyTo, p + 1);
+        }
+    }
+
+    void residency::inherit(uint32_t p, uint32_t e) {
+        const page& pg = pages[p];
+        if (pg.level == 0) {
+            return;
+        }
+
+        const textureInfo& info = infos[pg.texture];
+        const uint32_t w = std::max(info.width >> (pg.level - 1), 1u);
+        const uint32_t h = std::max(info.height >> (pg.level - 1), 1u);
+        const uint32_t pagesX = (w + pageSize - 1) / pageSize;
+        const uint32_t pagesY = (h + pageSize - 1) / pageSize;
+
+        for (uint32_t y = 2u * pg.y; y < std::min(2u * pg.y + 2, pagesY); y++) {
+            for (uint32_t x = 2u * pg.x; x < std::min(2u * pg.x + 2, pagesX); x++) {
+                const uint32_t child = info.offsets[pg.level - 1] + y * pagesX + x;
+                if (pages[child].st != state::resident) {
+                    set(child, e);
+                    inherit(child, e);
+                }
+            }
+        }
+    }
+
+    // what it leaves behind falls back to its parent's entry, which is itself a fallback if the parent is missing
+    void residency::evict(uint32_t p) {
+        page& pg = pages[p];
+        owners[pg.slot] = none;
+        freeSlots.push_back(pg.slot);
+        pg.slot = none;
+        pg.st = state::absent;
+        residentCount--;
+
+        const std::optional<uint32_t> up = parent(p);
+        const uint32_t e = up ? entries[*up] : 0;
+        set(p, e);
+        inherit(p, e);
+    }
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "fileio.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Virtual textures. Every mip level of a texture is cut into pages and written to a tile file next to
+// its source, and only the pages the last frames sampled are kept, in slots of a fixed size cache texture.
+// A page table maps each page to its slot, or to the nearest coarser page that is in one, so a texture
+// can be sampled whatever has arrived so far and texture memory doesn't grow with the textures.
+namespace vt {
+    constexpr uint32_t pageSize = 128; // texels along a side
+    constexpr uint32_t border = 4; // texels of the neighbouring pages kept around each one, so filtering stays in its slot
+    constexpr uint32_t slotSize = pageSize + 2 * border;
+    constexpr size_t tileBytes = size_t(slotSize) * slotSize * 4; // rgba8
+    constexpr size_t tileStride = (tileBytes + io::directAlignment - 1) / io::directAlignment * io::directAlignment;
+
+    constexpr uint32_t maxLevels = 16;
+    constexpr uint32_t maxTextures = 8; // textures[] in shader.frag
+    constexpr uint32_t maxPages = 1 << 16; // page table entries, across every texture
+    constexpr uint32_t none = UINT32_MAX; // no texture, shader.frag samples the map's flat default instead
+    constexpr uint64_t sweep = 16; // frames shader.frag takes to record feedback from every pixel, a pixel in 16 a frame
+
+    // levels halve down to a single texel, those smaller than a page take one page each
+    struct layout {
+        uint32_t width = 0; // powers of two
+        uint32_t height = 0;
+        uint32_t levels = 0;
+        std::array<uint32_t, maxLevels> pagesX = {};
+        std::array<uint32_t, maxLevels> pagesY = {};
+        std::array<uint32_t, maxLevels> first = {}; // of each level, pages go level by level in rows
+        uint32_t pages = 0;
+    };
+    layout layoutFor(uint32_t width, uint32_t height);
+
+    // the start of the page table buffer, vtTexture in shader.frag
+    struct textureInfo {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t levels = 0;
+        uint32_t pad = 0;
+        std::array<uint32_t, maxLevels> offsets = {}; // entry of each level's first page
+    };
+    static_assert(sizeof(textureInfo) == 80, "vtTexture is 80 bytes in std430");
+
+    // the page table entry of a page in a slot, or of a missing one that falls back to it
+    uint32_t entry(uint32_t slotX, uint32_t slotY, uint32_t level);
+
+    std::string pathFor(std::string_view source);
+
+    // there's a tile file at least as new as source
+    bool fresh(std::string_view source);
+
+    // sizes are rounded up to powers of two and mips built in linear space, then every page is written with a
+    // border that wraps round the edges, since the textures repeat. written to a temporary and renamed, throws on failure
+    void bake(std::string_view path, uint32_t width, uint32_t height, const uint8_t* pixels);
+
+    // tiles are read straight from here as they're needed
+    class tileFile {
+    public:
+        explicit tileFile(std::string_view path); // throws if it isn't a tile file
+
+        const layout& pages() const { return l; }
+        int fd() const { return f.fd(); }
+        uint64_t offset(uint32_t page) const; // page within this texture
+
+    private:
+        io::file f;
+        layout l;
+    };
+
+    // what's resident where. the table is kept here and copied to the gpu as is
+    class residency {
+    public:
+        void init(uint32_t slotsX, uint32_t slotsY);
+
+        // a texture's pages, none of them resident yet, returns its id. throws once the table is full
+        uint32_t add(const layout& l);
+
+        // pages set in feedback, a bit per entry, and every coarser page above them are used this frame. returns those
+        // neither resident nor loading, coarsest first, along with any texture's last level, which is always wanted
+        std::vector<uint32_t> use(const uint32_t* feedback, uint64_t frame);
+        void loading(uint32_t page);
+
+        // the slot a loaded page goes in, taking the least recently used page's if none is free. pages used within the
+        // last sweep may still be on screen, if every page in the cache was it's nullopt and the page is dropped, to be
+        // asked for again
+        std::optional<uint32_t> place(uint32_t page, uint64_t frame);
+
+        // slots free or holding pages not used within the last sweep, so loads beyond this would only be dropped
+        uint32_t room(uint64_t frame) const;
+
+        uint32_t texture(uint32_t page) const { return pages[page].texture; }
+        uint32_t local(uint32_t page) const { return page - infos[pages[page].texture].offsets[0]; } // within its texture
+        std::pair<uint32_t, uint32_t> slot(uint32_t s) const { return { s % slotsX, s / slotsX }; }
+
+        const std::vector<textureInfo>& textures() const { return infos; }
+        const std::vector<uint32_t>& table() const { return entries; }
+
+        // entries changed since the last clean, first and one past the last
+        std::pair<uint32_t, uint32_t> dirty() const { return { dirtyFrom, dirtyTo }; }
+        bool texturesDirty() const { return infosDirty; }
+        void clean();
+
+        uint32_t slots() const { return slotsX * slotsY; }
+        uint32_t resident() const { return residentCount; }
+        uint32_t inFlight() const { return loadingCount; }
+
+    private:
+        enum class state : uint8_t { absent, loading, resident };
+
+        struct page {
+            uint32_t texture = 0;
+            uint8_t level = 0;
+            state st = state::absent;
+            bool pinned = false; // a texture's last level, the fallback for all the rest
+            uint16_t x = 0;
+            uint16_t y = 0;
+            uint32_t slot = none;
+            uint64_t used = 0; // frame it was last used
+        };
+
+        uint32_t slotsX = 0;
+        uint32_t slotsY = 0;
+        std::vector<uint32_t> owners; // page in each slot
+        std::vector<uint32_t> freeSlots;
+
+        std::vector<textureInfo> infos;
+        std::vector<page> pages;
+        std::vector<uint32_t> entries;
+        std::vector<uint32_t> pinned;
+        std::vector<uint64_t> wanted; // frame each page was last asked for, so it's only asked for once
+
+        uint32_t dirtyFrom = 0;
+        uint32_t dirtyTo = 0;
+        bool infosDirty = false;
+        uint32_t residentCount = 0;
+        uint32_t loadingCount = 0;
+
+        std::optional<uint32_t> parent(uint32_t p) const;
+        void set(uint32_t p, uint32_t e);
+        void inherit(uint32_t p, uint32_t e); // every missing page below p falls back to e
+        void evict(uint32_t p);
+    };
+}